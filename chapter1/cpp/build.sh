@@ -23,3 +23,4 @@
 # SOFTWARE.
 
 g++ examples.cc -o examples `pkg-config --cflags --libs arrow`
+g++ row_builder_bench.cc -O3 -I../../utils/cpp -o row_builder_bench `pkg-config --cflags --libs arrow`
@@ -28,6 +28,7 @@
 #include <memory>
 #include <random>
 #include <vector>
+#include "row_builder.h"
 
 void first_example() {
   std::vector<int64_t> data{1, 2, 3, 4};
@@ -49,10 +50,16 @@ void random_data_example() {
   arrow::ArrayVector columns(ncols);
   arrow::FieldVector fields;
   for (int i = 0; i < ncols; ++i) {
+    // one allocation up front, then appends without capacity checks
+    auto status = builder.Reserve(nrows);
+    if (!status.ok()) {
+      std::cerr << status.message() << std::endl;
+      return;
+    }
     for (int j = 0; j < nrows; ++j) {
-      builder.Append(d(gen));
+      builder.UnsafeAppend(d(gen));
     }
-    auto status = builder.Finish(&columns[i]);
+    status = builder.Finish(&columns[i]);
     if (!status.ok()) {
       std::cerr << status.message() << std::endl;
       // do something!
@@ -132,9 +139,43 @@ void build_struct_builder() {
   std::cout << out->ToString() << std::endl;
 }
 
+// the same rows as build_struct_builder, with the schema and the builders
+// derived from the struct's members at compile time
+struct Archer {
+  std::string archer;
+  std::string location;
+  int16_t year;
+};
+
+void typed_row_builder() {
+  std::vector<Archer> archers{{"Legolas", "Murkwood", 1954},
+                              {"Oliver", "Star City", 1941},
+                              {"Merida", "Scotland", 2012},
+                              {"Lara", "London", 1996},
+                              {"Artemis", "Greece", -600}};
+
+  rows::StructRowBuilder<Archer, &Archer::archer, &Archer::location,
+                         &Archer::year>
+      builder({"archer", "location", "year"});
+  auto status = builder.Append(archers);
+  if (!status.ok()) {
+    std::cerr << status.message() << std::endl;
+    return;
+  }
+  auto batches = builder.Finish();
+  if (!batches.ok()) {
+    std::cerr << batches.status().message() << std::endl;
+    return;
+  }
+  for (const auto& batch : *batches) {
+    std::cout << batch->ToString() << std::endl;
+  }
+}
+
 int main(int argc, char** argv) {
   first_example();
   random_data_example();
   building_struct_array();
   build_struct_builder();
+  typed_row_builder();
 }
\ No newline at end of file
@@ -0,0 +1,270 @@
+// MIT License
+//
+// Copyright (c) 2021 Packt
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <arrow/api.h>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Builds record batches from plain C++ rows with the schema and the builders
+// worked out at compile time, instead of going through MakeBuilder and
+// static_cast'ing the children of a StructBuilder as build_struct_builder in
+// examples.cc does. Each column reserves room for a whole run of rows (and
+// the string bytes they need) up front, then appends without checks.
+//
+//   struct Archer { std::string archer, location; int16_t year; };
+//   rows::StructRowBuilder<Archer, &Archer::archer, &Archer::location,
+//                          &Archer::year>
+//       builder({"archer", "location", "year"});
+//   ARROW_RETURN_NOT_OK(builder.Append(archers));
+//   ARROW_ASSIGN_OR_RAISE(auto batches, builder.Finish());
+//
+// Supported field types are the arithmetic types, bool, std::string and
+// std::optional of any of those, which becomes a nullable column.
+namespace rows {
+
+template <typename T, typename = void>
+struct ColumnTraits {
+  static_assert(sizeof(T) == 0, "no Arrow column type for this field");
+};
+
+template <typename T>
+struct ColumnTraits<T, std::enable_if_t<std::is_arithmetic<T>::value>> {
+  using ArrowType = typename arrow::CTypeTraits<T>::ArrowType;
+  using BuilderType = typename arrow::TypeTraits<ArrowType>::BuilderType;
+  static constexpr bool nullable = false;
+  static constexpr bool variable_width = false;
+  static std::shared_ptr<arrow::DataType> type() {
+    return arrow::TypeTraits<ArrowType>::type_singleton();
+  }
+  static int64_t bytes(const T&) { return 0; }
+  static void UnsafeAppend(BuilderType* builder, const T& value) {
+    builder->UnsafeAppend(value);
+  }
+};
+
+template <>
+struct ColumnTraits<std::string> {
+  using BuilderType = arrow::StringBuilder;
+  static constexpr bool nullable = false;
+  static constexpr bool variable_width = true;
+  static std::shared_ptr<arrow::DataType> type() { return arrow::utf8(); }
+  static int64_t bytes(const std::string& value) { return value.size(); }
+  static void UnsafeAppend(BuilderType* builder, const std::string& value) {
+    builder->UnsafeAppend(value);
+  }
+};
+
+template <typename T>
+struct ColumnTraits<std::optional<T>> {
+  using Inner = ColumnTraits<T>;
+  using BuilderType = typename Inner::BuilderType;
+  static constexpr bool nullable = true;
+  static constexpr bool variable_width = Inner::variable_width;
+  static std::shared_ptr<arrow::DataType> type() { return Inner::type(); }
+  static int64_t bytes(const std::optional<T>& value) {
+    return value ? Inner::bytes(*value) : 0;
+  }
+  static void UnsafeAppend(BuilderType* builder,
+                           const std::optional<T>& value) {
+    if (value) {
+      Inner::UnsafeAppend(builder, *value);
+    } else {
+      builder->UnsafeAppendNull();
+    }
+  }
+};
+
+// a column read from a data member, Member<&Row::field>
+template <auto M>
+struct Member {
+  template <typename Row>
+  static const auto& Get(const Row& row) {
+    return row.*M;
+  }
+};
+
+// a column read from a tuple element, Element<0>
+template <size_t I>
+struct Element {
+  template <typename Row>
+  static const auto& Get(const Row& row) {
+    return std::get<I>(row);
+  }
+};
+
+struct RowBuilderOptions {
+  // rows per record batch; a batch is cut as soon as it is full
+  int64_t batch_rows = 1 << 16;
+  // gets each batch as it fills; unset, they're kept until Finish()
+  std::function<arrow::Status(std::shared_ptr<arrow::RecordBatch>)> sink;
+  arrow::MemoryPool* pool = arrow::default_memory_pool();
+};
+
+template <typename Row, typename... Columns>
+class RowBuilder {
+  template <typename C>
+  using Value = std::decay_t<decltype(C::Get(std::declval<const Row&>()))>;
+  template <typename C>
+  using Traits = ColumnTraits<Value<C>>;
+
+ public:
+  static constexpr size_t kNumColumns = sizeof...(Columns);
+
+  explicit RowBuilder(std::array<std::string, kNumColumns> names,
+                      RowBuilderOptions options = {})
+      : options_(std::move(options)),
+        builders_(PoolFor<Columns>(options_.pool)...) {
+    schema_ = arrow::schema(MakeFields(names, Indices{}));
+  }
+
+  const std::shared_ptr<arrow::Schema>& schema() const { return schema_; }
+
+  arrow::Status Append(const Row* rows, int64_t n) {
+    while (n > 0) {
+      const int64_t m = std::min(n, options_.batch_rows - length_);
+      ARROW_RETURN_NOT_OK(AppendRun(rows, m, Indices{}));
+      length_ += m;
+      rows += m;
+      n -= m;
+      if (length_ == options_.batch_rows) ARROW_RETURN_NOT_OK(Flush());
+    }
+    return arrow::Status::OK();
+  }
+
+  arrow::Status Append(const std::vector<Row>& rows) {
+    return Append(rows.data(), static_cast<int64_t>(rows.size()));
+  }
+
+  // one row at a time still works, but pays for a Reserve on every column
+  // per row; prefer handing over rows in bulk
+  arrow::Status Append(const Row& row) { return Append(&row, 1); }
+
+  // cuts a batch from whatever has been appended since the last one
+  arrow::Status Flush() {
+    if (length_ == 0) return arrow::Status::OK();
+    arrow::ArrayVector arrays(kNumColumns);
+    ARROW_RETURN_NOT_OK(FinishArrays(&arrays, Indices{}));
+    auto batch = arrow::RecordBatch::Make(schema_, length_, std::move(arrays));
+    length_ = 0;
+    if (options_.sink) return options_.sink(std::move(batch));
+    batches_.push_back(std::move(batch));
+    return arrow::Status::OK();
+  }
+
+  // flushes the last partial batch and hands back everything not already
+  // given to the sink
+  arrow::Result<arrow::RecordBatchVector> Finish() {
+    ARROW_RETURN_NOT_OK(Flush());
+    arrow::RecordBatchVector batches;
+    batches.swap(batches_);
+    return batches;
+  }
+
+ private:
+  using Indices = std::index_sequence_for<Columns...>;
+
+  template <typename C>
+  static arrow::MemoryPool* PoolFor(arrow::MemoryPool* pool) {
+    return pool;
+  }
+
+  template <size_t... I>
+  static arrow::FieldVector MakeFields(
+      const std::array<std::string, kNumColumns>& names,
+      std::index_sequence<I...>) {
+    return {arrow::field(names[I], Traits<Columns>::type(),
+                         Traits<Columns>::nullable)...};
+  }
+
+  // column by column: each loop touches one builder and stays tight
+  template <size_t I>
+  arrow::Status AppendColumn(const Row* rows, int64_t n) {
+    using C = std::tuple_element_t<I, std::tuple<Columns...>>;
+    using T = Traits<C>;
+    auto* builder = &std::get<I>(builders_);
+    ARROW_RETURN_NOT_OK(builder->Reserve(n));
+    if constexpr (T::variable_width) {
+      int64_t bytes = 0;
+      for (int64_t i = 0; i < n; ++i) bytes += T::bytes(C::Get(rows[i]));
+      ARROW_RETURN_NOT_OK(builder->ReserveData(bytes));
+    }
+    for (int64_t i = 0; i < n; ++i) T::UnsafeAppend(builder, C::Get(rows[i]));
+    return arrow::Status::OK();
+  }
+
+  template <size_t... I>
+  arrow::Status AppendRun(const Row* rows, int64_t n,
+                          std::index_sequence<I...>) {
+    arrow::Status status;
+    // stops at the first column that fails
+    (void)((status = AppendColumn<I>(rows, n)).ok() && ...);
+    return status;
+  }
+
+  template <size_t... I>
+  arrow::Status FinishArrays(arrow::ArrayVector* arrays,
+                             std::index_sequence<I...>) {
+    arrow::Status status;
+    (void)((status = std::get<I>(builders_).Finish(&(*arrays)[I])).ok() &&
+           ...);
+    return status;
+  }
+
+  RowBuilderOptions options_;
+  std::tuple<typename Traits<Columns>::BuilderType...> builders_;
+  std::shared_ptr<arrow::Schema> schema_;
+  int64_t length_ = 0;
+  arrow::RecordBatchVector batches_;
+};
+
+// columns from data members, in the order given
+template <typename Row, auto... Members>
+using StructRowBuilder = RowBuilder<Row, Member<Members>...>;
+
+namespace internal {
+template <typename Tuple, typename Indices>
+struct TupleRowBuilder;
+
+template <typename... Ts, size_t... I>
+struct TupleRowBuilder<std::tuple<Ts...>, std::index_sequence<I...>> {
+  using type = RowBuilder<std::tuple<Ts...>, Element<I>...>;
+};
+}  // namespace internal
+
+// one column per element of std::tuple<Ts...>
+template <typename... Ts>
+using TupleRowBuilder = typename internal::TupleRowBuilder<
+    std::tuple<Ts...>, std::index_sequence_for<Ts...>>::type;
+
+}  // namespace rows
@@ -0,0 +1,295 @@
+// MIT License
+//
+// Copyright (c) 2021 Packt
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <arrow/api.h>
+#include <arrow/io/api.h>
+#include <arrow/util/compression.h>
+#include <arrow/util/config.h>
+#include <parquet/arrow/reader.h>
+#include <parquet/arrow/writer.h>
+#include <parquet/properties.h>
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Parquet writing tuned per table instead of by hand. A sample of every
+// column is written once per candidate encoding and codec and read back;
+// the candidate with the lowest cost wins, where cost is the output size
+// in MiB plus the read time, read_seconds_per_mib seconds counting as much
+// as one MiB. The chosen candidates' bytes per row then size the row
+// groups to about target_row_group_bytes.
+//
+// Candidates: dictionary and plain for every type, byte stream split for
+// floating point, and, when the Arrow version can write them, delta binary
+// packed for integers (8 and up) and delta length byte array for strings
+// (13 and up). A candidate the writer rejects anyway is reported as
+// unsupported and left out of the choice.
+namespace adaptive {
+
+struct AdaptiveOptions {
+  int64_t target_row_group_bytes = int64_t(128) << 20;  // compressed
+  int64_t sample_rows = 1 << 16;
+  int sample_slices = 8;  // contiguous runs spread over the table
+  std::vector<arrow::Compression::type> codecs = {
+      arrow::Compression::UNCOMPRESSED, arrow::Compression::SNAPPY,
+      arrow::Compression::LZ4, arrow::Compression::ZSTD};
+  // read time that costs as much as one MiB of output
+  double read_seconds_per_mib = 0.01;
+};
+
+struct Candidate {
+  bool dictionary = false;
+  parquet::Encoding::type encoding = parquet::Encoding::PLAIN;
+  arrow::Compression::type codec = arrow::Compression::UNCOMPRESSED;
+  int64_t bytes = 0;  // of the sample file
+  double write_seconds = 0;
+  double read_seconds = 0;
+  bool supported = true;  // false if the trial write or read failed
+
+  std::string ToString() const {
+    auto name = dictionary ? std::string("DICTIONARY")
+                           : parquet::EncodingToString(encoding);
+    return name + "/" + arrow::util::Codec::GetCodecAsString(codec);
+  }
+};
+
+struct ColumnChoice {
+  std::string name;
+  Candidate chosen;
+  std::vector<Candidate> tried;
+};
+
+struct AdaptiveReport {
+  std::vector<ColumnChoice> columns;
+  int64_t rows_per_row_group = 0;
+  int64_t file_bytes = 0;
+  double write_seconds = 0;
+  double read_seconds = 0;  // whole file read back with ReadTable
+
+  void Print(std::ostream& os = std::cout) const {
+    for (const auto& column : columns) {
+      os << column.name << ": " << column.chosen.ToString() << std::endl;
+      for (const auto& tried : column.tried) {
+        os << "  " << std::left << std::setw(32) << tried.ToString();
+        if (!tried.supported) {
+          os << "unsupported" << std::endl;
+          continue;
+        }
+        os << tried.bytes << " bytes, write "
+           << tried.write_seconds * 1e3 << " ms, read "
+           << tried.read_seconds * 1e3 << " ms" << std::endl;
+      }
+    }
+    os << rows_per_row_group << " rows per row group, " << file_bytes
+       << " bytes, written in " << write_seconds << " s ("
+       << file_bytes / write_seconds / (1 << 20) << " MiB/s), read in "
+       << read_seconds << " s (" << file_bytes / read_seconds / (1 << 20)
+       << " MiB/s)" << std::endl;
+  }
+};
+
+namespace detail {
+
+inline double Seconds(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+// sample_slices runs of rows taken at even steps through the table
+inline arrow::Result<std::shared_ptr<arrow::Table>> Sample(
+    const std::shared_ptr<arrow::Table>& table,
+    const AdaptiveOptions& options) {
+  if (table->num_rows() <= options.sample_rows) return table;
+  const int64_t slice_rows = options.sample_rows / options.sample_slices;
+  const int64_t step = table->num_rows() / options.sample_slices;
+  std::vector<std::shared_ptr<arrow::Table>> slices;
+  for (int i = 0; i < options.sample_slices; ++i) {
+    slices.push_back(table->Slice(i * step, slice_rows));
+  }
+  ARROW_ASSIGN_OR_RAISE(auto sample, arrow::ConcatenateTables(slices));
+  return sample->CombineChunks();
+}
+
+inline std::vector<parquet::Encoding::type> Encodings(
+    const arrow::DataType& type) {
+  std::vector<parquet::Encoding::type> encodings = {parquet::Encoding::PLAIN};
+  switch (type.id()) {
+#if ARROW_VERSION_MAJOR >= 8
+    case arrow::Type::INT32:
+    case arrow::Type::INT64:
+    case arrow::Type::DATE32:
+    case arrow::Type::TIMESTAMP:
+      encodings.push_back(parquet::Encoding::DELTA_BINARY_PACKED);
+      break;
+#endif
+    case arrow::Type::FLOAT:
+    case arrow::Type::DOUBLE:
+      encodings.push_back(parquet::Encoding::BYTE_STREAM_SPLIT);
+      break;
+#if ARROW_VERSION_MAJOR >= 13
+    case arrow::Type::STRING:
+    case arrow::Type::BINARY:
+      encodings.push_back(parquet::Encoding::DELTA_LENGTH_BYTE_ARRAY);
+      break;
+#endif
+    default:
+      break;
+  }
+  return encodings;
+}
+
+inline void Apply(const std::string& column, const Candidate& candidate,
+                  parquet::WriterProperties::Builder* properties) {
+  properties->compression(column, candidate.codec);
+  if (candidate.dictionary) {
+    properties->enable_dictionary(column);
+  } else {
+    properties->disable_dictionary(column);
+    properties->encoding(column, candidate.encoding);
+  }
+}
+
+// writes the one column sample with this candidate and reads it back
+inline arrow::Status Trial(const std::shared_ptr<arrow::Table>& sample,
+                           Candidate* candidate) {
+  parquet::WriterProperties::Builder properties;
+  Apply(sample->field(0)->name(), *candidate, &properties);
+  ARROW_ASSIGN_OR_RAISE(auto sink, arrow::io::BufferOutputStream::Create());
+  auto start = std::chrono::steady_clock::now();
+  ARROW_RETURN_NOT_OK(parquet::arrow::WriteTable(
+      *sample, arrow::default_memory_pool(), sink, sample->num_rows(),
+      properties.build()));
+  ARROW_ASSIGN_OR_RAISE(auto buffer, sink->Finish());
+  candidate->write_seconds = Seconds(start);
+  candidate->bytes = buffer->size();
+
+  start = std::chrono::steady_clock::now();
+  std::unique_ptr<parquet::arrow::FileReader> reader;
+  ARROW_RETURN_NOT_OK(parquet::arrow::OpenFile(
+      std::make_shared<arrow::io::BufferReader>(buffer),
+      arrow::default_memory_pool(), &reader));
+  std::shared_ptr<arrow::Table> read;
+  ARROW_RETURN_NOT_OK(reader->ReadTable(&read));
+  candidate->read_seconds = Seconds(start);
+  return arrow::Status::OK();
+}
+
+inline double Cost(const Candidate& candidate,
+                   const AdaptiveOptions& options) {
+  return static_cast<double>(candidate.bytes) / (1 << 20) +
+         candidate.read_seconds / options.read_seconds_per_mib;
+}
+
+}  // namespace detail
+
+// Tries the candidates on a sample of each column. Nested columns, and
+// columns no candidate could be written for, keep the writer defaults.
+inline arrow::Result<AdaptiveReport> Choose(
+    const std::shared_ptr<arrow::Table>& table,
+    const AdaptiveOptions& options) {
+  ARROW_ASSIGN_OR_RAISE(auto sample, detail::Sample(table, options));
+  AdaptiveReport report;
+  double bytes_per_row = 0;
+  for (int i = 0; i < sample->num_columns(); ++i) {
+    const auto& field = sample->field(i);
+    if (arrow::is_nested(field->type()->id())) continue;
+    auto column = arrow::Table::Make(arrow::schema({field}),
+                                     {sample->column(i)});
+
+    ColumnChoice choice;
+    choice.name = field->name();
+    std::vector<std::pair<bool, parquet::Encoding::type>> layouts = {
+        {true, parquet::Encoding::PLAIN}};
+    for (auto encoding : detail::Encodings(*field->type())) {
+      layouts.emplace_back(false, encoding);
+    }
+    for (const auto& layout : layouts) {
+      for (auto codec : options.codecs) {
+        if (!arrow::util::Codec::IsAvailable(codec)) continue;
+        Candidate candidate;
+        candidate.dictionary = layout.first;
+        candidate.encoding = layout.second;
+        candidate.codec = codec;
+        candidate.supported = detail::Trial(column, &candidate).ok();
+        choice.tried.push_back(candidate);
+      }
+    }
+    const Candidate* best = nullptr;
+    for (const auto& candidate : choice.tried) {
+      if (candidate.supported &&
+          (best == nullptr ||
+           detail::Cost(candidate, options) < detail::Cost(*best, options))) {
+        best = &candidate;
+      }
+    }
+    if (best == nullptr) continue;
+    choice.chosen = *best;
+    bytes_per_row += static_cast<double>(choice.chosen.bytes) /
+                     std::max<int64_t>(1, sample->num_rows());
+    report.columns.push_back(std::move(choice));
+  }
+  report.rows_per_row_group = std::max<int64_t>(
+      1024, static_cast<int64_t>(options.target_row_group_bytes /
+                                 std::max(bytes_per_row, 1e-3)));
+  return report;
+}
+
+// Chooses per column settings and row group size, writes the table with
+// them and times reading it back.
+inline arrow::Result<AdaptiveReport> WriteAdaptive(
+    const std::shared_ptr<arrow::Table>& table, const std::string& path,
+    const AdaptiveOptions& options) {
+  ARROW_ASSIGN_OR_RAISE(auto report, Choose(table, options));
+  parquet::WriterProperties::Builder properties;
+  properties.max_row_group_length(report.rows_per_row_group);
+  for (const auto& column : report.columns) {
+    detail::Apply(column.name, column.chosen, &properties);
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  ARROW_ASSIGN_OR_RAISE(auto output, arrow::io::FileOutputStream::Open(path));
+  ARROW_RETURN_NOT_OK(parquet::arrow::WriteTable(
+      *table, arrow::default_memory_pool(), output, report.rows_per_row_group,
+      properties.build()));
+  ARROW_RETURN_NOT_OK(output->Close());
+  report.write_seconds = detail::Seconds(start);
+
+  start = std::chrono::steady_clock::now();
+  ARROW_ASSIGN_OR_RAISE(auto input, arrow::io::ReadableFile::Open(path));
+  ARROW_ASSIGN_OR_RAISE(report.file_bytes, input->GetSize());
+  std::unique_ptr<parquet::arrow::FileReader> reader;
+  ARROW_RETURN_NOT_OK(parquet::arrow::OpenFile(
+      input, arrow::default_memory_pool(), &reader));
+  std::shared_ptr<arrow::Table> read;
+  ARROW_RETURN_NOT_OK(reader->ReadTable(&read));
+  report.read_seconds = detail::Seconds(start);
+  return report;
+}
+
+}  // namespace adaptive
@@ -25,5 +25,12 @@
 g++ csv_reader.cc -o csv_reader `pkg-config --cflags --libs arrow-csv`
 g++ csv_writer.cc -o csv_writer `pkg-config --cflags --libs arrow-csv`
 g++ json_reader.cc -o json_reader `pkg-config --cflags --libs arrow-json`
-g++ orc_reader_writer.cc -o orc_reader_writer `pkg-config --cflags --libs arrow-orc`
-g++ parquet_reader_writer.cc -o parquet_reader_writer `pkg-config --cflags --libs parquet`
\ No newline at end of file
+# orc_reader_writer reads stripe statistics with liborc itself, so
+# <orc/OrcFile.hh> and -lorc have to come from a system liborc (liborc-dev,
+# or the orc package from conda-forge or Homebrew). An Arrow built with its
+# bundled ORC installs neither the headers nor the library.
+g++ orc_reader_writer.cc -o orc_reader_writer `pkg-config --cflags --libs arrow-orc arrow-dataset` -lorc
+g++ parquet_reader_writer.cc -I../../utils/cpp -o parquet_reader_writer `pkg-config --cflags --libs parquet`
+g++ csv_ingest.cc -O3 -o csv_ingest `pkg-config --cflags --libs arrow-csv parquet`
+g++ csv_writer_bench.cc -O3 -I../../utils/cpp -o csv_writer_bench `pkg-config --cflags --libs arrow-csv`
+g++ json_reader_bench.cc -O3 -I../../utils/cpp -o json_reader_bench `pkg-config --cflags --libs arrow-json`
@@ -0,0 +1,44 @@
+// MIT License
+//
+// Copyright (c) 2021 Packt
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <iostream>
+#include <string>
+#include "csv_ingest.h"
+
+// csv_ingest [input.csv] [output] [parquet|ipc] [max memory in MiB]
+int main(int argc, char** argv) {
+  std::string input = argc > 1 ? argv[1] : "../../sample_data/train.csv";
+  std::string output = argc > 2 ? argv[2] : "train.parquet";
+
+  ingest::IngestOptions options;
+  if (argc > 3 && std::string(argv[3]) == "ipc") {
+    options.format = ingest::Format::kIpc;
+  }
+  if (argc > 4) options.max_memory_bytes = std::stoll(argv[4]) << 20;
+
+  auto stats = ingest::IngestCsv(input, output, options);
+  if (!stats.ok()) {
+    std::cerr << stats.status().message() << std::endl;
+    return 1;
+  }
+  stats->Print();
+}
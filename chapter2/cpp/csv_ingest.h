@@ -0,0 +1,298 @@
+// MIT License
+//
+// Copyright (c) 2021 Packt
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <arrow/csv/api.h>
+#include <arrow/io/api.h>
+#include <arrow/ipc/api.h>
+#include <arrow/table.h>
+#include <arrow/util/byte_size.h>
+#include <parquet/arrow/writer.h>
+#include <parquet/properties.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Converts a CSV file of any size to Parquet or Arrow IPC in bounded
+// memory. The incremental csv::StreamingReader parses blocks on the CPU
+// thread pool; a reader thread pushes the batches into a queue that is
+// capped in bytes, and the calling thread takes them off and writes them.
+// When the writer falls behind the queue fills up and the reader thread
+// stops pulling blocks, so parsing never runs ahead of the disk.
+//
+// Memory in use is roughly the queue, one row group being built for
+// Parquet and the blocks the StreamingReader reads ahead, about block_size
+// per CPU thread. max_memory_bytes covers the first two.
+namespace ingest {
+
+enum class Format { kParquet, kIpc };
+
+struct IngestOptions {
+  Format format = Format::kParquet;
+  int32_t block_size = 4 << 20;  // bytes of CSV parsed into one batch
+  int64_t max_memory_bytes = int64_t(512) << 20;
+  int64_t row_group_bytes = int64_t(128) << 20;  // Parquet only
+  arrow::Compression::type compression = arrow::Compression::ZSTD;
+  arrow::csv::ParseOptions parse_options = arrow::csv::ParseOptions::Defaults();
+  arrow::csv::ConvertOptions convert_options =
+      arrow::csv::ConvertOptions::Defaults();
+};
+
+struct IngestStats {
+  int64_t rows = 0;
+  int64_t batches = 0;
+  int64_t bytes_in = 0;  // size of the CSV file
+  int64_t queue_high_water = 0;
+  int64_t peak_rss = 0;  // of the whole process, 0 if unknown
+  double seconds = 0;
+
+  void Print(std::ostream& os = std::cout) const {
+    os << rows << " rows in " << seconds << " s, " << rows / seconds
+       << " rows/s, " << bytes_in / seconds / (1 << 20) << " MiB/s; peak rss "
+       << peak_rss / (1 << 20) << " MiB, queue high water "
+       << queue_high_water / (1 << 20) << " MiB" << std::endl;
+  }
+};
+
+// VmHWM from /proc, the largest resident set size so far
+inline int64_t PeakRss() {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.compare(0, 6, "VmHWM:") == 0) {
+      return std::stoll(line.substr(6)) * 1024;
+    }
+  }
+  return 0;
+}
+
+// Batches waiting to be written. Push blocks while the queue holds more
+// than capacity bytes, but always admits a batch into an empty queue so a
+// single oversized batch can't stall the pipeline.
+class BatchQueue {
+ public:
+  explicit BatchQueue(int64_t capacity) : capacity_(capacity) {}
+
+  // false if the consumer gave up
+  bool Push(std::shared_ptr<arrow::RecordBatch> batch) {
+    auto bytes = arrow::util::TotalBufferSize(*batch);
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_full_.wait(lock, [&] {
+      return cancelled_ || queue_.empty() || bytes_ + bytes <= capacity_;
+    });
+    if (cancelled_) return false;
+    bytes_ += bytes;
+    high_water_ = std::max(high_water_, bytes_);
+    queue_.emplace_back(std::move(batch), bytes);
+    not_empty_.notify_one();
+    return true;
+  }
+
+  // the producer is done, with this status
+  void Finish(arrow::Status status) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    finished_ = true;
+    status_ = std::move(status);
+    not_empty_.notify_one();
+  }
+
+  void Cancel() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    cancelled_ = true;
+    not_full_.notify_one();
+  }
+
+  // nullptr once the producer finished and the queue is drained
+  arrow::Result<std::shared_ptr<arrow::RecordBatch>> Pop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_empty_.wait(lock, [&] { return finished_ || !queue_.empty(); });
+    if (queue_.empty()) {
+      ARROW_RETURN_NOT_OK(status_);
+      return nullptr;
+    }
+    auto batch = std::move(queue_.front().first);
+    bytes_ -= queue_.front().second;
+    queue_.pop_front();
+    not_full_.notify_one();
+    return batch;
+  }
+
+  int64_t high_water() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return high_water_;
+  }
+
+ private:
+  const int64_t capacity_;
+  mutable std::mutex mutex_;
+  std::condition_variable not_full_, not_empty_;
+  std::deque<std::pair<std::shared_ptr<arrow::RecordBatch>, int64_t>> queue_;
+  int64_t bytes_ = 0;
+  int64_t high_water_ = 0;
+  bool finished_ = false;
+  bool cancelled_ = false;
+  arrow::Status status_;
+};
+
+// Writes batches as they come, Parquet buffered into row groups of about
+// row_group_bytes
+class BatchSink {
+ public:
+  static arrow::Result<std::unique_ptr<BatchSink>> Make(
+      const std::string& path, const std::shared_ptr<arrow::Schema>& schema,
+      const IngestOptions& options, int64_t row_group_bytes) {
+    std::unique_ptr<BatchSink> sink(new BatchSink);
+    sink->schema_ = schema;
+    sink->row_group_bytes_ = row_group_bytes;
+    ARROW_ASSIGN_OR_RAISE(sink->output_,
+                          arrow::io::FileOutputStream::Open(path));
+    if (options.format == Format::kIpc) {
+      auto write_options = arrow::ipc::IpcWriteOptions::Defaults();
+      if (options.compression != arrow::Compression::UNCOMPRESSED) {
+        ARROW_ASSIGN_OR_RAISE(
+            write_options.codec,
+            arrow::util::Codec::Create(options.compression));
+      }
+      ARROW_ASSIGN_OR_RAISE(
+          sink->ipc_,
+          arrow::ipc::MakeFileWriter(sink->output_, schema, write_options));
+      return sink;
+    }
+    auto properties = parquet::WriterProperties::Builder()
+                          .compression(options.compression)
+                          ->max_row_group_length(int64_t(1) << 40)
+                          ->build();
+    ARROW_RETURN_NOT_OK(parquet::arrow::FileWriter::Open(
+        *schema, arrow::default_memory_pool(), sink->output_, properties,
+        parquet::default_arrow_writer_properties(), &sink->parquet_));
+    return sink;
+  }
+
+  arrow::Status Write(std::shared_ptr<arrow::RecordBatch> batch) {
+    if (ipc_) return ipc_->WriteRecordBatch(*batch);
+    pending_bytes_ += arrow::util::TotalBufferSize(*batch);
+    pending_.push_back(std::move(batch));
+    if (pending_bytes_ >= row_group_bytes_) return Flush();
+    return arrow::Status::OK();
+  }
+
+  arrow::Status Close() {
+    if (ipc_) {
+      ARROW_RETURN_NOT_OK(ipc_->Close());
+    } else {
+      ARROW_RETURN_NOT_OK(Flush());
+      ARROW_RETURN_NOT_OK(parquet_->Close());
+    }
+    return output_->Close();
+  }
+
+ private:
+  BatchSink() = default;
+
+  arrow::Status Flush() {
+    if (pending_.empty()) return arrow::Status::OK();
+    ARROW_ASSIGN_OR_RAISE(auto table,
+                          arrow::Table::FromRecordBatches(schema_, pending_));
+    pending_.clear();
+    pending_bytes_ = 0;
+    return parquet_->WriteTable(*table, table->num_rows());
+  }
+
+  std::shared_ptr<arrow::Schema> schema_;
+  std::shared_ptr<arrow::io::FileOutputStream> output_;
+  std::shared_ptr<arrow::ipc::RecordBatchWriter> ipc_;
+  std::unique_ptr<parquet::arrow::FileWriter> parquet_;
+  arrow::RecordBatchVector pending_;
+  int64_t pending_bytes_ = 0;
+  int64_t row_group_bytes_ = 0;
+};
+
+inline arrow::Result<IngestStats> IngestCsv(const std::string& input_path,
+                                            const std::string& output_path,
+                                            const IngestOptions& options) {
+  auto start = std::chrono::steady_clock::now();
+  ARROW_ASSIGN_OR_RAISE(auto input, arrow::io::ReadableFile::Open(input_path));
+  IngestStats stats;
+  ARROW_ASSIGN_OR_RAISE(stats.bytes_in, input->GetSize());
+
+  auto read_options = arrow::csv::ReadOptions::Defaults();
+  read_options.use_threads = true;
+  read_options.block_size = options.block_size;
+  ARROW_ASSIGN_OR_RAISE(
+      auto reader, arrow::csv::StreamingReader::Make(
+                       arrow::io::default_io_context(), input, read_options,
+                       options.parse_options, options.convert_options));
+
+  // half the budget for the queue, half for the row group being built
+  BatchQueue queue(options.max_memory_bytes / 2);
+  ARROW_ASSIGN_OR_RAISE(
+      auto sink, BatchSink::Make(output_path, reader->schema(), options,
+                                 std::min(options.row_group_bytes,
+                                          options.max_memory_bytes / 2)));
+
+  std::thread producer([&] {
+    std::shared_ptr<arrow::RecordBatch> batch;
+    while (true) {
+      auto status = reader->ReadNext(&batch);
+      if (!status.ok() || batch == nullptr) {
+        queue.Finish(std::move(status));
+        return;
+      }
+      if (!queue.Push(std::move(batch))) return;
+    }
+  });
+
+  arrow::Status status;
+  while (true) {
+    auto batch = queue.Pop();
+    if (!batch.ok()) {
+      status = batch.status();
+      break;
+    }
+    if (*batch == nullptr) break;
+    stats.rows += (*batch)->num_rows();
+    ++stats.batches;
+    status = sink->Write(std::move(*batch));
+    if (!status.ok()) break;
+  }
+  if (!status.ok()) queue.Cancel();
+  producer.join();
+  ARROW_RETURN_NOT_OK(status);
+  ARROW_RETURN_NOT_OK(sink->Close());
+
+  stats.queue_high_water = queue.high_water();
+  stats.peak_rss = PeakRss();
+  stats.seconds = std::chrono::duration<double>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+  return stats;
+}
+
+}  // namespace ingest
@@ -25,6 +25,7 @@
 #include <arrow/ipc/api.h>
 #include <arrow/table.h>
 #include <iostream>
+#include "parallel_csv_writer.h"
 
 arrow::Result<std::shared_ptr<arrow::Table>> read_csv(
     const std::string& filename) {
@@ -85,6 +86,20 @@ arrow::Status incremental_write(std::shared_ptr<arrow::Table> table,
   return arrow::Status::OK();
 }
 
+// same output as incremental_write, formatted on the CPU thread pool and
+// gzip compressed on the way out
+arrow::Status parallel_write(std::shared_ptr<arrow::Table> table,
+                             const std::string& output_filename) {
+  ARROW_ASSIGN_OR_RAISE(auto output,
+                        arrow::io::FileOutputStream::Open(output_filename));
+  csvpar::ParallelWriteOptions options;
+  options.compression = arrow::Compression::GZIP;
+  ARROW_ASSIGN_OR_RAISE(auto writer, csvpar::ParallelCsvWriter::Make(
+                                         output, table->schema(), options));
+  ARROW_RETURN_NOT_OK(writer->Write(*table));
+  return writer->Close();
+}
+
 int main(int argc, char** argv) {
   std::shared_ptr<arrow::Table> table =
       read_csv("../../sample_data/train.csv").ValueOrDie();
@@ -100,4 +115,10 @@ int main(int argc, char** argv) {
     std::cerr << status.message() << std::endl;
     return 1;
   }
+
+  status = parallel_write(table, "train.csv.gz");
+  if (!status.ok()) {
+    std::cerr << status.message() << std::endl;
+    return 1;
+  }
 }
\ No newline at end of file
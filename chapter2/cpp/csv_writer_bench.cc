@@ -0,0 +1,129 @@
+// MIT License
+//
+// Copyright (c) 2021 Packt
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <arrow/api.h>
+#include <arrow/csv/api.h>
+#include <arrow/io/api.h>
+#include <arrow/ipc/api.h>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include "benchmark.h"
+#include "parallel_csv_writer.h"
+
+// MiB/s of CSV text written by the serial csv::MakeCSVWriter loop from
+// csv_writer.cc against ParallelCsvWriter, plain and compressed. The input
+// is train.csv repeated until it's big enough to keep every core busy.
+
+constexpr auto output_path = "/tmp/csv_writer_bench.csv";
+constexpr int64_t min_rows = 4 << 20;
+
+arrow::Result<std::shared_ptr<arrow::Table>> load() {
+  ARROW_ASSIGN_OR_RAISE(auto input, arrow::io::ReadableFile::Open(
+                                        "../../sample_data/train.csv"));
+  ARROW_ASSIGN_OR_RAISE(
+      auto reader,
+      arrow::csv::TableReader::Make(
+          arrow::io::default_io_context(), input,
+          arrow::csv::ReadOptions::Defaults(),
+          arrow::csv::ParseOptions::Defaults(),
+          arrow::csv::ConvertOptions::Defaults()));
+  ARROW_ASSIGN_OR_RAISE(auto table, reader->Read());
+  std::vector<std::shared_ptr<arrow::Table>> copies;
+  for (int64_t rows = 0; rows < min_rows; rows += table->num_rows()) {
+    copies.push_back(table);
+  }
+  ARROW_ASSIGN_OR_RAISE(table, arrow::ConcatenateTables(copies));
+  // batches of the size a scan would hand us
+  return table->CombineChunks();
+}
+
+arrow::Status serial_write(const arrow::Table& table) {
+  ARROW_ASSIGN_OR_RAISE(auto output,
+                        arrow::io::FileOutputStream::Open(output_path));
+  ARROW_ASSIGN_OR_RAISE(
+      auto writer, arrow::csv::MakeCSVWriter(
+                       output, table.schema(),
+                       arrow::csv::WriteOptions::Defaults()));
+  arrow::TableBatchReader reader(table);
+  reader.set_chunksize(1 << 16);
+  std::shared_ptr<arrow::RecordBatch> batch;
+  while (true) {
+    ARROW_RETURN_NOT_OK(reader.ReadNext(&batch));
+    if (batch == nullptr) break;
+    ARROW_RETURN_NOT_OK(writer->WriteRecordBatch(*batch));
+  }
+  ARROW_RETURN_NOT_OK(writer->Close());
+  return output->Close();
+}
+
+arrow::Status parallel_write(const arrow::Table& table,
+                             arrow::Compression::type compression) {
+  ARROW_ASSIGN_OR_RAISE(auto output,
+                        arrow::io::FileOutputStream::Open(output_path));
+  csvpar::ParallelWriteOptions options;
+  options.compression = compression;
+  ARROW_ASSIGN_OR_RAISE(auto writer, csvpar::ParallelCsvWriter::Make(
+                                         output, table.schema(), options));
+  ARROW_RETURN_NOT_OK(writer->Write(table));
+  return writer->Close();
+}
+
+int main(int argc, char** argv) {
+  auto table = load().ValueOrDie();
+  // the uncompressed CSV size, the same for every variant
+  auto status = serial_write(*table);
+  if (!status.ok()) {
+    std::cerr << status.ToString() << std::endl;
+    return 1;
+  }
+  auto file = arrow::io::ReadableFile::Open(output_path).ValueOrDie();
+  const int64_t bytes = file->GetSize().ValueOrDie();
+
+  bench::Options opts;
+  opts.warmup = 1;
+  opts.trials = 5;
+  const int threads = arrow::GetCpuThreadPoolCapacity();
+  bench::Reporter reporter;
+  auto run = [&](const std::string& name, int used_threads, auto&& fn) {
+    reporter.Add(bench::Run(name, table->num_rows(), bytes, used_threads, opts,
+                            [&] {
+                              auto status = fn();
+                              if (!status.ok()) {
+                                std::cerr << status.ToString() << std::endl;
+                                std::abort();
+                              }
+                              return 0;
+                            }));
+  };
+
+  run("serial", 1, [&] { return serial_write(*table); });
+  run("parallel", threads, [&] {
+    return parallel_write(*table, arrow::Compression::UNCOMPRESSED);
+  });
+  run("parallel_gzip", threads,
+      [&] { return parallel_write(*table, arrow::Compression::GZIP); });
+  run("parallel_zstd", threads,
+      [&] { return parallel_write(*table, arrow::Compression::ZSTD); });
+
+  if (argc > 1) reporter.WriteCsv(argv[1]);
+}
@@ -24,6 +24,7 @@
 #include <arrow/json/api.h>
 #include <arrow/table.h>
 #include <iostream>
+#include "ndjson_reader.h"
 
 int main(int argc, char** argv) {
   auto read_options = arrow::json::ReadOptions::Defaults();
@@ -54,4 +55,30 @@ int main(int argc, char** argv) {
 
   std::shared_ptr<arrow::Table> table = *maybe_table;
   std::cout << table->ToString() << std::endl;
+
+  // the same file again as a stream of batches, parsed in parallel with
+  // the schema kept in sample.schema for the next run
+  ndjson::ReaderOptions stream_options;
+  stream_options.schema_cache = "sample.schema";
+  auto maybe_stream = arrow::io::ReadableFile::Open(filename);
+  if (!maybe_stream.ok()) {
+    std::cerr << maybe_stream.status().message() << std::endl;
+    return 1;
+  }
+  auto maybe_batches = ndjson::NdjsonReader::Make(*maybe_stream,
+                                                  stream_options);
+  if (!maybe_batches.ok()) {
+    std::cerr << maybe_batches.status().message() << std::endl;
+    return 1;
+  }
+  std::shared_ptr<arrow::RecordBatch> batch;
+  while (true) {
+    auto status = (*maybe_batches)->ReadNext(&batch);
+    if (!status.ok()) {
+      std::cerr << status.message() << std::endl;
+      return 1;
+    }
+    if (batch == nullptr) break;
+    std::cout << batch->num_rows() << " rows" << std::endl;
+  }
 }
\ No newline at end of file
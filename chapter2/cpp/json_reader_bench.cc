@@ -0,0 +1,106 @@
+// MIT License
+//
+// Copyright (c) 2021 Packt
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <arrow/api.h>
+#include <arrow/io/api.h>
+#include <arrow/json/api.h>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include "benchmark.h"
+#include "ndjson_reader.h"
+
+// rows/s reading an event log shaped NDJSON file with json::TableReader, as
+// json_reader.cc does, against NdjsonReader inferring the schema and
+// NdjsonReader with the schema from its cache.
+
+constexpr auto input_path = "/tmp/json_reader_bench.ndjson";
+constexpr auto schema_path = "/tmp/json_reader_bench.schema";
+constexpr int64_t num_rows = 2 << 20;
+
+int64_t write_events() {
+  std::ofstream out(input_path);
+  std::mt19937_64 rng(42);
+  const char* kinds[] = {"click", "view", "purchase", "scroll"};
+  for (int64_t i = 0; i < num_rows; ++i) {
+    out << "{\"id\": " << i << ", \"user\": " << rng() % 100000
+        << ", \"kind\": \"" << kinds[rng() % 4] << "\", \"value\": "
+        << (rng() % 100000) / 100.0 << ", \"ok\": "
+        << (rng() % 2 ? "true" : "false") << "}\n";
+  }
+  return out.tellp();
+}
+
+int64_t check(const arrow::Result<int64_t>& rows) {
+  if (!rows.ok()) {
+    std::cerr << rows.status().ToString() << std::endl;
+    std::abort();
+  }
+  return *rows;
+}
+
+arrow::Result<int64_t> table_reader() {
+  ARROW_ASSIGN_OR_RAISE(auto input, arrow::io::ReadableFile::Open(input_path));
+  ARROW_ASSIGN_OR_RAISE(
+      auto reader, arrow::json::TableReader::Make(
+                       arrow::default_memory_pool(), input,
+                       arrow::json::ReadOptions::Defaults(),
+                       arrow::json::ParseOptions::Defaults()));
+  ARROW_ASSIGN_OR_RAISE(auto table, reader->Read());
+  return table->num_rows();
+}
+
+arrow::Result<int64_t> streaming_reader(bool cached) {
+  if (!cached) std::remove(schema_path);
+  ARROW_ASSIGN_OR_RAISE(auto input, arrow::io::ReadableFile::Open(input_path));
+  ndjson::ReaderOptions options;
+  options.schema_cache = schema_path;
+  ARROW_ASSIGN_OR_RAISE(auto reader,
+                        ndjson::NdjsonReader::Make(input, options));
+  int64_t rows = 0;
+  std::shared_ptr<arrow::RecordBatch> batch;
+  while (true) {
+    ARROW_RETURN_NOT_OK(reader->ReadNext(&batch));
+    if (batch == nullptr) return rows;
+    rows += batch->num_rows();
+  }
+}
+
+int main(int argc, char** argv) {
+  const int64_t bytes = write_events();
+  bench::Options opts;
+  opts.warmup = 1;
+  opts.trials = 5;
+  const int threads = arrow::GetCpuThreadPoolCapacity();
+
+  bench::Reporter reporter;
+  reporter.Add(bench::Run("table_reader", num_rows, bytes, threads, opts,
+                          [] { return check(table_reader()); }));
+  reporter.Add(bench::Run("ndjson_inferred", num_rows, bytes, threads, opts,
+                          [] { return check(streaming_reader(false)); }));
+  reporter.Add(bench::Run("ndjson_cached", num_rows, bytes, threads, opts,
+                          [] { return check(streaming_reader(true)); }));
+  if (argc > 1) reporter.WriteCsv(argv[1]);
+}
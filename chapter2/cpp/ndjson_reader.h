@@ -0,0 +1,325 @@
+// MIT License
+//
+// Copyright (c) 2021 Packt
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <arrow/api.h>
+#include <arrow/compute/api.h>
+#include <arrow/io/api.h>
+#include <arrow/ipc/api.h>
+#include <arrow/json/api.h>
+#include <arrow/type_traits.h>
+#include <arrow/util/future.h>
+#include <arrow/util/thread_pool.h>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Newline-delimited JSON as a stream of RecordBatches. The input is read
+// in blocks cut at the last newline, and up to `readahead` blocks are
+// parsed at once on the CPU thread pool with json::ParseOne; batches come
+// out in file order. Only the blocks in the window are ever in memory.
+//
+// Parsing against a known schema is much cheaper than inferring one, so the
+// schema is taken from, in order: the explicit schema, the schema cache
+// file left by an earlier run, or inference on the first block. An
+// explicit schema is used as given: other fields are ignored and a block
+// whose values don't convert is parsed again with inference and cast to
+// it, failing only when there's no cast.
+//
+// Every batch has schema(), which never changes during the read. A block
+// that doesn't parse with it is parsed again with inference and cast to
+// it. When a block needs a wider schema, because a column turned from
+// integer to float or a field first shows up, the schemas are merged,
+// promoting integers to wider integers or double, null to anything and
+// mixed scalars to string, and the result goes to the cache so the next
+// run starts with it. A block that can still be cast is, dropping the new
+// fields; one that can't fails the read.
+namespace ndjson {
+
+struct ReaderOptions {
+  int64_t block_size = 1 << 20;
+  int readahead = 0;  // blocks parsed at once, 0 means twice the CPU pool
+  std::shared_ptr<arrow::Schema> schema;  // explicit, skips the cache
+  std::string schema_cache;  // path of a file to keep the schema in
+};
+
+namespace detail {
+
+// the narrowest type both can be converted to, or null if there's none
+inline std::shared_ptr<arrow::DataType> Promote(
+    const std::shared_ptr<arrow::DataType>& a,
+    const std::shared_ptr<arrow::DataType>& b) {
+  if (a->Equals(*b)) return a;
+  if (a->id() == arrow::Type::NA) return b;
+  if (b->id() == arrow::Type::NA) return a;
+  if (arrow::is_integer(a->id()) && arrow::is_integer(b->id())) {
+    return arrow::int64();
+  }
+  auto numeric = [](const arrow::DataType& type) {
+    return arrow::is_integer(type.id()) || arrow::is_floating(type.id());
+  };
+  if (numeric(*a) && numeric(*b)) return arrow::float64();
+  auto scalar = [&](const arrow::DataType& type) {
+    return numeric(type) || type.id() == arrow::Type::BOOL ||
+           type.id() == arrow::Type::STRING ||
+           type.id() == arrow::Type::TIMESTAMP;
+  };
+  if (scalar(*a) && scalar(*b)) return arrow::utf8();
+  return nullptr;
+}
+
+// fields of `base` with types promoted by `update`, then update's new fields
+inline arrow::Result<std::shared_ptr<arrow::Schema>> Merge(
+    const std::shared_ptr<arrow::Schema>& base,
+    const std::shared_ptr<arrow::Schema>& update) {
+  arrow::FieldVector fields = base->fields();
+  for (const auto& field : update->fields()) {
+    auto i = base->GetFieldIndex(field->name());
+    if (i < 0) {
+      fields.push_back(field);
+      continue;
+    }
+    auto type = Promote(fields[i]->type(), field->type());
+    if (type == nullptr) {
+      return arrow::Status::TypeError("column ", field->name(), " is ",
+                                      fields[i]->type()->ToString(), " and ",
+                                      field->type()->ToString());
+    }
+    fields[i] = fields[i]->WithType(type);
+  }
+  return arrow::schema(std::move(fields));
+}
+
+// batch with schema's columns in schema's order, missing ones all null
+inline arrow::Result<std::shared_ptr<arrow::RecordBatch>> Conform(
+    const std::shared_ptr<arrow::RecordBatch>& batch,
+    const std::shared_ptr<arrow::Schema>& schema) {
+  if (batch->schema()->Equals(*schema)) return batch;
+  arrow::ArrayVector columns;
+  for (const auto& field : schema->fields()) {
+    auto column = batch->GetColumnByName(field->name());
+    if (column == nullptr) {
+      ARROW_ASSIGN_OR_RAISE(column, arrow::MakeArrayOfNull(field->type(),
+                                                           batch->num_rows()));
+    } else if (!column->type()->Equals(*field->type())) {
+      ARROW_ASSIGN_OR_RAISE(column,
+                            arrow::compute::Cast(*column, field->type()));
+    }
+    columns.push_back(std::move(column));
+  }
+  return arrow::RecordBatch::Make(schema, batch->num_rows(),
+                                  std::move(columns));
+}
+
+inline arrow::Result<std::shared_ptr<arrow::Schema>> LoadSchema(
+    const std::string& path) {
+  ARROW_ASSIGN_OR_RAISE(auto file, arrow::io::ReadableFile::Open(path));
+  arrow::ipc::DictionaryMemo memo;
+  return arrow::ipc::ReadSchema(file.get(), &memo);
+}
+
+inline arrow::Status SaveSchema(const std::string& path,
+                                const arrow::Schema& schema) {
+  ARROW_ASSIGN_OR_RAISE(auto buffer, arrow::ipc::SerializeSchema(schema));
+  ARROW_ASSIGN_OR_RAISE(auto file, arrow::io::FileOutputStream::Open(path));
+  ARROW_RETURN_NOT_OK(file->Write(buffer));
+  return file->Close();
+}
+
+}  // namespace detail
+
+class NdjsonReader : public arrow::RecordBatchReader {
+ public:
+  static arrow::Result<std::shared_ptr<NdjsonReader>> Make(
+      std::shared_ptr<arrow::io::InputStream> input,
+      const ReaderOptions& options) {
+    std::shared_ptr<NdjsonReader> reader(
+        new NdjsonReader(std::move(input), options));
+    ARROW_RETURN_NOT_OK(reader->Init());
+    return reader;
+  }
+
+  std::shared_ptr<arrow::Schema> schema() const override { return schema_; }
+
+  arrow::Status ReadNext(std::shared_ptr<arrow::RecordBatch>* batch) override {
+    while (true) {
+      ARROW_RETURN_NOT_OK(Fill());
+      if (in_flight_.empty()) {
+        *batch = nullptr;
+        return arrow::Status::OK();
+      }
+      auto parsed = in_flight_.front().result();
+      in_flight_.pop_front();
+      ARROW_RETURN_NOT_OK(parsed.status());
+      if ((*parsed)->num_rows() == 0) continue;
+      return Fit(std::move(*parsed), batch);
+    }
+  }
+
+ private:
+  NdjsonReader(std::shared_ptr<arrow::io::InputStream> input,
+               const ReaderOptions& options)
+      : input_(std::move(input)),
+        options_(options),
+        readahead_(options.readahead > 0
+                       ? options.readahead
+                       : 2 * arrow::GetCpuThreadPoolCapacity()) {}
+
+  arrow::Status Init() {
+    parse_options_ = arrow::json::ParseOptions::Defaults();
+    if (options_.schema != nullptr) {
+      schema_ = options_.schema;
+      parse_options_.explicit_schema = schema_;
+      parse_options_.unexpected_field_behavior =
+          arrow::json::UnexpectedFieldBehavior::Ignore;
+      return arrow::Status::OK();
+    }
+    // new fields are inferred and show up in the batch, see Fit
+    parse_options_.unexpected_field_behavior =
+        arrow::json::UnexpectedFieldBehavior::InferType;
+    if (!options_.schema_cache.empty()) {
+      auto cached = detail::LoadSchema(options_.schema_cache);
+      if (cached.ok()) {
+        schema_ = widened_ = *cached;
+        parse_options_.explicit_schema = schema_;
+        return arrow::Status::OK();
+      }
+    }
+
+    // nothing known, the first block's types are the schema and its batch
+    // is the first one handed out
+    ARROW_ASSIGN_OR_RAISE(auto block, NextBlock());
+    schema_ = arrow::schema({});
+    if (block != nullptr) {
+      ARROW_ASSIGN_OR_RAISE(
+          first_batch_,
+          arrow::json::ParseOne(arrow::json::ParseOptions::Defaults(), block));
+      schema_ = first_batch_->schema();
+    }
+    widened_ = schema_;
+    parse_options_.explicit_schema = schema_;
+    if (!options_.schema_cache.empty()) {
+      ARROW_RETURN_NOT_OK(detail::SaveSchema(options_.schema_cache, *schema_));
+    }
+    return arrow::Status::OK();
+  }
+
+  // Casts a parsed block to the schema. Without an explicit schema, a block
+  // needing a wider one has the widened schema saved to the cache first.
+  // Called in file order.
+  arrow::Status Fit(std::shared_ptr<arrow::RecordBatch> parsed,
+                    std::shared_ptr<arrow::RecordBatch>* batch) {
+    if (options_.schema == nullptr && !parsed->schema()->Equals(*schema_)) {
+      ARROW_ASSIGN_OR_RAISE(auto merged,
+                            detail::Merge(widened_, parsed->schema()));
+      if (!merged->Equals(*widened_)) {
+        widened_ = std::move(merged);
+        if (!options_.schema_cache.empty()) {
+          ARROW_RETURN_NOT_OK(
+              detail::SaveSchema(options_.schema_cache, *widened_));
+        }
+      }
+    }
+    auto conformed = detail::Conform(parsed, schema_);
+    if (!conformed.ok()) {
+      return conformed.status().WithMessage(
+          "NDJSON block doesn't fit the schema ", schema_->ToString(), ": ",
+          conformed.status().message(),
+          options_.schema_cache.empty()
+              ? ""
+              : "; the widened schema is in the cache for the next run");
+    }
+    *batch = std::move(*conformed);
+    return arrow::Status::OK();
+  }
+
+  // the next run of whole lines, nullptr at the end of the input
+  arrow::Result<std::shared_ptr<arrow::Buffer>> NextBlock() {
+    while (!eof_) {
+      ARROW_ASSIGN_OR_RAISE(auto read, input_->Read(options_.block_size));
+      eof_ = read->size() == 0;
+      std::shared_ptr<arrow::Buffer> data = read;
+      if (partial_ != nullptr && partial_->size() > 0) {
+        ARROW_ASSIGN_OR_RAISE(data,
+                              arrow::ConcatenateBuffers({partial_, read}));
+      }
+      if (eof_) {
+        partial_ = nullptr;
+        return data->size() > 0 ? data : nullptr;
+      }
+      const auto* begin = reinterpret_cast<const char*>(data->data());
+      const auto* newline = static_cast<const char*>(
+          memrchr(begin, '\n', static_cast<size_t>(data->size())));
+      if (newline == nullptr) {
+        partial_ = data;  // a line longer than a block, read on
+        continue;
+      }
+      int64_t length = newline - begin + 1;
+      partial_ = arrow::SliceBuffer(data, length);
+      return arrow::SliceBuffer(data, 0, length);
+    }
+    return nullptr;
+  }
+
+  // submits blocks until the window is full or the input ends
+  arrow::Status Fill() {
+    if (first_batch_ != nullptr) {
+      in_flight_.push_back(
+          arrow::Future<std::shared_ptr<arrow::RecordBatch>>::MakeFinished(
+              std::move(first_batch_)));
+    }
+    while (static_cast<int>(in_flight_.size()) < readahead_) {
+      ARROW_ASSIGN_OR_RAISE(auto block, NextBlock());
+      if (block == nullptr) break;
+      auto parse_options = parse_options_;
+      ARROW_ASSIGN_OR_RAISE(
+          auto parsed,
+          arrow::internal::GetCpuThreadPool()->Submit(
+              [block, parse_options]()
+                  -> arrow::Result<std::shared_ptr<arrow::RecordBatch>> {
+                auto batch = arrow::json::ParseOne(parse_options, block);
+                if (batch.ok()) return batch;
+                // not the expected types, infer them; Evolve casts
+                return arrow::json::ParseOne(
+                    arrow::json::ParseOptions::Defaults(), block);
+              }));
+      in_flight_.push_back(std::move(parsed));
+    }
+    return arrow::Status::OK();
+  }
+
+  std::shared_ptr<arrow::io::InputStream> input_;
+  const ReaderOptions options_;
+  const int readahead_;
+  arrow::json::ParseOptions parse_options_;
+  std::shared_ptr<arrow::Schema> schema_;  // of every batch
+  std::shared_ptr<arrow::Schema> widened_;  // schema_ and what blocks added
+  std::shared_ptr<arrow::RecordBatch> first_batch_;
+  std::shared_ptr<arrow::Buffer> partial_;
+  bool eof_ = false;
+  std::deque<arrow::Future<std::shared_ptr<arrow::RecordBatch>>> in_flight_;
+};
+
+}  // namespace ndjson
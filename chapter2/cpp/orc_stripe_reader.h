@@ -0,0 +1,377 @@
+// MIT License
+//
+// Copyright (c) 2021 Packt
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <arrow/adapters/orc/adapter.h>
+#include <arrow/api.h>
+#include <arrow/compute/api.h>
+#include <arrow/compute/exec/expression.h>
+#include <arrow/dataset/api.h>
+#include <arrow/io/api.h>
+#include <arrow/util/async_generator.h>
+#include <arrow/util/future.h>
+#include <arrow/util/thread_pool.h>
+#include <orc/OrcFile.hh>
+#include <orc/Statistics.hh>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// ORC read path that works like the Parquet one: stripes are decoded in
+// parallel on the CPU thread pool, only the projected columns are decoded,
+// and stripes whose min/max statistics rule out the filter are never read.
+// OrcStripeReader streams the result as RecordBatches, one per stripe, in
+// file order. ORCFileReader doesn't expose statistics, so they are read
+// from the footer with liborc directly.
+//
+// PrunedOrcFileFormat puts the same reader behind the dataset layer, so
+// ORC datasets get stripe pruning and parallel decode from a Scanner.
+namespace orcscan {
+
+namespace cp = arrow::compute;
+namespace ds = arrow::dataset;
+
+struct StripeReadOptions {
+  std::vector<std::string> columns;  // empty means every column
+  cp::Expression filter = cp::literal(true);
+  bool filter_rows = true;  // apply the filter to rows, not just stripes
+  int readahead = 0;  // stripes decoded at once, 0 means the CPU pool size
+  arrow::MemoryPool* pool = arrow::default_memory_pool();
+};
+
+struct StripeReadStats {
+  int64_t stripes = 0;
+  int64_t stripes_skipped = 0;
+  int64_t rows_read = 0;
+};
+
+namespace detail {
+
+// liborc reading through an Arrow file, so any FileSystem works
+class ArrowOrcInput : public orc::InputStream {
+ public:
+  ArrowOrcInput(std::shared_ptr<arrow::io::RandomAccessFile> file,
+                int64_t size)
+      : file_(std::move(file)), size_(size) {}
+
+  uint64_t getLength() const override { return size_; }
+  uint64_t getNaturalReadSize() const override { return 128 * 1024; }
+  const std::string& getName() const override { return name_; }
+
+  void read(void* buf, uint64_t length, uint64_t offset) override {
+    auto read = file_->ReadAt(offset, length, buf);
+    if (!read.ok() || *read != static_cast<int64_t>(length)) {
+      throw orc::ParseError("short read from ORC file");
+    }
+  }
+
+ private:
+  std::shared_ptr<arrow::io::RandomAccessFile> file_;
+  int64_t size_;
+  std::string name_ = "ArrowOrcInput";
+};
+
+// min and max as scalars of `type`, false if there are none or the type
+// isn't one we understand
+inline bool Bounds(const orc::ColumnStatistics& stats,
+                   const std::shared_ptr<arrow::DataType>& type,
+                   std::shared_ptr<arrow::Scalar>* min,
+                   std::shared_ptr<arrow::Scalar>* max) {
+  std::shared_ptr<arrow::Scalar> lo, hi;
+  if (auto ints = dynamic_cast<const orc::IntegerColumnStatistics*>(&stats)) {
+    if (!ints->hasMinimum() || !ints->hasMaximum()) return false;
+    lo = arrow::MakeScalar(ints->getMinimum());
+    hi = arrow::MakeScalar(ints->getMaximum());
+  } else if (auto doubles =
+                 dynamic_cast<const orc::DoubleColumnStatistics*>(&stats)) {
+    if (!doubles->hasMinimum() || !doubles->hasMaximum()) return false;
+    lo = arrow::MakeScalar(doubles->getMinimum());
+    hi = arrow::MakeScalar(doubles->getMaximum());
+  } else if (auto strings =
+                 dynamic_cast<const orc::StringColumnStatistics*>(&stats)) {
+    if (!strings->hasMinimum() || !strings->hasMaximum()) return false;
+    lo = arrow::MakeScalar(strings->getMinimum());
+    hi = arrow::MakeScalar(strings->getMaximum());
+  } else if (auto dates =
+                 dynamic_cast<const orc::DateColumnStatistics*>(&stats)) {
+    if (!dates->hasMinimum() || !dates->hasMaximum()) return false;
+    lo = std::make_shared<arrow::Date32Scalar>(dates->getMinimum());
+    hi = std::make_shared<arrow::Date32Scalar>(dates->getMaximum());
+  } else {
+    return false;
+  }
+  if (!lo->type->Equals(*type)) {
+    auto lo_cast = lo->CastTo(type);
+    auto hi_cast = hi->CastTo(type);
+    if (!lo_cast.ok() || !hi_cast.ok()) return false;
+    lo = *lo_cast;
+    hi = *hi_cast;
+  }
+  *min = std::move(lo);
+  *max = std::move(hi);
+  return true;
+}
+
+// What a stripe's statistics guarantee about its rows, as an expression
+// the filter can be simplified against. Columns are matched by name among
+// the top-level fields of the file.
+inline cp::Expression StripeGuarantee(const orc::Reader& reader,
+                                      const orc::StripeStatistics& stripe,
+                                      const arrow::Schema& schema) {
+  const auto& root = reader.getType();
+  std::vector<cp::Expression> guarantees;
+  for (uint64_t i = 0; i < root.getSubtypeCount(); ++i) {
+    auto field = schema.GetFieldByName(root.getFieldName(i));
+    if (field == nullptr) continue;
+    const auto* stats =
+        stripe.getColumnStatistics(root.getSubtype(i)->getColumnId());
+    if (stats == nullptr) continue;
+    auto ref = cp::field_ref(field->name());
+    if (stats->getNumberOfValues() == 0) {
+      if (stats->hasNull()) guarantees.push_back(cp::is_null(ref));
+      continue;
+    }
+    std::shared_ptr<arrow::Scalar> min, max;
+    if (!Bounds(*stats, field->type(), &min, &max)) continue;
+    auto in_range = cp::and_(cp::greater_equal(ref, cp::literal(min)),
+                             cp::less_equal(ref, cp::literal(max)));
+    guarantees.push_back(stats->hasNull() ? cp::or_(in_range, cp::is_null(ref))
+                                          : in_range);
+  }
+  return guarantees.empty() ? cp::literal(true) : cp::and_(guarantees);
+}
+
+// the stripes that may hold rows matching filter, which is bound to schema
+inline arrow::Result<std::vector<int64_t>> SelectStripes(
+    const std::shared_ptr<arrow::io::RandomAccessFile>& file,
+    const arrow::Schema& schema, const cp::Expression& filter,
+    int64_t num_stripes) {
+  std::vector<int64_t> stripes;
+  if (filter == cp::literal(true)) {
+    for (int64_t i = 0; i < num_stripes; ++i) stripes.push_back(i);
+    return stripes;
+  }
+  ARROW_ASSIGN_OR_RAISE(auto size, file->GetSize());
+  // liborc reads the statistics lazily and throws on any I/O or parse
+  // error, none of which may escape into Arrow's thread pools
+  try {
+    auto reader = orc::createReader(
+        std::unique_ptr<orc::InputStream>(new ArrowOrcInput(file, size)),
+        orc::ReaderOptions());
+    const auto num_stats = reader->getNumberOfStripeStatistics();
+    for (int64_t i = 0; i < num_stripes; ++i) {
+      if (static_cast<uint64_t>(i) >= num_stats) {
+        stripes.push_back(i);
+        continue;
+      }
+      auto stats = reader->getStripeStatistics(i);
+      ARROW_ASSIGN_OR_RAISE(
+          auto guarantee,
+          StripeGuarantee(*reader, *stats, schema).Bind(schema));
+      ARROW_ASSIGN_OR_RAISE(auto simplified,
+                            cp::SimplifyWithGuarantee(filter, guarantee));
+      if (simplified != cp::literal(false)) stripes.push_back(i);
+    }
+  } catch (const std::exception& e) {
+    return arrow::Status::IOError("reading ORC stripe statistics: ", e.what());
+  }
+  return stripes;
+}
+
+}  // namespace detail
+
+class OrcStripeReader : public arrow::RecordBatchReader {
+ public:
+  static arrow::Result<std::shared_ptr<OrcStripeReader>> Make(
+      std::shared_ptr<arrow::io::RandomAccessFile> file,
+      StripeReadOptions options) {
+    ARROW_ASSIGN_OR_RAISE(
+        auto orc_reader,
+        arrow::adapters::orc::ORCFileReader::Open(file, options.pool));
+    ARROW_ASSIGN_OR_RAISE(auto file_schema, orc_reader->ReadSchema());
+    std::shared_ptr<OrcStripeReader> reader(new OrcStripeReader);
+    reader->file_ = std::move(file);
+
+    if (options.columns.empty()) {
+      for (const auto& field : file_schema->fields()) {
+        options.columns.push_back(field->name());
+      }
+    }
+    arrow::FieldVector fields;
+    for (const auto& name : options.columns) {
+      auto field = file_schema->GetFieldByName(name);
+      if (field == nullptr) {
+        return arrow::Status::KeyError("no column ", name, " in ORC file");
+      }
+      fields.push_back(field);
+    }
+    reader->schema_ = arrow::schema(std::move(fields));
+
+    ARROW_ASSIGN_OR_RAISE(auto filter, options.filter.Bind(*file_schema));
+    reader->read_columns_ = options.columns;
+    reader->filter_ = cp::literal(true);
+    if (options.filter_rows) {
+      reader->filter_ = filter;
+      std::unordered_set<std::string> seen(options.columns.begin(),
+                                           options.columns.end());
+      for (const auto& ref : cp::FieldsInExpression(filter)) {
+        if (ref.name() && seen.insert(*ref.name()).second) {
+          reader->read_columns_.push_back(*ref.name());
+        }
+      }
+    }
+
+    reader->stats_.stripes = orc_reader->NumberOfStripes();
+    ARROW_ASSIGN_OR_RAISE(
+        auto stripes, detail::SelectStripes(reader->file_, *file_schema, filter,
+                                            reader->stats_.stripes));
+    reader->stats_.stripes_skipped =
+        reader->stats_.stripes - static_cast<int64_t>(stripes.size());
+    reader->pending_.assign(stripes.begin(), stripes.end());
+    reader->options_ = std::move(options);
+    reader->readahead_ = reader->options_.readahead > 0
+                             ? reader->options_.readahead
+                             : arrow::GetCpuThreadPoolCapacity();
+    return reader;
+  }
+
+  std::shared_ptr<arrow::Schema> schema() const override { return schema_; }
+
+  const StripeReadStats& stats() const { return stats_; }
+
+  arrow::Status ReadNext(std::shared_ptr<arrow::RecordBatch>* batch) override {
+    while (true) {
+      ARROW_RETURN_NOT_OK(Fill());
+      if (in_flight_.empty()) {
+        *batch = nullptr;
+        return arrow::Status::OK();
+      }
+      auto next = in_flight_.front().result();
+      in_flight_.pop_front();
+      ARROW_ASSIGN_OR_RAISE(*batch, std::move(next));
+      stats_.rows_read += (*batch)->num_rows();
+      if ((*batch)->num_rows() > 0) return arrow::Status::OK();
+    }
+  }
+
+ private:
+  OrcStripeReader() = default;
+
+  // Each stripe task opens its own ORCFileReader: the adapter isn't meant
+  // to be shared between threads, and the footer is small next to a stripe.
+  arrow::Status Fill() {
+    while (!pending_.empty() &&
+           static_cast<int>(in_flight_.size()) < readahead_) {
+      auto stripe = pending_.front();
+      pending_.pop_front();
+      auto file = file_;
+      auto pool = options_.pool;
+      auto columns = read_columns_;
+      auto filter = filter_;
+      auto schema = schema_;
+      ARROW_ASSIGN_OR_RAISE(
+          auto read,
+          arrow::internal::GetCpuThreadPool()->Submit(
+              [=]() -> arrow::Result<std::shared_ptr<arrow::RecordBatch>> {
+                ARROW_ASSIGN_OR_RAISE(
+                    auto reader,
+                    arrow::adapters::orc::ORCFileReader::Open(file, pool));
+                ARROW_ASSIGN_OR_RAISE(auto batch,
+                                      reader->ReadStripe(stripe, columns));
+                if (filter != cp::literal(true)) {
+                  ARROW_ASSIGN_OR_RAISE(
+                      auto bound, filter.Bind(*batch->schema()));
+                  ARROW_ASSIGN_OR_RAISE(
+                      auto mask, cp::ExecuteScalarExpression(
+                                     bound, cp::ExecBatch(*batch)));
+                  ARROW_ASSIGN_OR_RAISE(auto filtered,
+                                        cp::Filter(batch, mask));
+                  batch = filtered.record_batch();
+                }
+                arrow::ArrayVector projected;
+                for (const auto& field : schema->fields()) {
+                  projected.push_back(batch->GetColumnByName(field->name()));
+                }
+                return arrow::RecordBatch::Make(schema, batch->num_rows(),
+                                                std::move(projected));
+              }));
+      in_flight_.push_back(std::move(read));
+    }
+    return arrow::Status::OK();
+  }
+
+  std::shared_ptr<arrow::io::RandomAccessFile> file_;
+  StripeReadOptions options_;
+  std::shared_ptr<arrow::Schema> schema_;
+  std::vector<std::string> read_columns_;
+  cp::Expression filter_;
+  int readahead_ = 1;
+  std::deque<int64_t> pending_;
+  std::deque<arrow::Future<std::shared_ptr<arrow::RecordBatch>>> in_flight_;
+  StripeReadStats stats_;
+};
+
+// OrcFileFormat whose scans go through OrcStripeReader: the scan filter
+// prunes stripes and only the materialized fields are decoded. Rows are
+// left for the scanner to filter, as it does for Parquet.
+class PrunedOrcFileFormat : public ds::OrcFileFormat {
+ public:
+  arrow::Result<ds::RecordBatchGenerator> ScanBatchesAsync(
+      const std::shared_ptr<ds::ScanOptions>& options,
+      const std::shared_ptr<ds::FileFragment>& file) const override {
+    ARROW_ASSIGN_OR_RAISE(auto input, file->source().Open());
+    ARROW_ASSIGN_OR_RAISE(auto physical, Inspect(file->source()));
+
+    StripeReadOptions read_options;
+    read_options.pool = options->pool;
+    read_options.filter_rows = false;
+    // partition fields become literals; a filter on columns this file
+    // lacks can't prune anything
+    ARROW_ASSIGN_OR_RAISE(
+        auto filter, cp::SimplifyWithGuarantee(options->filter,
+                                               file->partition_expression()));
+    if (filter.Bind(*physical).ok()) read_options.filter = filter;
+    for (const auto& ref : options->MaterializedFields()) {
+      if (ref.name() && physical->GetFieldByName(*ref.name())) {
+        read_options.columns.push_back(*ref.name());
+      }
+    }
+    if (read_options.columns.empty() && !physical->fields().empty()) {
+      // nothing projected, e.g. a count: still need rows
+      read_options.columns.push_back(physical->field(0)->name());
+    }
+    ARROW_ASSIGN_OR_RAISE(
+        auto reader, OrcStripeReader::Make(std::move(input), read_options));
+    ARROW_ASSIGN_OR_RAISE(
+        auto generator,
+        arrow::MakeBackgroundGenerator(
+            arrow::MakeIteratorFromReader(reader),
+            arrow::io::default_io_context().executor()));
+    return arrow::MakeTransferredGenerator(std::move(generator),
+                                           arrow::internal::GetCpuThreadPool());
+  }
+};
+
+}  // namespace orcscan
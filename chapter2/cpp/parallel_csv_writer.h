@@ -0,0 +1,162 @@
+// MIT License
+//
+// Copyright (c) 2021 Packt
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <arrow/api.h>
+#include <arrow/csv/api.h>
+#include <arrow/io/api.h>
+#include <arrow/util/compression.h>
+#include <arrow/util/future.h>
+#include <arrow/util/thread_pool.h>
+#include <algorithm>
+#include <deque>
+#include <memory>
+
+// A CSV writer that formats on every core. Each batch is cut into chunks of
+// rows_per_chunk rows, every chunk is turned into CSV text by a task on the
+// CPU thread pool, and the finished texts are written out in submission
+// order, so the file is byte for byte what csv::MakeCSVWriter would write.
+// At most max_in_flight chunks are being formatted or waiting to be
+// written; beyond that Write waits for the oldest one.
+//
+// The text goes through a large write buffer and, optionally, a gzip or
+// zstd compressor before it reaches the output stream.
+namespace csvpar {
+
+struct ParallelWriteOptions {
+  arrow::csv::WriteOptions write_options = arrow::csv::WriteOptions::Defaults();
+  arrow::Compression::type compression = arrow::Compression::UNCOMPRESSED;
+  int64_t buffer_size = 8 << 20;
+  int64_t rows_per_chunk = 1 << 16;
+  int max_in_flight = 0;  // 0 means twice the CPU pool capacity
+};
+
+class ParallelCsvWriter {
+ public:
+  // Close() closes `output` as well
+  static arrow::Result<std::unique_ptr<ParallelCsvWriter>> Make(
+      std::shared_ptr<arrow::io::OutputStream> output,
+      std::shared_ptr<arrow::Schema> schema,
+      const ParallelWriteOptions& options) {
+    std::unique_ptr<ParallelCsvWriter> writer(
+        new ParallelCsvWriter(std::move(schema), options));
+    if (options.compression != arrow::Compression::UNCOMPRESSED) {
+      ARROW_ASSIGN_OR_RAISE(writer->codec_,
+                            arrow::util::Codec::Create(options.compression));
+      ARROW_ASSIGN_OR_RAISE(output, arrow::io::CompressedOutputStream::Make(
+                                        writer->codec_.get(), output));
+    }
+    ARROW_ASSIGN_OR_RAISE(
+        writer->output_,
+        arrow::io::BufferedOutputStream::Create(
+            options.buffer_size, arrow::default_memory_pool(), output));
+    if (options.write_options.include_header) {
+      ARROW_RETURN_NOT_OK(writer->WriteHeader());
+    }
+    return writer;
+  }
+
+  arrow::Status Write(const arrow::RecordBatch& batch) {
+    for (int64_t offset = 0; offset < batch.num_rows();
+         offset += options_.rows_per_chunk) {
+      auto chunk = batch.Slice(offset, options_.rows_per_chunk);
+      auto write_options = options_.write_options;
+      write_options.include_header = false;
+      ARROW_ASSIGN_OR_RAISE(
+          auto formatted,
+          arrow::internal::GetCpuThreadPool()->Submit(
+              [chunk, write_options]() -> arrow::Result<
+                                            std::shared_ptr<arrow::Buffer>> {
+                ARROW_ASSIGN_OR_RAISE(auto sink,
+                                      arrow::io::BufferOutputStream::Create());
+                ARROW_RETURN_NOT_OK(
+                    arrow::csv::WriteCSV(*chunk, write_options, sink.get()));
+                return sink->Finish();
+              }));
+      in_flight_.push_back(std::move(formatted));
+      while (static_cast<int>(in_flight_.size()) > max_in_flight_) {
+        ARROW_RETURN_NOT_OK(WriteOldest());
+      }
+    }
+    return arrow::Status::OK();
+  }
+
+  arrow::Status Write(const arrow::Table& table) {
+    arrow::TableBatchReader reader(table);
+    std::shared_ptr<arrow::RecordBatch> batch;
+    while (true) {
+      ARROW_RETURN_NOT_OK(reader.ReadNext(&batch));
+      if (batch == nullptr) return arrow::Status::OK();
+      ARROW_RETURN_NOT_OK(Write(*batch));
+    }
+  }
+
+  // waits for every chunk, flushes the compressor and closes the stream
+  arrow::Status Close() {
+    arrow::Status status;
+    while (!in_flight_.empty()) {
+      auto written = WriteOldest();
+      if (status.ok()) status = written;
+    }
+    auto closed = output_->Close();
+    return status.ok() ? closed : status;
+  }
+
+ private:
+  ParallelCsvWriter(std::shared_ptr<arrow::Schema> schema,
+                    const ParallelWriteOptions& options)
+      : schema_(std::move(schema)),
+        options_(options),
+        max_in_flight_(options.max_in_flight > 0
+                           ? options.max_in_flight
+                           : 2 * arrow::GetCpuThreadPoolCapacity()) {}
+
+  // the header alone, written by the CSV writer so quoting and delimiter
+  // match the rows
+  arrow::Status WriteHeader() {
+    arrow::ArrayVector columns;
+    for (const auto& field : schema_->fields()) {
+      ARROW_ASSIGN_OR_RAISE(auto column,
+                            arrow::MakeArrayOfNull(field->type(), 0));
+      columns.push_back(std::move(column));
+    }
+    auto empty = arrow::RecordBatch::Make(schema_, 0, std::move(columns));
+    return arrow::csv::WriteCSV(*empty, options_.write_options, output_.get());
+  }
+
+  arrow::Status WriteOldest() {
+    auto formatted = std::move(in_flight_.front());
+    in_flight_.pop_front();
+    ARROW_ASSIGN_OR_RAISE(auto text, formatted.result());
+    return output_->Write(text);
+  }
+
+  std::shared_ptr<arrow::Schema> schema_;
+  const ParallelWriteOptions options_;
+  const int max_in_flight_;
+  std::unique_ptr<arrow::util::Codec> codec_;
+  std::shared_ptr<arrow::io::BufferedOutputStream> output_;
+  std::deque<arrow::Future<std::shared_ptr<arrow::Buffer>>> in_flight_;
+};
+
+}  // namespace csvpar
@@ -25,6 +25,8 @@
 #include <parquet/arrow/reader.h>
 #include <parquet/arrow/writer.h>
 #include <iostream>
+#include "adaptive_parquet.h"
+#include "parquet_stream.h"
 
 int main(int argc, char** argv) {
   PARQUET_ASSIGN_OR_THROW(auto input, arrow::io::ReadableFile::Open(
@@ -43,10 +45,32 @@ int main(int argc, char** argv) {
 
   std::cout << table->ToString() << std::endl;
 
+  // the same file as a stream: batches are ready as soon as the first row
+  // group is decoded, and at most readahead_bytes are decoded ahead
+  pqstream::StreamOptions stream_options;
+  stream_options.readahead_bytes = int64_t(64) << 20;
+  PARQUET_ASSIGN_OR_THROW(
+      auto stream, pqstream::ParquetStreamReader::Open(
+                       "../../sample_data/train.parquet", stream_options));
+  std::shared_ptr<arrow::RecordBatch> batch;
+  while (true) {
+    PARQUET_THROW_NOT_OK(stream->ReadNext(&batch));
+    if (batch == nullptr) break;
+  }
+  std::cout << stream->stats().rows << " rows streamed from "
+            << stream->stats().row_groups << " row groups" << std::endl;
+
   PARQUET_ASSIGN_OR_THROW(auto outfile,
                           arrow::io::FileOutputStream::Open("train.parquet"));
   int64_t chunk_size = 1024;
   PARQUET_THROW_NOT_OK(parquet::arrow::WriteTable(
       *table, arrow::default_memory_pool(), outfile, chunk_size));
   PARQUET_THROW_NOT_OK(outfile->Close());
+
+  // the same table with row groups sized by bytes and encodings and codecs
+  // picked per column from a sample
+  PARQUET_ASSIGN_OR_THROW(
+      auto report, adaptive::WriteAdaptive(table, "train_adaptive.parquet",
+                                           adaptive::AdaptiveOptions{}));
+  report.Print();
 }
\ No newline at end of file
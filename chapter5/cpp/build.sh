@@ -22,4 +22,5 @@
 # OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 # SOFTWARE.
 
-g++ -fPIC -shared -o libsample.so example_cdata.cc
+g++ -fPIC -shared -O3 -pthread -o libsample.so example_cdata.cc
+g++ shm_ring_bench.cc -O3 -pthread -I../../utils/cpp -o shm_ring_bench `pkg-config --cflags --libs arrow`
@@ -0,0 +1,363 @@
+// MIT License
+//
+// Copyright (c) 2021 Packt
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <arrow/c/abi.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// An ArrowArrayStream producer of record batches of fixed width columns,
+// written against the C Data Interface alone so the library needs nothing
+// but the Arrow ABI header.
+//
+// A background thread fills batches ahead of the consumer, up to
+// max_ready of them. Every batch lives in a pooled slot: its column
+// buffers are 64-byte aligned and allocated once, and the ArrowArray
+// structs, children and buffer pointer arrays are part of the slot, so
+// get_next does no allocation at all. When the consumer releases a batch,
+// and every child it may have moved out, the slot goes back to the free
+// list and the producer reuses it. At most max_slots batches exist at
+// once; the producer waits if the consumer holds on to all of them.
+namespace cstream {
+
+struct Column {
+  std::string name;
+  std::string format;  // C data interface format, e.g. "l", "i", "g"
+  int width;           // bytes per value
+};
+
+// fills one batch: columns[i] has room for rows values of column i
+using FillFn = std::function<void(int64_t batch, int64_t rows,
+                                  const std::vector<void*>& columns)>;
+
+struct StreamOptions {
+  std::vector<Column> columns;
+  int64_t batch_rows = 1 << 16;
+  int64_t num_batches = -1;  // -1 for no end
+  int max_ready = 4;  // batches filled ahead of the consumer
+  int max_slots = 8;  // batches in existence, ready or held by the consumer
+  FillFn fill;
+};
+
+// A struct schema of the columns; the caller owns it. The consumer may
+// move children out and release them after the parent, so the names and
+// formats live until the parent and every child are released.
+inline void ExportSchema(const std::vector<Column>& columns,
+                         struct ArrowSchema* out) {
+  struct Holder {
+    std::vector<std::string> names, formats;
+    std::vector<struct ArrowSchema> children;
+    std::vector<struct ArrowSchema*> pointers;
+    std::atomic<int> refs{0};  // the parent and each child
+
+    static void Unref(Holder* holder) {
+      if (holder->refs.fetch_sub(1) == 1) delete holder;
+    }
+  };
+  auto* holder = new Holder;
+  auto n = columns.size();
+  holder->children.resize(n);
+  holder->refs.store(1 + static_cast<int>(n));
+  for (const auto& column : columns) {
+    holder->names.push_back(column.name);
+    holder->formats.push_back(column.format);
+  }
+  for (size_t i = 0; i < n; ++i) {
+    holder->children[i] = (struct ArrowSchema){
+        .format = holder->formats[i].c_str(),
+        .name = holder->names[i].c_str(),
+        .metadata = nullptr,
+        .flags = 0,  // not nullable
+        .n_children = 0,
+        .children = nullptr,
+        .dictionary = nullptr,
+        .release =
+            [](struct ArrowSchema* schema) {
+              auto* holder = static_cast<Holder*>(schema->private_data);
+              schema->release = nullptr;
+              Holder::Unref(holder);
+            },
+        .private_data = holder,
+    };
+    holder->pointers.push_back(&holder->children[i]);
+  }
+  *out = (struct ArrowSchema){
+      .format = "+s",
+      .name = "",
+      .metadata = nullptr,
+      .flags = 0,
+      .n_children = static_cast<int64_t>(n),
+      .children = holder->pointers.data(),
+      .dictionary = nullptr,
+      // releases the children the consumer didn't move out, then the parent
+      .release =
+          [](struct ArrowSchema* schema) {
+            auto* holder = static_cast<Holder*>(schema->private_data);
+            for (int64_t i = 0; i < schema->n_children; ++i) {
+              auto* child = schema->children[i];
+              if (child->release != nullptr) child->release(child);
+            }
+            schema->release = nullptr;
+            Holder::Unref(holder);
+          },
+      .private_data = holder,
+  };
+}
+
+namespace detail {
+
+constexpr size_t kAlignment = 64;
+
+struct State;
+
+// one batch worth of memory, reused for the life of the stream
+struct Slot {
+  State* state = nullptr;
+  int64_t rows = 0;
+  std::atomic<int> refs{0};  // the parent and each child, see Release
+  std::vector<void*> data;   // one aligned buffer per column
+  std::vector<const void*> child_buffers;  // {nullptr, data} per column
+  const void* parent_buffers[1] = {nullptr};
+  std::vector<struct ArrowArray> children;
+  std::vector<struct ArrowArray*> child_pointers;
+};
+
+struct State {
+  StreamOptions options;
+  std::mutex mutex;
+  std::condition_variable ready_cv, free_cv;
+  std::deque<Slot*> ready;
+  std::vector<Slot*> free;
+  std::vector<Slot*> all;
+  int64_t produced = 0;
+  bool stopping = false;
+  bool producer_done = false;
+  bool stream_released = false;
+  int outstanding = 0;  // slots handed to the consumer, not yet released
+  std::string last_error;
+  std::thread producer;
+
+  ~State() {
+    for (auto* slot : all) {
+      for (auto* buffer : slot->data) std::free(buffer);
+      delete slot;
+    }
+  }
+};
+
+// deletes the state once the stream and every exported batch are released
+inline void MaybeDestroy(State* state, std::unique_lock<std::mutex>* lock) {
+  if (state->stream_released && state->outstanding == 0) {
+    lock->unlock();
+    delete state;
+  }
+}
+
+inline void ReturnSlot(Slot* slot) {
+  auto* state = slot->state;
+  std::unique_lock<std::mutex> lock(state->mutex);
+  --state->outstanding;
+  state->free.push_back(slot);
+  state->free_cv.notify_one();
+  MaybeDestroy(state, &lock);
+}
+
+inline void ReleaseChild(struct ArrowArray* array) {
+  auto* slot = static_cast<Slot*>(array->private_data);
+  array->release = nullptr;
+  if (slot->refs.fetch_sub(1) == 1) ReturnSlot(slot);
+}
+
+// releases the children the consumer didn't move out, then the parent
+inline void ReleaseParent(struct ArrowArray* array) {
+  auto* slot = static_cast<Slot*>(array->private_data);
+  for (int64_t i = 0; i < array->n_children; ++i) {
+    auto* child = array->children[i];
+    if (child->release != nullptr) child->release(child);
+  }
+  array->release = nullptr;
+  if (slot->refs.fetch_sub(1) == 1) ReturnSlot(slot);
+}
+
+inline Slot* MakeSlot(State* state) {
+  const auto& options = state->options;
+  auto* slot = new Slot;
+  slot->state = state;
+  auto n = options.columns.size();
+  slot->children.resize(n);
+  slot->child_pointers.resize(n);
+  slot->child_buffers.resize(2 * n);
+  for (size_t i = 0; i < n; ++i) {
+    size_t bytes = options.batch_rows * options.columns[i].width;
+    bytes = (bytes + kAlignment - 1) / kAlignment * kAlignment;
+    slot->data.push_back(std::aligned_alloc(kAlignment, bytes));
+    slot->child_buffers[2 * i] = nullptr;  // no nulls
+    slot->child_buffers[2 * i + 1] = slot->data[i];
+    slot->child_pointers[i] = &slot->children[i];
+  }
+  state->all.push_back(slot);
+  return slot;
+}
+
+inline void Produce(State* state) {
+  const auto& options = state->options;
+  while (true) {
+    Slot* slot = nullptr;
+    int64_t batch;
+    {
+      std::unique_lock<std::mutex> lock(state->mutex);
+      state->free_cv.wait(lock, [&] {
+        return state->stopping ||
+               (static_cast<int>(state->ready.size()) < options.max_ready &&
+                (!state->free.empty() ||
+                 static_cast<int>(state->all.size()) < options.max_slots));
+      });
+      if (state->stopping ||
+          (options.num_batches >= 0 &&
+           state->produced >= options.num_batches)) {
+        break;
+      }
+      if (state->free.empty()) {
+        slot = MakeSlot(state);
+      } else {
+        slot = state->free.back();
+        state->free.pop_back();
+      }
+      batch = state->produced++;
+    }
+    int64_t rows = options.batch_rows;
+    options.fill(batch, rows, slot->data);
+    slot->rows = rows;
+    std::lock_guard<std::mutex> lock(state->mutex);
+    state->ready.push_back(slot);
+    state->ready_cv.notify_one();
+  }
+  std::lock_guard<std::mutex> lock(state->mutex);
+  state->producer_done = true;
+  state->ready_cv.notify_all();
+}
+
+inline int GetSchema(struct ArrowArrayStream* stream,
+                     struct ArrowSchema* out) {
+  ExportSchema(static_cast<State*>(stream->private_data)->options.columns, out);
+  return 0;
+}
+
+inline int GetNext(struct ArrowArrayStream* stream, struct ArrowArray* out) {
+  auto* state = static_cast<State*>(stream->private_data);
+  Slot* slot;
+  {
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->ready_cv.wait(
+        lock, [&] { return !state->ready.empty() || state->producer_done; });
+    if (state->ready.empty()) {
+      out->release = nullptr;  // end of stream
+      return 0;
+    }
+    slot = state->ready.front();
+    state->ready.pop_front();
+    ++state->outstanding;
+    state->free_cv.notify_one();
+  }
+
+  auto n = static_cast<int64_t>(slot->children.size());
+  slot->refs.store(1 + static_cast<int>(n));
+  for (int64_t i = 0; i < n; ++i) {
+    slot->children[i] = (struct ArrowArray){
+        .length = slot->rows,
+        .null_count = 0,
+        .offset = 0,
+        .n_buffers = 2,
+        .n_children = 0,
+        .buffers = &slot->child_buffers[2 * i],
+        .children = nullptr,
+        .dictionary = nullptr,
+        .release = ReleaseChild,
+        .private_data = slot,
+    };
+  }
+  *out = (struct ArrowArray){
+      .length = slot->rows,
+      .null_count = 0,
+      .offset = 0,
+      .n_buffers = 1,
+      .n_children = n,
+      .buffers = slot->parent_buffers,
+      .children = slot->child_pointers.data(),
+      .dictionary = nullptr,
+      .release = ReleaseParent,
+      .private_data = slot,
+  };
+  return 0;
+}
+
+inline const char* GetLastError(struct ArrowArrayStream* stream) {
+  auto* state = static_cast<State*>(stream->private_data);
+  return state->last_error.empty() ? nullptr : state->last_error.c_str();
+}
+
+// stops the producer; the state lives on until every batch is released
+inline void ReleaseStream(struct ArrowArrayStream* stream) {
+  auto* state = static_cast<State*>(stream->private_data);
+  {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    state->stopping = true;
+    state->free_cv.notify_all();
+  }
+  state->producer.join();
+  stream->release = nullptr;
+  std::unique_lock<std::mutex> lock(state->mutex);
+  state->stream_released = true;
+  MaybeDestroy(state, &lock);
+}
+
+}  // namespace detail
+
+// Starts the producer and hands the stream to the caller, who owns it.
+inline void ExportStream(StreamOptions options,
+                         struct ArrowArrayStream* out) {
+  auto* state = new detail::State;
+  state->options = std::move(options);
+  if (state->options.max_slots < state->options.max_ready + 1) {
+    state->options.max_slots = state->options.max_ready + 1;
+  }
+  *out = (struct ArrowArrayStream){
+      .get_schema = detail::GetSchema,
+      .get_next = detail::GetNext,
+      .get_last_error = detail::GetLastError,
+      .release = detail::ReleaseStream,
+      .private_data = state,
+  };
+  state->producer = std::thread(detail::Produce, state);
+}
+
+}  // namespace cstream
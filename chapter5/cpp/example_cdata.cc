@@ -25,6 +25,7 @@
 #include <limits>
 #include <random>
 #include <vector>
+#include "cdata_stream.h"
 
 std::vector<int32_t> generate_data(size_t size) {
   static std::uniform_int_distribution<int32_t> dist(
@@ -64,3 +65,33 @@ void export_int32_data(struct ArrowArray* array) {
   array->buffers[0] = nullptr;
   array->buffers[1] = vecptr->data();
 }  // end of function
+
+extern "C" {
+void export_batch_stream(struct ArrowArrayStream*, int64_t batch_rows,
+                         int64_t num_batches);
+}
+
+// num_batches batches of {id: int64, value: int32, amount: float64}, filled
+// on a background thread into pooled buffers. Batch n is the same on every
+// run.
+void export_batch_stream(struct ArrowArrayStream* stream, int64_t batch_rows,
+                         int64_t num_batches) {
+  cstream::StreamOptions options;
+  options.columns = {{"id", "l", 8}, {"value", "i", 4}, {"amount", "g", 8}};
+  options.batch_rows = batch_rows;
+  options.num_batches = num_batches;
+  options.fill = [](int64_t batch, int64_t rows,
+                    const std::vector<void*>& columns) {
+    auto* ids = static_cast<int64_t*>(columns[0]);
+    auto* values = static_cast<int32_t*>(columns[1]);
+    auto* amounts = static_cast<double*>(columns[2]);
+    std::mt19937_64 generator(batch);
+    for (int64_t i = 0; i < rows; ++i) {
+      uint64_t bits = generator();
+      ids[i] = batch * rows + i;
+      values[i] = static_cast<int32_t>(bits);
+      amounts[i] = static_cast<double>(bits >> 40) / 100.0;
+    }
+  };
+  cstream::ExportStream(std::move(options), stream);
+}
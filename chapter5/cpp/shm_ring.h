@@ -0,0 +1,462 @@
+// MIT License
+//
+// Copyright (c) 2021 Packt
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <arrow/c/abi.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "cdata_stream.h"
+
+// A single producer, single consumer ring of record batch slots in shared
+// memory, for moving batches between processes on one host without copying
+// or serializing them. The producer writes each column straight into its
+// slot in Arrow layout, 64-byte aligned, and publishes the slot; the
+// consumer maps the same memory and hands out an ArrowArray whose buffers
+// point into the slot. Releasing that array, through the usual release
+// callback, marks the slot free for the producer again.
+//
+// The ring is a memfd, shared by fork or by passing the fd, or a named
+// POSIX shm object the consumer opens by name; the creator unlinks the name
+// when its Ring goes away, the mappings stay valid until unmapped. Slots
+// are reused in ring order, so a consumer holding on to one batch stalls
+// the producer once it wraps around to it. Both sides spin briefly, then
+// yield, while waiting.
+//
+// The consumer doesn't trust the other process: Open checks that every
+// column of every slot lies inside the mapping and keeps its own copy of
+// that layout, and Next rejects a slot claiming more than max_rows rows.
+namespace shmring {
+
+constexpr uint64_t kMagic = 0x4152524f57524e47;  // "ARROWRNG"
+constexpr size_t kAlignment = 64;
+constexpr int kMaxColumns = 16;
+
+enum SlotState : uint32_t { kFree = 0, kReady = 1, kHeld = 2 };
+
+struct alignas(kAlignment) SlotHeader {
+  std::atomic<uint32_t> state{kFree};
+  int64_t rows = 0;
+  int64_t published_ns = 0;  // steady clock, for latency measurements
+};
+
+struct alignas(kAlignment) RingHeader {
+  std::atomic<uint64_t> magic{0};
+  uint32_t num_slots;
+  uint32_t num_columns;
+  uint64_t slot_bytes;
+  int64_t max_rows;
+  char names[kMaxColumns][32];
+  char formats[kMaxColumns][8];
+  uint32_t widths[kMaxColumns];
+  uint64_t offsets[kMaxColumns];  // of each column within a slot
+  alignas(kAlignment) std::atomic<uint64_t> published{0};
+  std::atomic<uint32_t> closed{0};
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "the ring needs address-free atomics");
+
+inline size_t Align(size_t n) {
+  return (n + kAlignment - 1) / kAlignment * kAlignment;
+}
+
+inline int64_t NowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// spins, then yields to whoever we're waiting on
+template <typename Predicate>
+void WaitFor(Predicate&& done) {
+  for (int spins = 0; !done(); ++spins) {
+    if (spins > 1000) sched_yield();
+  }
+}
+
+// the mapping of a ring, on either side
+class Ring {
+ public:
+  // a new ring for batches of up to max_rows rows of these columns; an
+  // empty name makes an anonymous memfd
+  static std::unique_ptr<Ring> Create(
+      const std::string& name, const std::vector<cstream::Column>& columns,
+      int64_t max_rows, uint32_t num_slots) {
+    if (columns.size() > kMaxColumns) {
+      throw std::invalid_argument("too many columns for the ring");
+    }
+    if (num_slots == 0 || max_rows < 0) {
+      throw std::invalid_argument("a ring needs slots and max_rows >= 0");
+    }
+    uint64_t slot_bytes = Align(sizeof(SlotHeader));
+    for (const auto& column : columns) {
+      slot_bytes += Align(max_rows * column.width);
+    }
+    int fd = name.empty() ? memfd_create("arrow_ring", 0)
+                          : shm_open(name.c_str(), O_CREAT | O_RDWR, 0600);
+    if (fd < 0) throw std::runtime_error("creating shared memory failed");
+    size_t size = Align(sizeof(RingHeader)) + num_slots * slot_bytes;
+    if (ftruncate(fd, size) != 0) {
+      close(fd);
+      throw std::runtime_error("sizing shared memory failed");
+    }
+
+    std::unique_ptr<Ring> ring(new Ring(fd, size));
+    ring->name_ = name;
+    auto* header = new (ring->header_) RingHeader();
+    header->num_slots = num_slots;
+    header->num_columns = static_cast<uint32_t>(columns.size());
+    header->slot_bytes = slot_bytes;
+    header->max_rows = max_rows;
+    uint64_t offset = Align(sizeof(SlotHeader));
+    for (size_t i = 0; i < columns.size(); ++i) {
+      std::strncpy(header->names[i], columns[i].name.c_str(),
+                   sizeof(header->names[i]) - 1);
+      std::strncpy(header->formats[i], columns[i].format.c_str(),
+                   sizeof(header->formats[i]) - 1);
+      header->widths[i] = columns[i].width;
+      header->offsets[i] = offset;
+      offset += Align(max_rows * columns[i].width);
+    }
+    ring->CopyLayout();
+    for (uint32_t i = 0; i < num_slots; ++i) new (ring->slot(i)) SlotHeader();
+    // last, so a consumer that sees the magic sees the rest
+    header->magic.store(kMagic, std::memory_order_release);
+    return ring;
+  }
+
+  // the consumer's side of a ring made by Create, by fd or by name
+  static std::unique_ptr<Ring> Open(int fd) {
+    struct stat info;
+    if (fstat(fd, &info) != 0) throw std::runtime_error("fstat failed");
+    size_t size = info.st_size;
+    if (size < Align(sizeof(RingHeader))) {
+      throw std::runtime_error("not an Arrow ring");
+    }
+    std::unique_ptr<Ring> ring(new Ring(dup(fd), size));
+    auto* header = ring->header_;
+    // pairs with the release store in Create
+    if (header->magic.load(std::memory_order_acquire) != kMagic) {
+      throw std::runtime_error("not an Arrow ring");
+    }
+    // checked on the copy, the other process can still write the header
+    ring->CopyLayout();
+    if (ring->num_columns_ > kMaxColumns || ring->num_slots_ == 0 ||
+        ring->max_rows_ < 0 ||
+        ring->slot_bytes_ < Align(sizeof(SlotHeader))) {
+      throw std::runtime_error("not an Arrow ring");
+    }
+    // every slot the header describes has to be inside the mapping
+    if ((size - Align(sizeof(RingHeader))) / ring->slot_bytes_ <
+        ring->num_slots_) {
+      throw std::runtime_error("Arrow ring is truncated");
+    }
+    // and every column of max_rows values inside its slot, after the slot
+    // header and aligned
+    const uint64_t max_rows = ring->max_rows_;
+    for (uint32_t i = 0; i < ring->num_columns_; ++i) {
+      const uint64_t offset = ring->offsets_[i];
+      const uint64_t width = ring->widths_[i];
+      if (offset < Align(sizeof(SlotHeader)) || offset % kAlignment != 0 ||
+          offset > ring->slot_bytes_ ||
+          (width != 0 && max_rows > (ring->slot_bytes_ - offset) / width)) {
+        throw std::runtime_error("Arrow ring column " + std::to_string(i) +
+                                 " lies outside its slot");
+      }
+    }
+    return ring;
+  }
+
+  static std::unique_ptr<Ring> Open(const std::string& name) {
+    int fd = shm_open(name.c_str(), O_RDWR, 0600);
+    if (fd < 0) throw std::runtime_error("opening shared memory failed");
+    auto ring = Open(fd);
+    close(fd);
+    return ring;
+  }
+
+  ~Ring() {
+    munmap(base_, size_);
+    close(fd_);
+    if (!name_.empty()) shm_unlink(name_.c_str());
+  }
+
+  int fd() const { return fd_; }
+  RingHeader* header() const { return header_; }
+  uint32_t num_slots() const { return num_slots_; }
+  uint32_t num_columns() const { return num_columns_; }
+  int64_t max_rows() const { return max_rows_; }
+
+  SlotHeader* slot(uint64_t index) const {
+    return reinterpret_cast<SlotHeader*>(base_ + Align(sizeof(RingHeader)) +
+                                         (index % num_slots_) * slot_bytes_);
+  }
+
+  uint8_t* column(uint64_t index, int column) const {
+    return reinterpret_cast<uint8_t*>(slot(index)) + offsets_[column];
+  }
+
+ private:
+  Ring(int fd, size_t size) : fd_(fd), size_(size) {
+    void* base =
+        mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+      close(fd);
+      throw std::runtime_error("mmap failed");
+    }
+    base_ = static_cast<uint8_t*>(base);
+    header_ = reinterpret_cast<RingHeader*>(base_);
+  }
+
+  void CopyLayout() {
+    num_slots_ = header_->num_slots;
+    num_columns_ = header_->num_columns;
+    slot_bytes_ = header_->slot_bytes;
+    max_rows_ = header_->max_rows;
+    for (uint32_t i = 0; i < std::min<uint32_t>(num_columns_, kMaxColumns);
+         ++i) {
+      offsets_[i] = header_->offsets[i];
+      widths_[i] = header_->widths[i];
+    }
+  }
+
+  int fd_;
+  size_t size_;
+  std::string name_;  // set on the creator's side of a named ring
+  uint8_t* base_;
+  RingHeader* header_;
+  // the layout as checked by Open, not read from shared memory again
+  uint32_t num_slots_ = 0;
+  uint32_t num_columns_ = 0;
+  uint64_t slot_bytes_ = 0;
+  int64_t max_rows_ = 0;
+  uint64_t offsets_[kMaxColumns] = {};
+  uint32_t widths_[kMaxColumns] = {};
+};
+
+// Writes batches into the ring:
+//   auto columns = producer.Acquire();  // waits for a free slot
+//   ... fill columns[i] with up to max_rows values ...
+//   producer.Publish(rows);
+class Producer {
+ public:
+  explicit Producer(Ring* ring) : ring_(ring) {}
+
+  std::vector<void*> Acquire() {
+    auto* slot = ring_->slot(next_);
+    WaitFor([&] {
+      return slot->state.load(std::memory_order_acquire) == kFree;
+    });
+    std::vector<void*> columns;
+    for (uint32_t i = 0; i < ring_->num_columns(); ++i) {
+      columns.push_back(ring_->column(next_, i));
+    }
+    return columns;
+  }
+
+  void Publish(int64_t rows) {
+    if (rows < 0 || rows > ring_->max_rows()) {
+      throw std::out_of_range("batch of " + std::to_string(rows) +
+                              " rows doesn't fit a ring slot");
+    }
+    auto* slot = ring_->slot(next_);
+    slot->rows = rows;
+    slot->published_ns = NowNs();
+    slot->state.store(kReady, std::memory_order_release);
+    ring_->header()->published.store(++next_, std::memory_order_release);
+  }
+
+  // no more batches after the ones published
+  void Close() {
+    ring_->header()->closed.store(1, std::memory_order_release);
+  }
+
+ private:
+  Ring* ring_;
+  uint64_t next_ = 0;
+};
+
+// Hands out the ring's batches as ArrowArrays pointing into shared memory.
+// The per-slot ArrowArray structs live in state shared with the exported
+// batches, so Next doesn't allocate, and batches may outlive the Consumer:
+// the state, and the ring mapping their buffers point into, go away once
+// the Consumer and every batch it exported are released.
+class Consumer {
+ public:
+  explicit Consumer(std::shared_ptr<Ring> ring) : state_(new State) {
+    state_->ring = std::move(ring);
+    const auto num_columns = state_->ring->num_columns();
+    for (uint32_t i = 0; i < state_->ring->num_slots(); ++i) {
+      std::unique_ptr<View> view(new View);
+      view->state = state_;
+      view->children.resize(num_columns);
+      view->child_pointers.resize(num_columns);
+      view->buffers.resize(2 * num_columns);
+      state_->views.push_back(std::move(view));
+    }
+  }
+
+  ~Consumer() { Unref(state_); }
+
+  Consumer(const Consumer&) = delete;
+  Consumer& operator=(const Consumer&) = delete;
+
+  // The schema of the ring's batches; the caller owns it.
+  void ExportSchema(struct ArrowSchema* out) const {
+    const auto& ring = *state_->ring;
+    auto* header = ring.header();
+    // bounded, nothing guarantees the other side terminated them
+    auto text = [](const char* chars, size_t size) {
+      return std::string(chars, strnlen(chars, size));
+    };
+    std::vector<cstream::Column> columns;
+    for (uint32_t i = 0; i < ring.num_columns(); ++i) {
+      columns.push_back({text(header->names[i], sizeof(header->names[i])),
+                         text(header->formats[i], sizeof(header->formats[i])),
+                         static_cast<int>(header->widths[i])});
+    }
+    cstream::ExportSchema(columns, out);
+  }
+
+  // false once the producer closed the ring and everything was consumed;
+  // published_ns, if given, gets the time the batch was published
+  bool Next(struct ArrowArray* out, int64_t* published_ns = nullptr) {
+    const auto& ring = *state_->ring;
+    auto* header = ring.header();
+    auto* slot = ring.slot(next_);
+    WaitFor([&] {
+      return slot->state.load(std::memory_order_acquire) == kReady ||
+             (header->closed.load(std::memory_order_acquire) &&
+              header->published.load(std::memory_order_acquire) == next_);
+    });
+    if (slot->state.load(std::memory_order_acquire) != kReady) {
+      out->release = nullptr;
+      return false;
+    }
+    const int64_t rows = slot->rows;
+    if (rows < 0 || rows > ring.max_rows()) {
+      throw std::runtime_error("Arrow ring slot claims " +
+                               std::to_string(rows) + " rows");
+    }
+    slot->state.store(kHeld, std::memory_order_relaxed);
+    if (published_ns != nullptr) *published_ns = slot->published_ns;
+
+    const uint32_t num_columns = ring.num_columns();
+    auto& view = *state_->views[next_ % ring.num_slots()];
+    view.slot = slot;
+    view.refs.store(1 + static_cast<int>(num_columns));
+    state_->refs.fetch_add(1);  // dropped when the batch is released
+    for (uint32_t i = 0; i < num_columns; ++i) {
+      view.buffers[2 * i] = nullptr;
+      view.buffers[2 * i + 1] = ring.column(next_, i);
+      view.children[i] = (struct ArrowArray){
+          .length = rows,
+          .null_count = 0,
+          .offset = 0,
+          .n_buffers = 2,
+          .n_children = 0,
+          .buffers = &view.buffers[2 * i],
+          .children = nullptr,
+          .dictionary = nullptr,
+          .release = ReleaseChild,
+          .private_data = &view,
+      };
+      view.child_pointers[i] = &view.children[i];
+    }
+    *out = (struct ArrowArray){
+        .length = rows,
+        .null_count = 0,
+        .offset = 0,
+        .n_buffers = 1,
+        .n_children = num_columns,
+        .buffers = view.parent_buffers,
+        .children = view.child_pointers.data(),
+        .dictionary = nullptr,
+        .release = ReleaseParent,
+        .private_data = &view,
+    };
+    ++next_;
+    return true;
+  }
+
+ private:
+  struct State;
+
+  struct View {
+    State* state = nullptr;
+    SlotHeader* slot = nullptr;
+    std::atomic<int> refs{0};
+    const void* parent_buffers[1] = {nullptr};
+    std::vector<const void*> buffers;
+    std::vector<struct ArrowArray> children;
+    std::vector<struct ArrowArray*> child_pointers;
+  };
+
+  struct State {
+    std::shared_ptr<Ring> ring;
+    std::vector<std::unique_ptr<View>> views;
+    std::atomic<int> refs{1};  // the Consumer and each exported batch
+  };
+
+  static void Unref(State* state) {
+    if (state->refs.fetch_sub(1) == 1) delete state;
+  }
+
+  static void Unref(View* view) {
+    if (view->refs.fetch_sub(1) == 1) {
+      view->slot->state.store(kFree, std::memory_order_release);
+      Unref(view->state);
+    }
+  }
+
+  static void ReleaseChild(struct ArrowArray* array) {
+    array->release = nullptr;
+    Unref(static_cast<View*>(array->private_data));
+  }
+
+  static void ReleaseParent(struct ArrowArray* array) {
+    for (int64_t i = 0; i < array->n_children; ++i) {
+      auto* child = array->children[i];
+      if (child->release != nullptr) child->release(child);
+    }
+    array->release = nullptr;
+    Unref(static_cast<View*>(array->private_data));
+  }
+
+  State* state_;
+  uint64_t next_ = 0;
+};
+
+}  // namespace shmring
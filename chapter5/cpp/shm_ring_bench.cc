@@ -0,0 +1,204 @@
+// MIT License
+//
+// Copyright (c) 2021 Packt
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <arrow/api.h>
+#include <arrow/c/bridge.h>
+#include <arrow/io/api.h>
+#include <arrow/ipc/api.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "benchmark.h"
+#include "shm_ring.h"
+
+// Throughput and latency of moving record batches from a producer process
+// to a consumer process through the shared memory ring, against writing
+// them as an Arrow IPC stream over a pipe. Both producers fill the same
+// columns the same way; both consumers import the batch and sum one
+// column so the data is actually touched. Latency is from the producer
+// publishing a batch to the consumer having it as a RecordBatch.
+//
+//   shm_ring_bench [rows per batch] [batches]
+
+const std::vector<cstream::Column> columns = {
+    {"id", "l", 8}, {"value", "i", 4}, {"amount", "g", 8}};
+
+void fill(int64_t batch, int64_t rows, const std::vector<void*>& out) {
+  auto* ids = static_cast<int64_t*>(out[0]);
+  auto* values = static_cast<int32_t*>(out[1]);
+  auto* amounts = static_cast<double*>(out[2]);
+  std::mt19937_64 generator(batch);
+  for (int64_t i = 0; i < rows; ++i) {
+    uint64_t bits = generator();
+    ids[i] = batch * rows + i;
+    values[i] = static_cast<int32_t>(bits & 0xff);
+    amounts[i] = static_cast<double>(bits >> 40) / 100.0;
+  }
+}
+
+struct Result {
+  int64_t rows = 0;
+  int64_t sum = 0;
+  double seconds = 0;
+  std::vector<double> latencies;  // seconds
+};
+
+void Report(const std::string& name, int64_t row_bytes, Result result) {
+  std::sort(result.latencies.begin(), result.latencies.end());
+  std::cout << name << ": " << result.rows / result.seconds / 1e6
+            << " Mrows/s, "
+            << result.rows * row_bytes / result.seconds / (1 << 20)
+            << " MiB/s, latency p50 "
+            << bench::Percentile(result.latencies, 0.5) * 1e6 << " us p99 "
+            << bench::Percentile(result.latencies, 0.99) * 1e6
+            << " us (sum " << result.sum << ")" << std::endl;
+}
+
+int64_t SumValues(const arrow::RecordBatch& batch) {
+  const auto& values =
+      static_cast<const arrow::Int32Array&>(*batch.column(1));
+  int64_t sum = 0;
+  for (int64_t i = 0; i < values.length(); ++i) sum += values.Value(i);
+  return sum;
+}
+
+arrow::Result<Result> run_shm(int64_t rows, int64_t batches) {
+  std::shared_ptr<shmring::Ring> ring =
+      shmring::Ring::Create("", columns, rows, 8);
+  pid_t pid = fork();
+  if (pid == 0) {
+    shmring::Producer producer(ring.get());
+    for (int64_t b = 0; b < batches; ++b) {
+      fill(b, rows, producer.Acquire());
+      producer.Publish(rows);
+    }
+    producer.Close();
+    _exit(0);
+  }
+
+  shmring::Consumer consumer(ring);
+  struct ArrowSchema c_schema;
+  consumer.ExportSchema(&c_schema);
+  ARROW_ASSIGN_OR_RAISE(auto schema, arrow::ImportSchema(&c_schema));
+  Result result;
+  auto start = shmring::NowNs();
+  struct ArrowArray c_array;
+  int64_t published_ns;
+  while (consumer.Next(&c_array, &published_ns)) {
+    // zero copy, the batch's buffers are the ring slot
+    ARROW_ASSIGN_OR_RAISE(auto batch,
+                          arrow::ImportRecordBatch(&c_array, schema));
+    result.latencies.push_back((shmring::NowNs() - published_ns) * 1e-9);
+    result.rows += batch->num_rows();
+    result.sum += SumValues(*batch);
+  }  // the batch going away frees its slot
+  result.seconds = (shmring::NowNs() - start) * 1e-9;
+  waitpid(pid, nullptr, 0);
+  return result;
+}
+
+arrow::Status produce_ipc(int fd, int64_t rows, int64_t batches) {
+  ARROW_ASSIGN_OR_RAISE(auto output, arrow::io::FileOutputStream::Open(fd));
+  arrow::FieldVector fields = {arrow::field("id", arrow::int64(), false),
+                               arrow::field("value", arrow::int32(), false),
+                               arrow::field("amount", arrow::float64(), false)};
+  auto schema = arrow::schema(fields);
+  ARROW_ASSIGN_OR_RAISE(auto writer,
+                        arrow::ipc::MakeStreamWriter(output, schema));
+  for (int64_t b = 0; b < batches; ++b) {
+    std::vector<std::shared_ptr<arrow::Buffer>> buffers;
+    std::vector<void*> data;
+    for (const auto& column : columns) {
+      ARROW_ASSIGN_OR_RAISE(auto buffer,
+                            arrow::AllocateBuffer(rows * column.width));
+      data.push_back(buffer->mutable_data());
+      buffers.push_back(std::move(buffer));
+    }
+    fill(b, rows, data);
+    // the send time rides in the first id, the consumer takes it back out
+    static_cast<int64_t*>(data[0])[0] = shmring::NowNs();
+    arrow::ArrayVector arrays;
+    for (size_t i = 0; i < buffers.size(); ++i) {
+      arrays.push_back(arrow::MakeArray(arrow::ArrayData::Make(
+          fields[i]->type(), rows, {nullptr, buffers[i]}, 0)));
+    }
+    ARROW_RETURN_NOT_OK(
+        writer->WriteRecordBatch(*arrow::RecordBatch::Make(schema, rows,
+                                                           arrays)));
+  }
+  ARROW_RETURN_NOT_OK(writer->Close());
+  return output->Close();
+}
+
+arrow::Result<Result> run_pipe(int64_t rows, int64_t batches) {
+  int fds[2];
+  if (pipe(fds) != 0) return arrow::Status::IOError("pipe failed");
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(fds[0]);
+    auto status = produce_ipc(fds[1], rows, batches);
+    if (!status.ok()) std::cerr << status.ToString() << std::endl;
+    _exit(status.ok() ? 0 : 1);
+  }
+  close(fds[1]);
+
+  Result result;
+  auto start = shmring::NowNs();
+  ARROW_ASSIGN_OR_RAISE(auto input, arrow::io::ReadableFile::Open(fds[0]));
+  ARROW_ASSIGN_OR_RAISE(auto reader,
+                        arrow::ipc::RecordBatchStreamReader::Open(input));
+  std::shared_ptr<arrow::RecordBatch> batch;
+  while (true) {
+    ARROW_RETURN_NOT_OK(reader->ReadNext(&batch));
+    if (batch == nullptr) break;
+    auto sent_ns =
+        static_cast<const arrow::Int64Array&>(*batch->column(0)).Value(0);
+    result.latencies.push_back((shmring::NowNs() - sent_ns) * 1e-9);
+    result.rows += batch->num_rows();
+    result.sum += SumValues(*batch);
+  }
+  result.seconds = (shmring::NowNs() - start) * 1e-9;
+  waitpid(pid, nullptr, 0);
+  return result;
+}
+
+int main(int argc, char** argv) {
+  int64_t rows = argc > 1 ? std::atoll(argv[1]) : 1 << 16;
+  int64_t batches = argc > 2 ? std::atoll(argv[2]) : 2000;
+  int64_t row_bytes = 0;
+  for (const auto& column : columns) row_bytes += column.width;
+
+  auto shm = run_shm(rows, batches);
+  auto ipc = run_pipe(rows, batches);
+  if (!shm.ok() || !ipc.ok()) {
+    std::cerr << (shm.ok() ? ipc.status() : shm.status()).ToString()
+              << std::endl;
+    return 1;
+  }
+  Report("shared memory ring", row_bytes, std::move(*shm));
+  Report("ipc over pipe", row_bytes, std::move(*ipc));
+}
@@ -0,0 +1,46 @@
+#!/usr/bin/env python3
+
+# MIT License
+#
+# Copyright (c) 2021 Packt
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+import time
+
+import pyarrow as pa
+from pyarrow.cffi import ffi
+
+ffi.cdef("void export_batch_stream(struct ArrowArrayStream*, int64_t, int64_t);")
+lib = ffi.dlopen("../cpp/libsample.so")
+
+c_stream = ffi.new("struct ArrowArrayStream*")
+c_ptr = int(ffi.cast("uintptr_t", c_stream))
+# 1000 batches of 64Ki rows, produced ahead of us on a C++ thread
+lib.export_batch_stream(c_stream, 1 << 16, 1000)
+
+reader = pa.RecordBatchReader._import_from_c(c_ptr)
+print(reader.schema)
+rows = 0
+start = time.perf_counter()
+for batch in reader:
+    rows += batch.num_rows
+    # dropping the batch releases it, which recycles its buffers
+elapsed = time.perf_counter() - start
+print(f"{rows} rows in {elapsed:.3f} s, {rows / elapsed / 1e6:.1f} Mrows/s")
@@ -22,5 +22,10 @@
 # OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 # SOFTWARE.
 
-g++ compute_functions.cc -o compute_functions `pkg-config --cflags --libs parquet arrow-compute`
+g++ compute_functions.cc -I../../utils/cpp -o compute_functions `pkg-config --cflags --libs parquet arrow-compute`
 g++ compute_or_not.cc -O3 -o compute_or_not `pkg-config --cflags --libs parquet arrow-compute`
+g++ compute_or_not_bench.cc -O3 -I../../utils/cpp -o compute_or_not_bench `pkg-config --cflags --libs arrow-compute`
+g++ -c simd_add_avx2.cc -O3 -mavx2 -o simd_add_avx2.o
+g++ -c simd_add_avx512.cc -O3 -mavx512f -o simd_add_avx512.o
+g++ simd_add.cc simd_add_avx2.o simd_add_avx512.o -O3 -I../../utils/cpp -o simd_add `pkg-config --cflags --libs arrow-compute`
+g++ top_k.cc -O3 -I../../utils/cpp -o top_k `pkg-config --cflags --libs arrow-compute`
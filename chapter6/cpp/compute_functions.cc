@@ -28,18 +28,18 @@
 #include <arrow/table.h>
 #include <parquet/arrow/reader.h>
 #include <iostream>
+#include "parquet_stream.h"
+#include "stats_min_max.h"
+#include "table_cache.h"
+#include "top_k.h"
+
+constexpr auto filepath = "../../sample_data/yellow_tripdata_2015-01.parquet";
 
 arrow::Status compute_parquet() {
-  constexpr auto filepath = "../../sample_data/yellow_tripdata_2015-01.parquet";
-  ARROW_ASSIGN_OR_RAISE(auto input, arrow::io::ReadableFile::Open(filepath));
-  std::unique_ptr<parquet::arrow::FileReader> reader;
-  RETURN_NOT_OK(
-      parquet::arrow::OpenFile(input, arrow::default_memory_pool(), &reader));
-
-  std::shared_ptr<arrow::Table> table;
-  RETURN_NOT_OK(reader->ReadTable(&table));
-  std::shared_ptr<arrow::ChunkedArray> column =
-      table->GetColumnByName("total_amount");
+  // only total_amount gets decoded, and only the first time it's asked for
+  ARROW_ASSIGN_OR_RAISE(
+      std::shared_ptr<arrow::ChunkedArray> column,
+      TableCache::Instance().GetColumn(filepath, "total_amount"));
   std::cout << column->ToString() << std::endl;
 
   ARROW_ASSIGN_OR_RAISE(
@@ -56,16 +56,9 @@ arrow::Status compute_parquet() {
 }
 
 arrow::Status find_minmax() {
-  constexpr auto filepath = "../../sample_data/yellow_tripdata_2015-01.parquet";
-  ARROW_ASSIGN_OR_RAISE(auto input, arrow::io::ReadableFile::Open(filepath));
-  std::unique_ptr<parquet::arrow::FileReader> reader;
-  RETURN_NOT_OK(
-      parquet::arrow::OpenFile(input, arrow::default_memory_pool(), &reader));
-
-  std::shared_ptr<arrow::Table> table;
-  RETURN_NOT_OK(reader->ReadTable(&table));
-  std::shared_ptr<arrow::ChunkedArray> column =
-      table->GetColumnByName("total_amount");
+  ARROW_ASSIGN_OR_RAISE(
+      std::shared_ptr<arrow::ChunkedArray> column,
+      TableCache::Instance().GetColumn(filepath, "total_amount"));
   std::cout << column->ToString() << std::endl;
 
   arrow::compute::ScalarAggregateOptions scalar_agg_opts;
@@ -77,15 +70,49 @@ arrow::Status find_minmax() {
   return arrow::Status::OK();
 }
 
-arrow::Status sort_table() {
-  constexpr auto filepath = "../../sample_data/yellow_tripdata_2015-01.parquet";
-  ARROW_ASSIGN_OR_RAISE(auto input, arrow::io::ReadableFile::Open(filepath));
-  std::unique_ptr<parquet::arrow::FileReader> reader;
-  RETURN_NOT_OK(
-      parquet::arrow::OpenFile(input, arrow::default_memory_pool(), &reader));
+arrow::Status find_minmax_from_stats() {
+  // same answer as find_minmax, but from the footer wherever possible
+  arrow::compute::ScalarAggregateOptions scalar_agg_opts;
+  scalar_agg_opts.skip_nulls = false;
+  ARROW_ASSIGN_OR_RAISE(
+      auto minmax,
+      MinMaxFromStatistics(filepath, "total_amount", scalar_agg_opts));
+  std::cout << "min: " << minmax.min->ToString()
+            << " max: " << minmax.max->ToString()
+            << " count: " << minmax.count << " nulls: " << minmax.null_count
+            << std::endl;
+  std::cout << minmax.row_groups_skipped << " of " << minmax.row_groups
+            << " row groups answered from statistics, "
+            << minmax.row_groups_decoded << " decoded" << std::endl;
+  return arrow::Status::OK();
+}
+
+arrow::Status streamed_sum() {
+  // summing starts on the first batch while later row groups still decode
+  pqstream::StreamOptions options;
+  options.columns = {"total_amount"};
+  ARROW_ASSIGN_OR_RAISE(auto reader,
+                        pqstream::ParquetStreamReader::Open(filepath, options));
+  double sum = 0;
+  std::shared_ptr<arrow::RecordBatch> batch;
+  while (true) {
+    ARROW_RETURN_NOT_OK(reader->ReadNext(&batch));
+    if (batch == nullptr) break;
+    ARROW_ASSIGN_OR_RAISE(arrow::Datum partial,
+                          arrow::compute::Sum(batch->column(0)));
+    auto scalar = partial.scalar_as<arrow::DoubleScalar>();
+    if (scalar.is_valid) sum += scalar.value;
+  }
+  std::cout << "sum: " << sum << " over " << reader->stats().rows
+            << " rows, at most " << reader->stats().buffered_high_water
+            << " bytes decoded ahead" << std::endl;
+  return arrow::Status::OK();
+}
 
-  std::shared_ptr<arrow::Table> table;
-  RETURN_NOT_OK(reader->ReadTable(&table));
+arrow::Status sort_table() {
+  // every column is needed for the Take, total_amount is already cached
+  ARROW_ASSIGN_OR_RAISE(std::shared_ptr<arrow::Table> table,
+                        TableCache::Instance().GetTable(filepath, {}));
 
   arrow::compute::SortOptions sort_opts;
   sort_opts.sort_keys = {arrow::compute::SortKey{
@@ -102,7 +129,29 @@ arrow::Status sort_table() {
   return arrow::Status::OK();
 }
 
+arrow::Status top_trips() {
+  ARROW_ASSIGN_OR_RAISE(std::shared_ptr<arrow::Table> table,
+                        TableCache::Instance().GetTable(filepath, {}));
+
+  // same first rows as sort_table, without sorting or taking the rest
+  TopKOptions options;
+  options.key = "total_amount";
+  options.k = 10;
+  ARROW_ASSIGN_OR_RAISE(auto output, TopK(table, options));
+  std::cout << output->ToString() << std::endl;
+
+  return arrow::Status::OK();
+}
+
 int main(int argc, char** argv) {
   PARQUET_THROW_NOT_OK(compute_parquet());
   PARQUET_THROW_NOT_OK(find_minmax());
+  PARQUET_THROW_NOT_OK(find_minmax_from_stats());
+  PARQUET_THROW_NOT_OK(streamed_sum());
+  PARQUET_THROW_NOT_OK(top_trips());
+
+  auto stats = TableCache::Instance().stats();
+  std::cout << "cache hits: " << stats.hits << " misses: " << stats.misses
+            << " evictions: " << stats.evictions
+            << " bytes cached: " << stats.bytes_cached << std::endl;
 }
\ No newline at end of file
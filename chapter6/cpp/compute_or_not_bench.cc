@@ -0,0 +1,214 @@
+// MIT License
+//
+// Copyright (c) 2021 Packt
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <arrow/api.h>
+#include <arrow/array/data.h>
+#include <arrow/array/util.h>
+#include <arrow/buffer.h>
+#include <arrow/compute/api.h>
+#include <arrow/util/bitmap_ops.h>
+#include <arrow/util/optional.h>
+#include <arrow/util/parallel.h>
+#include <arrow/util/thread_pool.h>
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <numeric>
+#include <string>
+#include <thread>
+#include <vector>
+#include "benchmark.h"
+
+// The same four "add 2" variants as compute_or_not.cc, but measured with the
+// benchmark harness: warmup, repeated trials, a monotonic clock and a sweep
+// over both the array length and the number of threads.
+
+namespace cp = arrow::compute;
+
+using kernel_fn = std::function<arrow::Datum(const arrow::Int32Array&)>;
+
+arrow::Datum add_compute(const arrow::Int32Array& arr) {
+  return cp::Add(arr.data(), arrow::Datum{(int32_t)2}).ValueOrDie();
+}
+
+arrow::Datum add_builder(const arrow::Int32Array& arr) {
+  arrow::Int32Builder b;
+  for (int64_t i = 0; i < arr.length(); ++i) {
+    if (arr.IsValid(i)) {
+      b.Append(arr.Value(i) + 2);
+    } else {
+      b.AppendNull();
+    }
+  }
+  return arrow::Datum{b.Finish().ValueOrDie()};
+}
+
+arrow::Datum add_iterator(const arrow::Int32Array& arr) {
+  arrow::Int32Builder b;
+  b.Reserve(arr.length());
+  std::for_each(std::begin(arr), std::end(arr),
+                [&b](const arrow::util::optional<int32_t>& v) {
+                  if (v) {
+                    b.UnsafeAppend(*v + 2);
+                  } else {
+                    b.UnsafeAppendNull();
+                  }
+                });
+  return arrow::Datum{b.Finish().ValueOrDie()};
+}
+
+arrow::Datum add_raw(const arrow::Int32Array& arr) {
+  std::shared_ptr<arrow::Buffer> newbuf =
+      arrow::AllocateBuffer(sizeof(int32_t) * arr.length()).ValueOrDie();
+  auto output = reinterpret_cast<int32_t*>(newbuf->mutable_data());
+  std::transform(arr.raw_values(), arr.raw_values() + arr.length(), output,
+                 [](const int32_t v) { return v + 2; });
+  // a sliced input shares its parent's bitmap at some offset, but the new
+  // values start at zero so the bitmap has to be realigned to match
+  std::shared_ptr<arrow::Buffer> bitmap = arr.null_bitmap();
+  if (bitmap && arr.offset() != 0) {
+    bitmap = arrow::internal::CopyBitmap(arrow::default_memory_pool(),
+                                         arr.null_bitmap_data(), arr.offset(),
+                                         arr.length())
+                 .ValueOrDie();
+  }
+  return arrow::Datum{arrow::MakeArray(
+      arrow::ArrayData::Make(arr.type(), arr.length(), {bitmap, newbuf},
+                             arr.null_count()))};
+}
+
+// Split the input into `threads` contiguous slices and run the kernel over
+// each slice on the CPU thread pool. With one thread we run inline so the
+// single threaded numbers don't include any scheduling overhead.
+std::vector<arrow::Datum> run_sliced(const kernel_fn& kernel,
+                                     const std::shared_ptr<arrow::Array>& arr,
+                                     int threads) {
+  std::vector<arrow::Datum> out(threads);
+  if (threads == 1) {
+    out[0] = kernel(static_cast<const arrow::Int32Array&>(*arr));
+    return out;
+  }
+
+  const int64_t slice_len = (arr->length() + threads - 1) / threads;
+  auto status = arrow::internal::ParallelFor(threads, [&](int i) {
+    auto slice = std::static_pointer_cast<arrow::Int32Array>(
+        arr->Slice(i * slice_len, slice_len));
+    out[i] = kernel(*slice);
+    return arrow::Status::OK();
+  });
+  if (!status.ok()) {
+    std::cerr << status.message() << std::endl;
+    abort();
+  }
+  return out;
+}
+
+std::shared_ptr<arrow::Array> make_input(int64_t n) {
+  std::vector<int32_t> testvalues(n);
+  std::iota(std::begin(testvalues), std::end(testvalues), 0);
+  // every 100th value is null so the bitmap paths are exercised too
+  std::vector<bool> is_valid(n);
+  for (int64_t i = 0; i < n; ++i) {
+    is_valid[i] = (i % 100) != 0;
+  }
+
+  arrow::Int32Builder nb;
+  nb.AppendValues(testvalues, is_valid);
+  return nb.Finish().ValueOrDie();
+}
+
+int main(int argc, char** argv) {
+  const std::string prefix = argc > 1 ? argv[1] : "compute_or_not";
+
+  const std::vector<std::pair<std::string, kernel_fn>> kernels{
+      {"compute_add", add_compute},
+      {"builder_loop", add_builder},
+      {"iterator_for_each", add_iterator},
+      {"raw_transform", add_raw},
+  };
+
+  std::vector<int> thread_counts{1, 2, 4};
+  const int hw = static_cast<int>(std::thread::hardware_concurrency());
+  if (hw > 4) thread_counts.push_back(hw);
+
+  bench::Options opts;
+  bench::Reporter reporter;
+  // median seconds keyed by (threads, n) -> kernel name
+  std::map<std::pair<int, int64_t>, std::map<std::string, double>> medians;
+
+  for (int64_t n = 1000; n <= 10000000; n *= 10) {
+    auto arr = make_input(n);
+
+    // sanity check that all the variants agree before timing them
+    const auto expected = add_compute(static_cast<arrow::Int32Array&>(*arr));
+    for (const auto& k : kernels) {
+      if (!(k.second(static_cast<arrow::Int32Array&>(*arr)) == expected)) {
+        std::cerr << k.first << " produced a different result" << std::endl;
+        return 1;
+      }
+    }
+
+    for (int threads : thread_counts) {
+      if (!arrow::SetCpuThreadPoolCapacity(threads).ok()) return 1;
+      for (const auto& k : kernels) {
+        // read the input values and write the output values
+        const int64_t bytes = 2 * n * sizeof(int32_t);
+        auto stats = bench::Run(k.first, n, bytes, threads, opts, [&] {
+          return run_sliced(k.second, arr, threads).size();
+        });
+        medians[{threads, n}][k.first] = stats.median;
+        reporter.Add(std::move(stats));
+      }
+    }
+  }
+
+  // report the smallest N at which cp::Add is at least as fast as each of the
+  // hand written loops, per thread count
+  for (int threads : thread_counts) {
+    for (const auto& k : kernels) {
+      if (k.first == "compute_add") continue;
+      int64_t crossover = -1;
+      for (const auto& entry : medians) {
+        if (entry.first.first != threads) continue;
+        if (entry.second.at("compute_add") <= entry.second.at(k.first)) {
+          crossover = entry.first.second;
+          break;
+        }
+      }
+      std::cout << "threads=" << threads << " compute_add vs " << k.first
+                << ": ";
+      if (crossover < 0) {
+        std::cout << "never faster" << std::endl;
+      } else {
+        std::cout << "faster from N=" << crossover << std::endl;
+      }
+    }
+  }
+
+  if (!reporter.WriteJson(prefix + ".json") ||
+      !reporter.WriteCsv(prefix + ".csv")) {
+    std::cerr << "failed writing results to " << prefix << ".{json,csv}"
+              << std::endl;
+    return 1;
+  }
+}
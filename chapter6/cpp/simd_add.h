@@ -0,0 +1,125 @@
+// MIT License
+//
+// Copyright (c) 2021 Packt
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+
+// The element-wise loops behind the "simd_add" compute function in
+// simd_add.cc. The loop is written once against a small set of vector
+// operations (the `Ops` parameter) and instantiated in simd_add_avx2.cc and
+// simd_add_avx512.cc, which are compiled with -mavx2 and -mavx512f. Which
+// instantiation runs is decided at runtime from the CPU's features, so the
+// binary still works on machines without them.
+//
+// An `Ops` type provides:
+//   T, V, kWidth          element type, vector type and lanes per vector
+//   Zero(), Broadcast(T)  vector constructors
+//   Load(const T*), Store(T*, V)
+//   Add(V, V)             wrapping add
+//   Or(V, V), OverflowBits(V a, V b, V sum), AnySignBit(V)
+//                         only needed for the overflow checked integer loops
+
+// Adds `left` to either the `right` array or, when `right` is null, to
+// `right_scalar`. Returns true if a checked kernel saw a lane overflow. Null
+// slots are not special cased here: they are added like any other value and
+// the caller decides whether an overflow there matters.
+template <typename T>
+using AddFn = bool (*)(const T* left, const T* right, T right_scalar, T* out,
+                       int64_t length);
+
+struct AddKernels {
+  const char* name;
+  AddFn<int32_t> int32;
+  AddFn<int32_t> int32_checked;
+  AddFn<int64_t> int64;
+  AddFn<int64_t> int64_checked;
+  AddFn<double> float64;
+};
+
+extern const AddKernels kScalarAddKernels;
+extern const AddKernels kAvx2AddKernels;
+extern const AddKernels kAvx512AddKernels;
+
+// Internal linkage: each translation unit gets its own copies of these. As
+// ordinary inline templates, the AVX2 and AVX-512 objects would emit weak
+// symbols like ScalarAdd<int, false, false> under the same names as
+// simd_add.cc's, and the linker could pick an AVX-compiled copy as the
+// portable scalar fallback.
+namespace {
+
+template <typename T, bool kChecked, bool kScalarRight>
+inline bool ScalarAdd(const T* left, const T* right, T right_scalar, T* out,
+                      int64_t start, int64_t length) {
+  bool overflow = false;
+  for (int64_t i = start; i < length; ++i) {
+    const T rhs = kScalarRight ? right_scalar : right[i];
+    if constexpr (std::is_integral<T>::value) {
+      // wraps like the vector instructions do instead of being UB
+      const bool lane_overflow = __builtin_add_overflow(left[i], rhs, &out[i]);
+      if (kChecked) overflow |= lane_overflow;
+    } else {
+      out[i] = left[i] + rhs;
+    }
+  }
+  return overflow;
+}
+
+template <typename Ops, bool kChecked, bool kScalarRight>
+inline bool VectorAdd(const typename Ops::T* left, const typename Ops::T* right,
+                      typename Ops::T right_scalar, typename Ops::T* out,
+                      int64_t length) {
+  using T = typename Ops::T;
+  using V = typename Ops::V;
+
+  const V broadcast = Ops::Broadcast(right_scalar);
+  V overflow_bits = Ops::Zero();
+  int64_t i = 0;
+  for (; i + Ops::kWidth <= length; i += Ops::kWidth) {
+    const V a = Ops::Load(left + i);
+    const V b = kScalarRight ? broadcast : Ops::Load(right + i);
+    const V sum = Ops::Add(a, b);
+    if (kChecked) {
+      overflow_bits = Ops::Or(overflow_bits, Ops::OverflowBits(a, b, sum));
+    }
+    Ops::Store(out + i, sum);
+  }
+
+  bool overflow = kChecked && Ops::AnySignBit(overflow_bits);
+  overflow |= ScalarAdd<T, kChecked, kScalarRight>(left, right, right_scalar,
+                                                   out, i, length);
+  return overflow;
+}
+
+template <typename Ops, bool kChecked>
+bool VectorAddKernel(const typename Ops::T* left, const typename Ops::T* right,
+                     typename Ops::T right_scalar, typename Ops::T* out,
+                     int64_t length) {
+  return right == nullptr
+             ? VectorAdd<Ops, kChecked, true>(left, right, right_scalar, out,
+                                              length)
+             : VectorAdd<Ops, kChecked, false>(left, right, right_scalar, out,
+                                               length);
+}
+
+}  // namespace
@@ -0,0 +1,105 @@
+// MIT License
+//
+// Copyright (c) 2021 Packt
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Compiled with -mavx2, see build.sh. Keep this file to the vector loops
+// only: anything inline pulled in from other headers would be compiled with
+// AVX2 enabled too and could end up being used on CPUs without it.
+
+#include <immintrin.h>
+#include "simd_add.h"
+
+namespace {
+
+struct Int32Ops {
+  using T = int32_t;
+  using V = __m256i;
+  static constexpr int kWidth = 8;
+
+  static V Zero() { return _mm256_setzero_si256(); }
+  static V Broadcast(T v) { return _mm256_set1_epi32(v); }
+  static V Load(const T* p) {
+    return _mm256_loadu_si256(reinterpret_cast<const V*>(p));
+  }
+  static void Store(T* p, V v) {
+    _mm256_storeu_si256(reinterpret_cast<V*>(p), v);
+  }
+  static V Add(V a, V b) { return _mm256_add_epi32(a, b); }
+  static V Or(V a, V b) { return _mm256_or_si256(a, b); }
+  // the sign bit is set where a and b share a sign that the sum doesn't
+  static V OverflowBits(V a, V b, V sum) {
+    return _mm256_and_si256(_mm256_xor_si256(a, sum),
+                            _mm256_xor_si256(b, sum));
+  }
+  static bool AnySignBit(V v) {
+    return _mm256_movemask_ps(_mm256_castsi256_ps(v)) != 0;
+  }
+};
+
+struct Int64Ops {
+  using T = int64_t;
+  using V = __m256i;
+  static constexpr int kWidth = 4;
+
+  static V Zero() { return _mm256_setzero_si256(); }
+  static V Broadcast(T v) { return _mm256_set1_epi64x(v); }
+  static V Load(const T* p) {
+    return _mm256_loadu_si256(reinterpret_cast<const V*>(p));
+  }
+  static void Store(T* p, V v) {
+    _mm256_storeu_si256(reinterpret_cast<V*>(p), v);
+  }
+  static V Add(V a, V b) { return _mm256_add_epi64(a, b); }
+  static V Or(V a, V b) { return _mm256_or_si256(a, b); }
+  static V OverflowBits(V a, V b, V sum) {
+    return _mm256_and_si256(_mm256_xor_si256(a, sum),
+                            _mm256_xor_si256(b, sum));
+  }
+  static bool AnySignBit(V v) {
+    return _mm256_movemask_pd(_mm256_castsi256_pd(v)) != 0;
+  }
+};
+
+struct DoubleOps {
+  using T = double;
+  using V = __m256d;
+  static constexpr int kWidth = 4;
+
+  static V Zero() { return _mm256_setzero_pd(); }
+  static V Broadcast(T v) { return _mm256_set1_pd(v); }
+  static V Load(const T* p) { return _mm256_loadu_pd(p); }
+  static void Store(T* p, V v) { _mm256_storeu_pd(p, v); }
+  static V Add(V a, V b) { return _mm256_add_pd(a, b); }
+  static V Or(V a, V b) { return _mm256_or_pd(a, b); }
+  static V OverflowBits(V, V, V) { return Zero(); }
+  static bool AnySignBit(V) { return false; }
+};
+
+}  // namespace
+
+const AddKernels kAvx2AddKernels{
+    "avx2",
+    VectorAddKernel<Int32Ops, false>,
+    VectorAddKernel<Int32Ops, true>,
+    VectorAddKernel<Int64Ops, false>,
+    VectorAddKernel<Int64Ops, true>,
+    VectorAddKernel<DoubleOps, false>,
+};
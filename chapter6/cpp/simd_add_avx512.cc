@@ -0,0 +1,94 @@
+// MIT License
+//
+// Copyright (c) 2021 Packt
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Compiled with -mavx512f, see build.sh and the note in simd_add_avx2.cc.
+
+#include <immintrin.h>
+#include "simd_add.h"
+
+namespace {
+
+struct Int32Ops {
+  using T = int32_t;
+  using V = __m512i;
+  static constexpr int kWidth = 16;
+
+  static V Zero() { return _mm512_setzero_si512(); }
+  static V Broadcast(T v) { return _mm512_set1_epi32(v); }
+  static V Load(const T* p) { return _mm512_loadu_si512(p); }
+  static void Store(T* p, V v) { _mm512_storeu_si512(p, v); }
+  static V Add(V a, V b) { return _mm512_add_epi32(a, b); }
+  static V Or(V a, V b) { return _mm512_or_si512(a, b); }
+  static V OverflowBits(V a, V b, V sum) {
+    return _mm512_and_si512(_mm512_xor_si512(a, sum),
+                            _mm512_xor_si512(b, sum));
+  }
+  static bool AnySignBit(V v) {
+    return _mm512_cmplt_epi32_mask(v, Zero()) != 0;
+  }
+};
+
+struct Int64Ops {
+  using T = int64_t;
+  using V = __m512i;
+  static constexpr int kWidth = 8;
+
+  static V Zero() { return _mm512_setzero_si512(); }
+  static V Broadcast(T v) { return _mm512_set1_epi64(v); }
+  static V Load(const T* p) { return _mm512_loadu_si512(p); }
+  static void Store(T* p, V v) { _mm512_storeu_si512(p, v); }
+  static V Add(V a, V b) { return _mm512_add_epi64(a, b); }
+  static V Or(V a, V b) { return _mm512_or_si512(a, b); }
+  static V OverflowBits(V a, V b, V sum) {
+    return _mm512_and_si512(_mm512_xor_si512(a, sum),
+                            _mm512_xor_si512(b, sum));
+  }
+  static bool AnySignBit(V v) {
+    return _mm512_cmplt_epi64_mask(v, Zero()) != 0;
+  }
+};
+
+struct DoubleOps {
+  using T = double;
+  using V = __m512d;
+  static constexpr int kWidth = 8;
+
+  static V Zero() { return _mm512_setzero_pd(); }
+  static V Broadcast(T v) { return _mm512_set1_pd(v); }
+  static V Load(const T* p) { return _mm512_loadu_pd(p); }
+  static void Store(T* p, V v) { _mm512_storeu_pd(p, v); }
+  static V Add(V a, V b) { return _mm512_add_pd(a, b); }
+  static V Or(V a, V) { return a; }
+  static V OverflowBits(V, V, V) { return Zero(); }
+  static bool AnySignBit(V) { return false; }
+};
+
+}  // namespace
+
+const AddKernels kAvx512AddKernels{
+    "avx512",
+    VectorAddKernel<Int32Ops, false>,
+    VectorAddKernel<Int32Ops, true>,
+    VectorAddKernel<Int64Ops, false>,
+    VectorAddKernel<Int64Ops, true>,
+    VectorAddKernel<DoubleOps, false>,
+};
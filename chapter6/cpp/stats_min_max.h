@@ -0,0 +1,212 @@
+// MIT License
+//
+// Copyright (c) 2021 Packt
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <arrow/api.h>
+#include <arrow/compute/api.h>
+#include <arrow/io/file.h>
+#include <arrow/util/checked_cast.h>
+#include <arrow/util/parallel.h>
+#include <parquet/arrow/reader.h>
+#include <parquet/exception.h>
+#include <parquet/file_reader.h>
+#include <parquet/metadata.h>
+#include <parquet/statistics.h>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+
+// min_max and count for one Parquet column, answered from the row group
+// statistics in the footer wherever they can be trusted. Only row groups
+// without usable statistics are decoded, in parallel, and only the one
+// column. The parquet reader already reports is_stats_set() == false for
+// files from writers known to produce wrong statistics.
+struct StatsMinMax {
+  std::shared_ptr<arrow::Scalar> min, max;
+  int64_t count = 0;  // non-null values
+  int64_t null_count = 0;
+  int row_groups = 0;
+  int row_groups_skipped = 0;  // answered from statistics alone
+  int row_groups_decoded = 0;
+};
+
+namespace stats_internal {
+
+// min/max of a column chunk as scalars, or false if they can't be used
+inline bool ChunkMinMax(const parquet::ColumnChunkMetaData& chunk,
+                        std::shared_ptr<arrow::Scalar>* min,
+                        std::shared_ptr<arrow::Scalar>* max,
+                        int64_t* null_count) {
+  if (!chunk.is_stats_set()) return false;
+  auto stats = chunk.statistics();
+  if (!stats || !stats->HasNullCount()) return false;
+  *null_count = stats->null_count();
+  if (!stats->HasMinMax()) {
+    // an all null chunk has no min/max but its counts are still exact
+    *min = *max = nullptr;
+    return stats->null_count() == chunk.num_values();
+  }
+  if (!parquet::arrow::StatisticsAsScalars(*stats, min, max).ok()) {
+    return false;
+  }
+  // NaN bounds were written by old writers and say nothing useful
+  for (const auto* bound : {min, max}) {
+    if ((*bound)->type->id() == arrow::Type::DOUBLE &&
+        std::isnan(arrow::internal::checked_cast<const arrow::DoubleScalar&>(
+                       **bound)
+                       .value)) {
+      return false;
+    }
+    if ((*bound)->type->id() == arrow::Type::FLOAT &&
+        std::isnan(
+            arrow::internal::checked_cast<const arrow::FloatScalar&>(**bound)
+                .value)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+inline arrow::Result<std::shared_ptr<arrow::Array>> ToArray(
+    const std::shared_ptr<arrow::DataType>& type,
+    const arrow::ScalarVector& scalars) {
+  std::unique_ptr<arrow::ArrayBuilder> builder;
+  ARROW_RETURN_NOT_OK(
+      arrow::MakeBuilder(arrow::default_memory_pool(), type, &builder));
+  ARROW_RETURN_NOT_OK(builder->AppendScalars(scalars));
+  return builder->Finish();
+}
+
+}  // namespace stats_internal
+
+inline arrow::Result<StatsMinMax> MinMaxFromStatistics(
+    const std::string& path, const std::string& column,
+    const arrow::compute::ScalarAggregateOptions& options =
+        arrow::compute::ScalarAggregateOptions::Defaults()) {
+  ARROW_ASSIGN_OR_RAISE(auto input, arrow::io::ReadableFile::Open(path));
+  std::shared_ptr<parquet::FileMetaData> metadata;
+  std::unique_ptr<parquet::arrow::FileReader> reader;
+  // a missing, corrupt or non-Parquet file throws
+  BEGIN_PARQUET_CATCH_EXCEPTIONS
+  auto parquet_reader = parquet::ParquetFileReader::Open(input);
+  metadata = parquet_reader->metadata();
+  ARROW_RETURN_NOT_OK(parquet::arrow::FileReader::Make(
+      arrow::default_memory_pool(), std::move(parquet_reader), &reader));
+  END_PARQUET_CATCH_EXCEPTIONS
+
+  const int col = metadata->schema()->ColumnIndex(column);
+  if (col < 0) {
+    return arrow::Status::KeyError("no column named ", column, " in ", path);
+  }
+  std::shared_ptr<arrow::Schema> schema;
+  ARROW_RETURN_NOT_OK(reader->GetSchema(&schema));
+  auto field = schema->GetFieldByName(column);
+  if (!field) {
+    return arrow::Status::NotImplemented(column, " is not a top level column");
+  }
+
+  StatsMinMax result;
+  result.row_groups = metadata->num_row_groups();
+  arrow::ScalarVector mins, maxs;
+  std::vector<int> to_decode;
+  for (int rg = 0; rg < result.row_groups; ++rg) {
+    auto chunk = metadata->RowGroup(rg)->ColumnChunk(col);
+    std::shared_ptr<arrow::Scalar> min, max;
+    int64_t null_count = 0;
+    if (!stats_internal::ChunkMinMax(*chunk, &min, &max, &null_count) ||
+        (min && !min->type->Equals(*field->type()))) {
+      to_decode.push_back(rg);
+      continue;
+    }
+    ++result.row_groups_skipped;
+    result.null_count += null_count;
+    result.count += chunk->num_values() - null_count;
+    if (min) {
+      mins.push_back(std::move(min));
+      maxs.push_back(std::move(max));
+    }
+  }
+
+  // Each task gets its own reader over the same file and parsed footer,
+  // a single FileReader can't serve concurrent reads.
+  std::vector<std::shared_ptr<arrow::Scalar>> decoded_min(to_decode.size()),
+      decoded_max(to_decode.size());
+  std::vector<int64_t> decoded_nulls(to_decode.size()),
+      decoded_rows(to_decode.size());
+  ARROW_RETURN_NOT_OK(arrow::internal::ParallelFor(
+      static_cast<int>(to_decode.size()), [&](int i) -> arrow::Status {
+        // nothing may throw out of a thread pool task
+        std::unique_ptr<parquet::arrow::FileReader> task_reader;
+        BEGIN_PARQUET_CATCH_EXCEPTIONS
+        ARROW_RETURN_NOT_OK(parquet::arrow::FileReader::Make(
+            arrow::default_memory_pool(),
+            parquet::ParquetFileReader::Open(
+                input, parquet::default_reader_properties(), metadata),
+            &task_reader));
+        END_PARQUET_CATCH_EXCEPTIONS
+        std::shared_ptr<arrow::Table> table;
+        ARROW_RETURN_NOT_OK(
+            task_reader->ReadRowGroup(to_decode[i], {col}, &table));
+        auto data = table->column(0);
+        decoded_nulls[i] = data->null_count();
+        decoded_rows[i] = data->length();
+
+        arrow::compute::ScalarAggregateOptions skip_nulls;
+        ARROW_ASSIGN_OR_RAISE(auto minmax,
+                              arrow::compute::MinMax(data, skip_nulls));
+        const auto& pair = minmax.scalar_as<arrow::StructScalar>();
+        decoded_min[i] = pair.value[0];
+        decoded_max[i] = pair.value[1];
+        return arrow::Status::OK();
+      }));
+
+  for (size_t i = 0; i < to_decode.size(); ++i) {
+    ++result.row_groups_decoded;
+    result.null_count += decoded_nulls[i];
+    result.count += decoded_rows[i] - decoded_nulls[i];
+    if (decoded_min[i]->is_valid) {
+      mins.push_back(decoded_min[i]);
+      maxs.push_back(decoded_max[i]);
+    }
+  }
+
+  // fold the per row group bounds with min_max itself, which also gives
+  // the same null semantics as running it over the decoded column
+  ARROW_ASSIGN_OR_RAISE(auto min_array,
+                        stats_internal::ToArray(field->type(), mins));
+  ARROW_ASSIGN_OR_RAISE(auto max_array,
+                        stats_internal::ToArray(field->type(), maxs));
+  ARROW_ASSIGN_OR_RAISE(auto min_of_mins,
+                        arrow::compute::MinMax(min_array, options));
+  ARROW_ASSIGN_OR_RAISE(auto max_of_maxs,
+                        arrow::compute::MinMax(max_array, options));
+  result.min = min_of_mins.scalar_as<arrow::StructScalar>().value[0];
+  result.max = max_of_maxs.scalar_as<arrow::StructScalar>().value[1];
+  if ((!options.skip_nulls && result.null_count > 0) ||
+      result.count < options.min_count) {
+    result.min = arrow::MakeNullScalar(field->type());
+    result.max = arrow::MakeNullScalar(field->type());
+  }
+  return result;
+}
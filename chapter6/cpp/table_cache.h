@@ -0,0 +1,212 @@
+// MIT License
+//
+// Copyright (c) 2021 Packt
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <arrow/io/file.h>
+#include <arrow/status.h>
+#include <arrow/table.h>
+#include <arrow/util/byte_size.h>
+#include <parquet/arrow/reader.h>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// A process wide cache of decoded Parquet columns. Files are memory mapped
+// and opened once, only the columns a caller asks for get decoded, and the
+// decoded ChunkedArrays are shared between everyone who asks for them. When
+// the decoded columns exceed the memory budget the least recently used ones
+// are dropped from the cache; callers still holding one keep it alive.
+//
+// Columns are looked up by name among the file's leaf columns, which is
+// what the flat taxi files need.
+class TableCache {
+ public:
+  struct Stats {
+    int64_t hits = 0;
+    int64_t misses = 0;
+    int64_t evictions = 0;
+    int64_t bytes_cached = 0;
+  };
+
+  explicit TableCache(int64_t memory_budget) : memory_budget_(memory_budget) {}
+
+  static TableCache& Instance() {
+    static TableCache instance{int64_t{2} << 30};  // 2 GiB
+    return instance;
+  }
+
+  void set_memory_budget(int64_t budget) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    memory_budget_ = budget;
+    EvictLocked();
+  }
+
+  Stats stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+  }
+
+  arrow::Result<std::shared_ptr<arrow::ChunkedArray>> GetColumn(
+      const std::string& path, const std::string& column) {
+    ARROW_ASSIGN_OR_RAISE(auto table, GetTable(path, {column}));
+    return table->column(0);
+  }
+
+  // The requested columns as a table, in the order given. An empty list
+  // means every column in the file.
+  arrow::Result<std::shared_ptr<arrow::Table>> GetTable(
+      const std::string& path, std::vector<std::string> columns) {
+    ARROW_ASSIGN_OR_RAISE(auto file, OpenFile(path));
+    if (columns.empty()) {
+      for (const auto& field : file->schema->fields()) {
+        columns.push_back(field->name());
+      }
+    }
+
+    std::vector<std::shared_ptr<arrow::ChunkedArray>> found(columns.size());
+    std::vector<int> missing;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (size_t i = 0; i < columns.size(); ++i) {
+        auto it = entries_.find(Key(path, columns[i]));
+        if (it == entries_.end()) {
+          ++stats_.misses;
+          missing.push_back(static_cast<int>(i));
+          continue;
+        }
+        ++stats_.hits;
+        lru_.splice(lru_.begin(), lru_, it->second.lru_pos);
+        found[i] = it->second.data;
+      }
+    }
+
+    if (!missing.empty()) {
+      ARROW_RETURN_NOT_OK(Decode(path, *file, columns, missing, &found));
+    }
+
+    arrow::FieldVector fields;
+    for (size_t i = 0; i < columns.size(); ++i) {
+      fields.push_back(arrow::field(columns[i], found[i]->type()));
+    }
+    return arrow::Table::Make(arrow::schema(std::move(fields)),
+                              std::move(found));
+  }
+
+ private:
+  struct File {
+    std::shared_ptr<arrow::io::MemoryMappedFile> mapped;
+    std::unique_ptr<parquet::arrow::FileReader> reader;
+    std::shared_ptr<arrow::Schema> schema;
+    std::mutex decode_mutex;  // FileReader isn't safe to share across reads
+  };
+
+  struct Entry {
+    std::shared_ptr<arrow::ChunkedArray> data;
+    int64_t bytes;
+    std::list<std::string>::iterator lru_pos;
+  };
+
+  static std::string Key(const std::string& path, const std::string& column) {
+    return path + '\0' + column;
+  }
+
+  arrow::Result<std::shared_ptr<File>> OpenFile(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = files_.find(path);
+    if (it != files_.end()) return it->second;
+
+    auto file = std::make_shared<File>();
+    ARROW_ASSIGN_OR_RAISE(
+        file->mapped,
+        arrow::io::MemoryMappedFile::Open(path, arrow::io::FileMode::READ));
+    ARROW_RETURN_NOT_OK(parquet::arrow::OpenFile(
+        file->mapped, arrow::default_memory_pool(), &file->reader));
+    file->reader->set_use_threads(true);  // decode columns in parallel
+    ARROW_RETURN_NOT_OK(file->reader->GetSchema(&file->schema));
+    files_.emplace(path, file);
+    return file;
+  }
+
+  // decode just the missing columns in one pass and add them to the cache
+  arrow::Status Decode(const std::string& path, File& file,
+                       const std::vector<std::string>& columns,
+                       const std::vector<int>& missing,
+                       std::vector<std::shared_ptr<arrow::ChunkedArray>>* out) {
+    std::lock_guard<std::mutex> decode_lock(file.decode_mutex);
+    const auto* parquet_schema =
+        file.reader->parquet_reader()->metadata()->schema();
+
+    std::vector<int> indices;
+    for (int i : missing) {
+      const int index = parquet_schema->ColumnIndex(columns[i]);
+      if (index < 0) {
+        return arrow::Status::KeyError("no column named ", columns[i], " in ",
+                                       path);
+      }
+      indices.push_back(index);
+    }
+
+    std::shared_ptr<arrow::Table> table;
+    ARROW_RETURN_NOT_OK(file.reader->ReadTable(indices, &table));
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t j = 0; j < missing.size(); ++j) {
+      const auto key = Key(path, columns[missing[j]]);
+      auto it = entries_.find(key);
+      if (it != entries_.end()) {
+        // someone else decoded it while we were, share theirs
+        (*out)[missing[j]] = it->second.data;
+        continue;
+      }
+      auto data = table->GetColumnByName(columns[missing[j]]);
+      const int64_t bytes = arrow::util::TotalBufferSize(*data);
+      lru_.push_front(key);
+      entries_.emplace(key, Entry{data, bytes, lru_.begin()});
+      stats_.bytes_cached += bytes;
+      (*out)[missing[j]] = std::move(data);
+    }
+    EvictLocked();
+    return arrow::Status::OK();
+  }
+
+  void EvictLocked() {
+    while (stats_.bytes_cached > memory_budget_ && !lru_.empty()) {
+      auto it = entries_.find(lru_.back());
+      stats_.bytes_cached -= it->second.bytes;
+      ++stats_.evictions;
+      entries_.erase(it);
+      lru_.pop_back();
+    }
+  }
+
+  mutable std::mutex mutex_;
+  int64_t memory_budget_;
+  Stats stats_;
+  std::unordered_map<std::string, std::shared_ptr<File>> files_;
+  std::unordered_map<std::string, Entry> entries_;
+  std::list<std::string> lru_;  // most recently used at the front
+};
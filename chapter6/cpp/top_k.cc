@@ -0,0 +1,166 @@
+// MIT License
+//
+// Copyright (c) 2021 Packt
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <arrow/api.h>
+#include <arrow/compute/api.h>
+#include <arrow/compute/exec/exec_plan.h>
+#include <arrow/util/async_generator.h>
+#include <arrow/util/optional.h>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "benchmark.h"
+#include "top_k.h"
+
+// Compares the full sort_indices + Take used by sort_table in
+// compute_functions.cc against TopK on a synthetic taxi-shaped table, and
+// runs the same query through an ExecPlan with the top-k sink.
+
+namespace cp = arrow::compute;
+
+std::shared_ptr<arrow::Table> make_trips(int64_t num_rows, int64_t chunk_size) {
+  const std::vector<std::string> payment_types{"CRD", "CSH", "NOC", "DIS"};
+  auto schema = arrow::schema({arrow::field("total_amount", arrow::float64()),
+                               arrow::field("trip_distance", arrow::float64()),
+                               arrow::field("passenger_count", arrow::int64()),
+                               arrow::field("payment_type", arrow::utf8())});
+
+  std::vector<std::shared_ptr<arrow::RecordBatch>> batches;
+  for (int64_t offset = 0; offset < num_rows; offset += chunk_size) {
+    const int64_t n = std::min(chunk_size, num_rows - offset);
+    std::mt19937_64 gen{static_cast<uint64_t>(offset)};
+    std::lognormal_distribution<> amount{2.5, 0.7};
+    std::exponential_distribution<> distance{0.3};
+    std::uniform_int_distribution<int64_t> passengers{1, 6};
+
+    arrow::DoubleBuilder amount_builder, distance_builder;
+    arrow::Int64Builder passenger_builder;
+    arrow::StringBuilder payment_builder;
+    amount_builder.Reserve(n);
+    distance_builder.Reserve(n);
+    passenger_builder.Reserve(n);
+    payment_builder.Reserve(n);
+    payment_builder.ReserveData(n * 3);
+    for (int64_t i = 0; i < n; ++i) {
+      // a few missing fares so the null handling is exercised
+      if (i % 1000 == 999) {
+        amount_builder.UnsafeAppendNull();
+      } else {
+        amount_builder.UnsafeAppend(amount(gen));
+      }
+      distance_builder.UnsafeAppend(distance(gen));
+      const int64_t count = passengers(gen);
+      passenger_builder.UnsafeAppend(count);
+      payment_builder.UnsafeAppend(payment_types[count % 4]);
+    }
+    batches.push_back(arrow::RecordBatch::Make(
+        schema, n,
+        {amount_builder.Finish().ValueOrDie(),
+         distance_builder.Finish().ValueOrDie(),
+         passenger_builder.Finish().ValueOrDie(),
+         payment_builder.Finish().ValueOrDie()}));
+  }
+  return arrow::Table::FromRecordBatches(schema, batches).ValueOrDie();
+}
+
+// what sort_table does today
+arrow::Result<std::shared_ptr<arrow::Table>> full_sort(
+    const std::shared_ptr<arrow::Table>& table) {
+  cp::SortOptions sort_opts;
+  sort_opts.sort_keys = {
+      cp::SortKey{"total_amount", cp::SortOrder::Descending}};
+  ARROW_ASSIGN_OR_RAISE(arrow::Datum indices,
+                        cp::CallFunction("sort_indices", {table}, &sort_opts));
+  ARROW_ASSIGN_OR_RAISE(arrow::Datum sorted, cp::Take(table, indices));
+  return sorted.table();
+}
+
+arrow::Result<std::shared_ptr<arrow::Table>> top_k_plan(
+    const std::shared_ptr<arrow::Table>& table, const TopKOptions& options) {
+  std::vector<arrow::util::optional<cp::ExecBatch>> batches;
+  arrow::TableBatchReader reader{*table};
+  std::shared_ptr<arrow::RecordBatch> batch;
+  while (true) {
+    ARROW_RETURN_NOT_OK(reader.ReadNext(&batch));
+    if (!batch) break;
+    batches.emplace_back(cp::ExecBatch(*batch));
+  }
+
+  ARROW_ASSIGN_OR_RAISE(auto consumer,
+                        TopKSinkConsumer::Make(table->schema(), options));
+  ARROW_ASSIGN_OR_RAISE(auto plan, cp::ExecPlan::Make());
+  ARROW_RETURN_NOT_OK(
+      cp::Declaration::Sequence(
+          {{"source",
+            cp::SourceNodeOptions{table->schema(),
+                                  arrow::MakeVectorGenerator(batches)}},
+           {"consuming_sink", cp::ConsumingSinkNodeOptions{consumer}}})
+          .AddToPlan(plan.get()));
+  ARROW_RETURN_NOT_OK(plan->Validate());
+  ARROW_RETURN_NOT_OK(plan->StartProducing());
+  ARROW_RETURN_NOT_OK(plan->finished().status());
+  return consumer->table();
+}
+
+int main(int argc, char** argv) {
+  const int64_t num_rows = argc > 1 ? std::stoll(argv[1]) : 10000000;
+  auto table = make_trips(num_rows, 1 << 20);
+  std::cout << "rows: " << table->num_rows() << std::endl;
+
+  auto expected = full_sort(table).ValueOrDie();
+
+  bench::Options opts;
+  opts.warmup = 1;
+  opts.trials = 5;
+  bench::Reporter reporter;
+  const int64_t key_bytes = num_rows * sizeof(double);
+
+  reporter.Add(bench::Run("sort_indices+take", num_rows, key_bytes, 1, opts,
+                          [&] { return full_sort(table).ValueOrDie(); }));
+
+  for (int64_t k : {10, 1000, 100000}) {
+    TopKOptions options;
+    options.key = "total_amount";
+    options.k = k;
+
+    auto top = TopK(table, options).ValueOrDie();
+    auto from_plan = top_k_plan(table, options).ValueOrDie();
+    auto key = expected->Slice(0, k)->GetColumnByName("total_amount");
+    if (!top->Equals(*expected->Slice(0, k)) ||
+        !from_plan->GetColumnByName("total_amount")->Equals(key)) {
+      std::cerr << "top-" << k << " differs from the full sort" << std::endl;
+      return 1;
+    }
+
+    const std::string suffix = "[k=" + std::to_string(k) + "]";
+    reporter.Add(bench::Run("top_k" + suffix, num_rows, key_bytes, 1, opts,
+                            [&] { return TopK(table, options).ValueOrDie(); }));
+    reporter.Add(bench::Run("top_k_plan" + suffix, num_rows, key_bytes, 1, opts,
+                            [&] {
+                              return top_k_plan(table, options).ValueOrDie();
+                            }));
+  }
+
+  reporter.WriteJson("top_k.json");
+  reporter.WriteCsv("top_k.csv");
+}
@@ -0,0 +1,293 @@
+// MIT License
+//
+// Copyright (c) 2021 Packt
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <arrow/api.h>
+#include <arrow/compute/api.h>
+#include <arrow/compute/exec/options.h>
+#include <arrow/util/parallel.h>
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Selects the first K rows of a table in sort order without sorting it.
+// The key column is cut into morsels which are scanned in parallel, each
+// keeping a bounded heap of its best K candidates. The heaps are merged and
+// only the K winning rows are materialized with Take. Ties are broken by row
+// position and NaNs then nulls come last, so the result matches
+// sort_indices + Take + Slice(0, K).
+struct TopKOptions {
+  std::string key;
+  int64_t k = 10;
+  arrow::compute::SortOrder order = arrow::compute::SortOrder::Descending;
+  bool use_threads = true;
+};
+
+namespace top_k_internal {
+
+constexpr int64_t kMorselSize = 1 << 20;
+
+inline arrow::Status Validate(const TopKOptions& options) {
+  if (options.k < 1) {
+    return arrow::Status::Invalid("top-k needs k >= 1, got ", options.k);
+  }
+  return arrow::Status::OK();
+}
+
+template <typename T>
+struct Candidate {
+  T value;
+  int64_t index;
+};
+
+struct Morsel {
+  const arrow::Array* chunk;
+  int64_t begin, end;  // within the chunk
+  int64_t base;        // row index of the chunk's first row
+};
+
+template <typename T>
+struct MorselResult {
+  std::vector<Candidate<T>> heap;
+  std::vector<int64_t> nans, nulls;  // first K of each, in row order
+};
+
+template <typename ArrowType>
+arrow::Result<std::shared_ptr<arrow::Array>> SelectIndices(
+    const arrow::ChunkedArray& column, const TopKOptions& options) {
+  using T = typename ArrowType::c_type;
+  using ArrayType = typename arrow::TypeTraits<ArrowType>::ArrayType;
+  const int64_t k = options.k;
+  const bool descending =
+      options.order == arrow::compute::SortOrder::Descending;
+
+  // "better" sorts first; as a heap comparator it keeps the worst on top
+  auto better = [descending](const Candidate<T>& a, const Candidate<T>& b) {
+    if (a.value != b.value) {
+      return descending ? a.value > b.value : a.value < b.value;
+    }
+    return a.index < b.index;
+  };
+
+  std::vector<Morsel> morsels;
+  int64_t base = 0;
+  for (const auto& chunk : column.chunks()) {
+    for (int64_t begin = 0; begin < chunk->length(); begin += kMorselSize) {
+      morsels.push_back(Morsel{chunk.get(), begin,
+                               std::min(begin + kMorselSize, chunk->length()),
+                               base});
+    }
+    base += chunk->length();
+  }
+
+  std::vector<MorselResult<T>> results(morsels.size());
+  auto scan_morsel = [&](int m) {
+    const auto& morsel = morsels[m];
+    const auto& chunk = static_cast<const ArrayType&>(*morsel.chunk);
+    const T* values = chunk.raw_values();
+    const bool has_nulls = chunk.null_count() > 0;
+    auto& result = results[m];
+    auto& heap = result.heap;
+    heap.reserve(k);
+
+    for (int64_t i = morsel.begin; i < morsel.end; ++i) {
+      const int64_t index = morsel.base + i;
+      if (has_nulls && chunk.IsNull(i)) {
+        if (static_cast<int64_t>(result.nulls.size()) < k) {
+          result.nulls.push_back(index);
+        }
+        continue;
+      }
+      if constexpr (std::is_floating_point<T>::value) {
+        if (std::isnan(values[i])) {
+          if (static_cast<int64_t>(result.nans.size()) < k) {
+            result.nans.push_back(index);
+          }
+          continue;
+        }
+      }
+
+      const Candidate<T> candidate{values[i], index};
+      if (static_cast<int64_t>(heap.size()) < k) {
+        heap.push_back(candidate);
+        std::push_heap(heap.begin(), heap.end(), better);
+      } else if (better(candidate, heap.front())) {
+        std::pop_heap(heap.begin(), heap.end(), better);
+        heap.back() = candidate;
+        std::push_heap(heap.begin(), heap.end(), better);
+      }
+    }
+    return arrow::Status::OK();
+  };
+
+  const int num_morsels = static_cast<int>(morsels.size());
+  if (options.use_threads) {
+    ARROW_RETURN_NOT_OK(arrow::internal::ParallelFor(num_morsels, scan_morsel));
+  } else {
+    for (int m = 0; m < num_morsels; ++m) {
+      ARROW_RETURN_NOT_OK(scan_morsel(m));
+    }
+  }
+
+  // merge: at most K candidates per morsel, so this stays small
+  std::vector<Candidate<T>> merged;
+  std::vector<int64_t> nans, nulls;
+  for (auto& result : results) {
+    merged.insert(merged.end(), result.heap.begin(), result.heap.end());
+    nans.insert(nans.end(), result.nans.begin(), result.nans.end());
+    nulls.insert(nulls.end(), result.nulls.begin(), result.nulls.end());
+  }
+  const auto top = std::min<int64_t>(k, merged.size());
+  std::partial_sort(merged.begin(), merged.begin() + top, merged.end(),
+                    better);
+  // morsels are in row order, so nans and nulls are already sorted by
+  // position and fill up whatever is left after the real values
+
+  arrow::UInt64Builder indices;
+  ARROW_RETURN_NOT_OK(indices.Reserve(k));
+  for (int64_t i = 0; i < top; ++i) {
+    indices.UnsafeAppend(static_cast<uint64_t>(merged[i].index));
+  }
+  for (const auto* tail : {&nans, &nulls}) {
+    for (int64_t index : *tail) {
+      if (indices.length() == k) break;
+      indices.UnsafeAppend(static_cast<uint64_t>(index));
+    }
+  }
+  return indices.Finish();
+}
+
+}  // namespace top_k_internal
+
+// The row indices of the first K rows in sort order, like sort_indices
+// followed by Slice(0, K).
+inline arrow::Result<std::shared_ptr<arrow::Array>> TopKIndices(
+    const arrow::ChunkedArray& column, const TopKOptions& options) {
+  using top_k_internal::SelectIndices;
+  ARROW_RETURN_NOT_OK(top_k_internal::Validate(options));
+  switch (column.type()->id()) {
+    case arrow::Type::INT32:
+      return SelectIndices<arrow::Int32Type>(column, options);
+    case arrow::Type::INT64:
+      return SelectIndices<arrow::Int64Type>(column, options);
+    case arrow::Type::FLOAT:
+      return SelectIndices<arrow::FloatType>(column, options);
+    case arrow::Type::DOUBLE:
+      return SelectIndices<arrow::DoubleType>(column, options);
+    default:
+      return arrow::Status::NotImplemented("top-k on ",
+                                           column.type()->ToString());
+  }
+}
+
+inline arrow::Result<std::shared_ptr<arrow::Table>> TopK(
+    const std::shared_ptr<arrow::Table>& table, const TopKOptions& options) {
+  auto column = table->GetColumnByName(options.key);
+  if (!column) {
+    return arrow::Status::KeyError("no column named ", options.key);
+  }
+  ARROW_ASSIGN_OR_RAISE(auto indices, TopKIndices(*column, options));
+  ARROW_ASSIGN_OR_RAISE(arrow::Datum rows,
+                        arrow::compute::Take(table, indices));
+  return rows.table();
+}
+
+// An ExecPlan sink keeping the top K rows of everything it's fed, for use
+// with "consuming_sink" at the end of a dataset scan. Every batch is cut
+// down to its own top K, and the survivors are compacted back to K rows
+// whenever enough of them pile up, so memory stays proportional to K
+// rather than to the dataset.
+class TopKSinkConsumer : public arrow::compute::SinkNodeConsumer {
+ public:
+  // checks the options up front, see the constructor
+  static arrow::Result<std::shared_ptr<TopKSinkConsumer>> Make(
+      std::shared_ptr<arrow::Schema> schema, TopKOptions options) {
+    ARROW_RETURN_NOT_OK(top_k_internal::Validate(options));
+    return std::make_shared<TopKSinkConsumer>(std::move(schema),
+                                              std::move(options));
+  }
+
+  // invalid options fail the first Consume or Finish
+  TopKSinkConsumer(std::shared_ptr<arrow::Schema> schema, TopKOptions options)
+      : schema_(std::move(schema)),
+        options_(std::move(options)),
+        status_(top_k_internal::Validate(options_)) {
+    // batches already arrive on the CPU thread pool, don't nest on it
+    options_.use_threads = false;
+  }
+
+  arrow::Status Consume(arrow::compute::ExecBatch batch) override {
+    ARROW_RETURN_NOT_OK(status_);
+    ARROW_ASSIGN_OR_RAISE(auto record_batch, batch.ToRecordBatch(schema_));
+    ARROW_ASSIGN_OR_RAISE(auto table,
+                          arrow::Table::FromRecordBatches({record_batch}));
+    ARROW_ASSIGN_OR_RAISE(auto top, TopK(table, options_));
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_rows_ += top->num_rows();
+    candidates_.push_back(std::move(top));
+    if (pending_rows_ > kCompactFactor * options_.k) {
+      return CompactLocked();
+    }
+    return arrow::Status::OK();
+  }
+
+  arrow::Future<> Finish() override {
+    ARROW_RETURN_NOT_OK(status_);
+    std::lock_guard<std::mutex> lock(mutex_);
+    return CompactLocked();
+  }
+
+  // the result, valid once the plan has finished
+  std::shared_ptr<arrow::Table> table() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return candidates_.empty() ? nullptr : candidates_.front();
+  }
+
+ private:
+  static constexpr int64_t kCompactFactor = 8;
+
+  arrow::Status CompactLocked() {
+    if (candidates_.empty()) {
+      ARROW_ASSIGN_OR_RAISE(auto empty, arrow::Table::MakeEmpty(schema_));
+      candidates_.push_back(std::move(empty));
+      return arrow::Status::OK();
+    }
+    ARROW_ASSIGN_OR_RAISE(auto all, arrow::ConcatenateTables(candidates_));
+    ARROW_ASSIGN_OR_RAISE(auto top, TopK(all, options_));
+    candidates_ = {top};
+    pending_rows_ = top->num_rows();
+    return arrow::Status::OK();
+  }
+
+  const std::shared_ptr<arrow::Schema> schema_;
+  TopKOptions options_;
+  const arrow::Status status_;
+  mutable std::mutex mutex_;
+  std::vector<std::shared_ptr<arrow::Table>> candidates_;
+  int64_t pending_rows_ = 0;
+};
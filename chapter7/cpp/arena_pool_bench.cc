@@ -0,0 +1,215 @@
+// MIT License
+//
+// Copyright (c) 2021 Packt
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <arrow/api.h>
+#include <arrow/compute/api.h>
+#include <arrow/compute/exec/exec_plan.h>
+#include <arrow/dataset/api.h>
+#include <arrow/dataset/plan.h>
+#include <arrow/io/api.h>
+#include <arrow/util/async_generator.h>
+#include <arrow/util/optional.h>
+#include <arrow/util/thread_pool.h>
+#include <parquet/arrow/reader.h>
+#include <parquet/arrow/writer.h>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "arena_pool.h"
+#include "benchmark.h"
+#include "taxi_data.h"
+
+namespace ds = arrow::dataset;
+namespace cp = arrow::compute;
+
+// The same short queries run against each pool Arrow was built with, and
+// against an ArenaMemoryPool made for the query and dropped after it:
+//   kernels     per-batch temporaries from chained compute calls, the
+//               pattern compute_or_not.cc times in chapter 6
+//   read_table  parquet::arrow ReadTable of a whole file
+//   plan        scan, filter and hash aggregate in an ExecPlan, shaped
+//               like grouped_filtered_mean in streaming_engine.cc
+// All of them run over generated taxi data, so no network is needed.
+constexpr int64_t kRows = int64_t(1) << 23;
+constexpr int64_t kBatchRows = int64_t(1) << 16;
+constexpr auto parquet_path = "/tmp/arena_pool_bench.parquet";
+
+arrow::Status kernels(const arrow::Table& table, cp::ExecContext* ctx) {
+  arrow::TableBatchReader reader(table);
+  reader.set_chunksize(kBatchRows);
+  std::shared_ptr<arrow::RecordBatch> batch;
+  while (true) {
+    ARROW_RETURN_NOT_OK(reader.ReadNext(&batch));
+    if (batch == nullptr) break;
+    auto fare = batch->GetColumnByName("fare_amount");
+    auto tip = batch->GetColumnByName("tip_amount");
+    ARROW_ASSIGN_OR_RAISE(auto total,
+                          cp::CallFunction("add", {fare, tip}, ctx));
+    ARROW_ASSIGN_OR_RAISE(auto ratio,
+                          cp::CallFunction("divide", {tip, total}, ctx));
+    ARROW_ASSIGN_OR_RAISE(
+        auto generous,
+        cp::CallFunction("greater", {ratio, arrow::Datum(0.2f)}, ctx));
+    ARROW_ASSIGN_OR_RAISE(auto kept, cp::CallFunction(
+                                         "filter", {batch, generous}, ctx));
+    bench::DoNotOptimize(kept.record_batch()->num_rows());
+  }
+  return arrow::Status::OK();
+}
+
+arrow::Status read_table(arrow::MemoryPool* pool) {
+  ARROW_ASSIGN_OR_RAISE(auto input,
+                        arrow::io::ReadableFile::Open(parquet_path, pool));
+  std::unique_ptr<parquet::arrow::FileReader> reader;
+  ARROW_RETURN_NOT_OK(parquet::arrow::OpenFile(input, pool, &reader));
+  reader->set_use_threads(true);
+  std::shared_ptr<arrow::Table> table;
+  ARROW_RETURN_NOT_OK(reader->ReadTable(&table));
+  bench::DoNotOptimize(table->num_rows());
+  return arrow::Status::OK();
+}
+
+arrow::Status plan(const std::shared_ptr<ds::Dataset>& dataset,
+                   cp::ExecContext* ctx) {
+  auto options = std::make_shared<ds::ScanOptions>();
+  options->use_threads = true;
+  options->pool = ctx->memory_pool();
+  ARROW_ASSIGN_OR_RAISE(auto projection, ds::ProjectionDescr::FromNames(
+                                             {"vendor_id", "passenger_count",
+                                              "fare_amount"},
+                                             *dataset->schema()));
+  ds::SetProjection(options.get(), projection);
+
+  arrow::AsyncGenerator<arrow::util::optional<cp::ExecBatch>> sink_gen;
+  ARROW_ASSIGN_OR_RAISE(auto plan, cp::ExecPlan::Make(ctx));
+  ARROW_RETURN_NOT_OK(
+      cp::Declaration::Sequence(
+          {{"scan", ds::ScanNodeOptions{dataset, options}},
+           {"filter",
+            cp::FilterNodeOptions{cp::greater(
+                cp::field_ref("passenger_count"),
+                cp::literal(static_cast<int8_t>(1)))}},
+           {"aggregate", cp::AggregateNodeOptions{{{"hash_mean", nullptr}},
+                                                  {"fare_amount"},
+                                                  {"mean(fare_amount)"},
+                                                  {"vendor_id"}}},
+           {"sink", cp::SinkNodeOptions{&sink_gen}}})
+          .AddToPlan(plan.get()));
+
+  auto schema =
+      arrow::schema({arrow::field("mean(fare_amount)", arrow::float64()),
+                     arrow::field("vendor_id", arrow::utf8())});
+  auto sink_reader =
+      cp::MakeGeneratorReader(schema, std::move(sink_gen), ctx->memory_pool());
+  ARROW_RETURN_NOT_OK(plan->StartProducing());
+  ARROW_ASSIGN_OR_RAISE(auto result,
+                        arrow::Table::FromRecordBatchReader(sink_reader.get()));
+  bench::DoNotOptimize(result->num_rows());
+  return plan->finished().status();
+}
+
+struct Pool {
+  std::string name;
+  // the pool for one query, and what to do once the query is over
+  std::function<arrow::MemoryPool*()> begin;
+  std::function<void()> end = [] {};
+};
+
+int main(int argc, char** argv) {
+  datagen::Generator gen(taxidata::Columns(2016, 1), 42);
+  auto table = gen.MakeTable(kRows, kBatchRows).ValueOrDie();
+  auto dataset = std::make_shared<ds::InMemoryDataset>(table);
+  {
+    auto output = arrow::io::FileOutputStream::Open(parquet_path).ValueOrDie();
+    auto status = parquet::arrow::WriteTable(
+        *table, arrow::default_memory_pool(), output, /*chunk_size*/ 1 << 20);
+    if (!status.ok() || !output->Close().ok()) {
+      std::cerr << status.ToString() << std::endl;
+      return 1;
+    }
+  }
+  ds::internal::Initialize();
+
+  std::vector<Pool> pools;
+  pools.push_back({"system", [] { return arrow::system_memory_pool(); }});
+  arrow::MemoryPool* pool;
+  if (arrow::jemalloc_memory_pool(&pool).ok()) {
+    pools.push_back({"jemalloc", [pool] { return pool; }});
+  }
+  if (arrow::mimalloc_memory_pool(&pool).ok()) {
+    pools.push_back({"mimalloc", [pool] { return pool; }});
+  }
+  std::unique_ptr<arena::ArenaMemoryPool> query_arena;
+  int64_t arena_reserved = 0;
+  pools.push_back({"arena",
+                   [&] {
+                     query_arena.reset(new arena::ArenaMemoryPool);
+                     return query_arena.get();
+                   },
+                   [&] {
+                     arena_reserved = query_arena->reserved_bytes();
+                     query_arena.reset();
+                   }});
+
+  bench::Options opts;
+  opts.warmup = 1;
+  opts.trials = 10;
+  const int threads = arrow::GetCpuThreadPoolCapacity();
+  bench::Reporter reporter;
+  auto run = [&](const std::string& workload, const Pool& pool,
+                 std::function<arrow::Status(cp::ExecContext*)> fn) {
+    reporter.Add(bench::Run(
+        workload + "/" + pool.name, kRows, 0, threads, opts, [&] {
+          // scoped so everything the query made is gone before end()
+          arrow::Status status;
+          {
+            cp::ExecContext ctx(pool.begin(),
+                                arrow::internal::GetCpuThreadPool());
+            status = fn(&ctx);
+          }
+          pool.end();
+          if (!status.ok()) {
+            std::cerr << status.ToString() << std::endl;
+            std::abort();
+          }
+          return 0;
+        }));
+    if (pool.name == "arena") {
+      std::cout << "  arena held " << arena_reserved / (1 << 20)
+                << " MiB at the end of the query" << std::endl;
+    }
+  };
+
+  for (const auto& pool : pools) {
+    run("kernels", pool,
+        [&](cp::ExecContext* ctx) { return kernels(*table, ctx); });
+    run("read_table", pool,
+        [&](cp::ExecContext* ctx) { return read_table(ctx->memory_pool()); });
+    run("plan", pool,
+        [&](cp::ExecContext* ctx) { return plan(dataset, ctx); });
+  }
+
+  if (argc > 1) reporter.WriteCsv(argv[1]);
+}
@@ -0,0 +1,149 @@
+// MIT License
+//
+// Copyright (c) 2021 Packt
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <arrow/api.h>
+#include <arrow/dataset/api.h>
+#include <arrow/filesystem/api.h>
+#include <parquet/arrow/writer.h>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include "block_cache_fs.h"
+
+namespace fs = arrow::fs;
+namespace ds = arrow::dataset;
+
+// Scans a local Parquet dataset behind SlowFileSystem, which adds a random
+// latency around this average to every call and read, standing in for S3.
+// The block cache should bring warm re-scans close to local disk speed.
+constexpr auto base_dir = "/tmp/block_cache_sample";
+constexpr auto cache_dir = "/tmp/block_cache_blocks";
+constexpr double average_latency = 0.01;
+constexpr int num_files = 8;
+constexpr int64_t rows_per_file = 1 << 20;
+
+arrow::Status write_sample(const std::shared_ptr<fs::FileSystem>& filesystem) {
+  ARROW_RETURN_NOT_OK(filesystem->CreateDir(base_dir));
+  for (int f = 0; f < num_files; ++f) {
+    arrow::Int64Builder ids;
+    arrow::DoubleBuilder fares;
+    arrow::StringBuilder vendors;
+    for (int64_t i = 0; i < rows_per_file; ++i) {
+      ARROW_RETURN_NOT_OK(ids.Append(f * rows_per_file + i));
+      ARROW_RETURN_NOT_OK(fares.Append(2.5 + (i % 1000) * 0.05));
+      ARROW_RETURN_NOT_OK(vendors.Append(i % 3 == 0 ? "CMT" : "VTS"));
+    }
+    std::shared_ptr<arrow::Array> id_arr, fare_arr, vendor_arr;
+    ARROW_RETURN_NOT_OK(ids.Finish(&id_arr));
+    ARROW_RETURN_NOT_OK(fares.Finish(&fare_arr));
+    ARROW_RETURN_NOT_OK(vendors.Finish(&vendor_arr));
+    auto table = arrow::Table::Make(
+        arrow::schema({arrow::field("id", arrow::int64()),
+                       arrow::field("fare_amount", arrow::float64()),
+                       arrow::field("vendor_id", arrow::utf8())}),
+        {id_arr, fare_arr, vendor_arr});
+    ARROW_ASSIGN_OR_RAISE(
+        auto output, filesystem->OpenOutputStream(
+                         std::string(base_dir) + "/part" +
+                         std::to_string(f) + ".parquet"));
+    ARROW_RETURN_NOT_OK(parquet::arrow::WriteTable(
+        *table, arrow::default_memory_pool(), output, /*chunk_size*/ 1 << 17));
+    ARROW_RETURN_NOT_OK(output->Close());
+  }
+  return arrow::Status::OK();
+}
+
+// discovery plus a scan of two of the three columns, in seconds
+arrow::Result<double> scan(const std::shared_ptr<fs::FileSystem>& filesystem,
+                           int64_t* rows) {
+  auto start = std::chrono::steady_clock::now();
+  auto format = std::make_shared<ds::ParquetFileFormat>();
+  // coalesced column chunk reads, issued ahead through ReadAsync
+  auto scan_options = std::make_shared<ds::ParquetFragmentScanOptions>();
+  scan_options->arrow_reader_properties->set_pre_buffer(true);
+  format->default_fragment_scan_options = scan_options;
+
+  fs::FileSelector selector;
+  selector.base_dir = base_dir;
+  ARROW_ASSIGN_OR_RAISE(auto factory, ds::FileSystemDatasetFactory::Make(
+                                          filesystem, selector, format,
+                                          ds::FileSystemFactoryOptions()));
+  ARROW_ASSIGN_OR_RAISE(auto dataset, factory->Finish());
+  ARROW_ASSIGN_OR_RAISE(auto scan_builder, dataset->NewScan());
+  ARROW_RETURN_NOT_OK(scan_builder->Project({"id", "fare_amount"}));
+  ARROW_RETURN_NOT_OK(scan_builder->UseThreads(true));
+  ARROW_ASSIGN_OR_RAISE(auto scanner, scan_builder->Finish());
+  ARROW_ASSIGN_OR_RAISE(auto table, scanner->ToTable());
+  *rows = table->num_rows();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+arrow::Status report(const std::string& name,
+                     const std::shared_ptr<fs::FileSystem>& filesystem) {
+  int64_t rows = 0;
+  ARROW_ASSIGN_OR_RAISE(auto seconds, scan(filesystem, &rows));
+  std::cout << name << ": " << seconds << " s, " << rows << " rows"
+            << std::endl;
+  return arrow::Status::OK();
+}
+
+arrow::Status run() {
+  std::shared_ptr<fs::FileSystem> local =
+      std::make_shared<fs::LocalFileSystem>();
+  ARROW_RETURN_NOT_OK(write_sample(local));
+  ARROW_RETURN_NOT_OK(local->CreateDir(cache_dir));
+  ARROW_RETURN_NOT_OK(local->DeleteDirContents(cache_dir));
+  std::shared_ptr<fs::FileSystem> slow =
+      std::make_shared<fs::SlowFileSystem>(local, average_latency, 42);
+
+  ARROW_RETURN_NOT_OK(report("local", local));
+  ARROW_RETURN_NOT_OK(report("slow", slow));
+
+  blockcache::BlockCacheOptions options;
+  options.disk_dir = cache_dir;
+  ARROW_ASSIGN_OR_RAISE(auto cache, blockcache::BlockCache::Make(options));
+  auto cached = std::make_shared<blockcache::CachingFileSystem>(slow, cache);
+  ARROW_RETURN_NOT_OK(report("cached, cold", cached));
+  cache->stats().Print();
+  ARROW_RETURN_NOT_OK(report("cached, warm", cached));
+  cache->stats().Print();
+
+  // a new process: nothing in memory, the blocks are still on disk
+  ARROW_ASSIGN_OR_RAISE(auto disk_cache, blockcache::BlockCache::Make(options));
+  auto disk_cached =
+      std::make_shared<blockcache::CachingFileSystem>(slow, disk_cache);
+  ARROW_RETURN_NOT_OK(report("cached, from disk", disk_cached));
+  disk_cache->stats().Print();
+  return arrow::Status::OK();
+}
+
+int main(int argc, char** argv) {
+  auto status = run();
+  if (!status.ok()) {
+    std::cerr << status.ToString() << std::endl;
+    return 1;
+  }
+}
@@ -0,0 +1,631 @@
+// MIT License
+//
+// Copyright (c) 2021 Packt
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <arrow/api.h>
+#include <arrow/filesystem/api.h>
+#include <arrow/io/api.h>
+#include <arrow/util/future.h>
+#include <arrow/util/thread_pool.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// A read-through block cache in front of any FileSystem. Random access
+// files are read in fixed size blocks, kept in memory and, if a directory
+// is given, on local disk, both with LRU eviction. Blocks are keyed by path,
+// size and mtime so a rewritten file never hits stale blocks.
+//
+// Missing adjacent blocks are fetched with one read, WillNeed prefetches
+// the blocks of the ranges it's given (column chunks) and opening a file
+// prefetches the blocks holding its footer. A block already being fetched
+// by another thread is waited for instead of being fetched twice.
+
+namespace blockcache {
+
+namespace fs = arrow::fs;
+namespace io = arrow::io;
+
+struct BlockCacheOptions {
+  int64_t block_size = 1 << 20;
+  int64_t memory_capacity = int64_t(256) << 20;
+  std::string disk_dir;  // empty for a memory only cache
+  int64_t disk_capacity = int64_t(4) << 30;
+  int64_t footer_prefetch = 64 << 10;  // 0 to not prefetch footers
+};
+
+struct BlockCacheStats {
+  int64_t memory_hits = 0;
+  int64_t disk_hits = 0;
+  int64_t misses = 0;
+  int64_t remote_reads = 0;  // coalesced reads issued to the base fs
+  int64_t bytes_remote = 0;
+  int64_t bytes_saved = 0;  // bytes served without the base fs
+  int64_t evictions = 0;
+
+  void Print(std::ostream& os = std::cout) const {
+    os << "block cache: " << memory_hits << " memory hits, " << disk_hits
+       << " disk hits, " << misses << " misses in " << remote_reads
+       << " reads, " << bytes_remote / (1 << 20) << " MiB fetched, "
+       << bytes_saved / (1 << 20) << " MiB saved, " << evictions
+       << " evictions" << std::endl;
+  }
+};
+
+using BlockFuture = arrow::Future<std::shared_ptr<arrow::Buffer>>;
+
+// Thread safe, shared by every file of a CachingFileSystem (or several).
+class BlockCache {
+ public:
+  static arrow::Result<std::shared_ptr<BlockCache>> Make(
+      BlockCacheOptions options = {}) {
+    std::shared_ptr<BlockCache> cache(new BlockCache(std::move(options)));
+    ARROW_RETURN_NOT_OK(cache->LoadDiskIndex());
+    return cache;
+  }
+
+  const BlockCacheOptions& options() const { return options_; }
+
+  BlockCacheStats stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+  }
+
+  using FetchFn = std::function<arrow::Result<std::shared_ptr<arrow::Buffer>>(
+      int64_t, int64_t)>;
+
+  // Blocks [first, last] of a file, fetching whatever is missing through
+  // `fetch(offset, length)` with one call per run of adjacent missing blocks.
+  arrow::Result<std::vector<std::shared_ptr<arrow::Buffer>>> GetBlocks(
+      const std::string& file_key, int64_t file_size, int64_t first,
+      int64_t last, const FetchFn& fetch) {
+    return GetBlocks(file_key, file_size, first, last, fetch,
+                     /*retry_failed_waits=*/true);
+  }
+
+ private:
+  struct MemoryEntry {
+    std::shared_ptr<arrow::Buffer> block;
+    std::list<std::string>::iterator lru;
+  };
+  struct DiskEntry {
+    int64_t size;
+    std::list<std::string>::iterator lru;
+  };
+
+  explicit BlockCache(BlockCacheOptions options)
+      : options_(std::move(options)) {}
+
+  // A block another thread was fetching is fetched again here if that
+  // fetch failed, once: a failed prefetch mustn't fail the read behind it.
+  arrow::Result<std::vector<std::shared_ptr<arrow::Buffer>>> GetBlocks(
+      const std::string& file_key, int64_t file_size, int64_t first,
+      int64_t last, const FetchFn& fetch, bool retry_failed_waits) {
+    auto count = last - first + 1;
+    std::vector<std::shared_ptr<arrow::Buffer>> blocks(count);
+    std::vector<std::pair<int64_t, BlockFuture>> waits;
+    std::vector<int64_t> on_disk, missing;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (int64_t i = 0; i < count; ++i) {
+        auto key = BlockKey(file_key, first + i);
+        auto cached = memory_.find(key);
+        if (cached != memory_.end()) {
+          memory_lru_.splice(memory_lru_.begin(), memory_lru_,
+                             cached->second.lru);
+          blocks[i] = cached->second.block;
+          ++stats_.memory_hits;
+          stats_.bytes_saved += blocks[i]->size();
+          continue;
+        }
+        auto pending = pending_.find(key);
+        if (pending != pending_.end()) {
+          waits.emplace_back(i, pending->second);
+          continue;
+        }
+        pending_.emplace(key, BlockFuture::Make());
+        if (disk_.count(DiskName(key))) {
+          on_disk.push_back(i);
+        } else {
+          missing.push_back(i);
+          ++stats_.misses;
+        }
+      }
+    }
+
+    for (auto i : on_disk) {
+      auto key = BlockKey(file_key, first + i);
+      auto block = ReadDisk(key);
+      if (block.ok()) {
+        blocks[i] = *block;
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++stats_.disk_hits;
+        stats_.bytes_saved += blocks[i]->size();
+        Complete(key, blocks[i], /*written_to_disk=*/false);
+      } else {
+        // gone or corrupt, fetch it like any other miss
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++stats_.misses;
+        missing.push_back(i);
+      }
+    }
+    std::sort(missing.begin(), missing.end());
+
+    arrow::Status status;
+    const auto block_size = options_.block_size;
+    for (size_t run_start = 0; run_start < missing.size();) {
+      auto run_end = run_start;
+      while (run_end + 1 < missing.size() &&
+             missing[run_end + 1] == missing[run_end] + 1) {
+        ++run_end;
+      }
+      auto offset = (first + missing[run_start]) * block_size;
+      auto length = std::min(
+          (missing[run_end] - missing[run_start] + 1) * block_size,
+          file_size - offset);
+      auto fetched = status.ok() ? fetch(offset, length)
+                                 : arrow::Result<std::shared_ptr<
+                                       arrow::Buffer>>(status);
+      if (fetched.ok()) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++stats_.remote_reads;
+        stats_.bytes_remote += (*fetched)->size();
+      } else {
+        status = fetched.status();
+      }
+      for (auto r = run_start; r <= run_end; ++r) {
+        auto i = missing[r];
+        auto key = BlockKey(file_key, first + i);
+        if (!fetched.ok()) {
+          std::lock_guard<std::mutex> lock(mutex_);
+          Fail(key, status);
+          continue;
+        }
+        auto start = static_cast<int64_t>(r - run_start) * block_size;
+        if (start >= (*fetched)->size()) {
+          status = arrow::Status::IOError("short read of ", file_key);
+          std::lock_guard<std::mutex> lock(mutex_);
+          Fail(key, status);
+          continue;
+        }
+        auto length = std::min(block_size, (*fetched)->size() - start);
+        if (start == 0 && length == (*fetched)->size()) {
+          blocks[i] = *fetched;
+        } else {
+          // its own copy: a slice would keep the whole coalesced read
+          // alive, which memory_capacity doesn't account for
+          auto copy = arrow::AllocateBuffer(length);
+          if (!copy.ok()) {
+            status = copy.status();
+            std::lock_guard<std::mutex> lock(mutex_);
+            Fail(key, status);
+            continue;
+          }
+          std::memcpy((*copy)->mutable_data(), (*fetched)->data() + start,
+                      length);
+          blocks[i] = std::move(*copy);
+        }
+        // the disk is a cache too, a failed write only costs a later miss
+        bool written =
+            !options_.disk_dir.empty() && WriteDisk(key, blocks[i]).ok();
+        std::lock_guard<std::mutex> lock(mutex_);
+        Complete(key, blocks[i], written);
+      }
+      run_start = run_end + 1;
+    }
+    ARROW_RETURN_NOT_OK(status);
+
+    for (auto& wait : waits) {
+      auto waited = wait.second.result();
+      if (!waited.ok()) {
+        if (!retry_failed_waits) return waited.status();
+        auto block = first + wait.first;
+        ARROW_ASSIGN_OR_RAISE(auto again,
+                              GetBlocks(file_key, file_size, block, block,
+                                        fetch, /*retry_failed_waits=*/false));
+        blocks[wait.first] = std::move(again[0]);
+        continue;
+      }
+      blocks[wait.first] = std::move(*waited);
+      std::lock_guard<std::mutex> lock(mutex_);
+      ++stats_.memory_hits;
+      stats_.bytes_saved += blocks[wait.first]->size();
+    }
+    return blocks;
+  }
+
+  static std::string BlockKey(const std::string& file_key, int64_t block) {
+    return file_key + "#" + std::to_string(block);
+  }
+
+  static std::string DiskName(const std::string& key) {
+    std::ostringstream name;
+    name << std::hex << std::setw(16) << std::setfill('0')
+         << std::hash<std::string>()(key) << ".blk";
+    return name.str();
+  }
+
+  std::string DiskPath(const std::string& name) const {
+    return options_.disk_dir + "/" + name;
+  }
+
+  // blocks left on disk by an earlier run, oldest first in the LRU
+  arrow::Status LoadDiskIndex() {
+    if (options_.disk_dir.empty()) return arrow::Status::OK();
+    fs::LocalFileSystem local;
+    ARROW_RETURN_NOT_OK(local.CreateDir(options_.disk_dir));
+    fs::FileSelector selector;
+    selector.base_dir = options_.disk_dir;
+    ARROW_ASSIGN_OR_RAISE(auto infos, local.GetFileInfo(selector));
+    std::sort(infos.begin(), infos.end(),
+              [](const fs::FileInfo& a, const fs::FileInfo& b) {
+                return a.mtime() > b.mtime();
+              });
+    for (const auto& info : infos) {
+      if (!info.IsFile() || info.extension() != "blk") continue;
+      disk_lru_.push_back(info.base_name());
+      disk_.emplace(info.base_name(),
+                    DiskEntry{info.size(), std::prev(disk_lru_.end())});
+      disk_bytes_ += info.size();
+    }
+    EvictDisk();
+    return arrow::Status::OK();
+  }
+
+  // a block file is its key's length and the key followed by the data, so
+  // a hash collision reads as a miss
+  arrow::Result<std::shared_ptr<arrow::Buffer>> ReadDisk(
+      const std::string& key) {
+    ARROW_ASSIGN_OR_RAISE(auto file,
+                          io::ReadableFile::Open(DiskPath(DiskName(key))));
+    ARROW_ASSIGN_OR_RAISE(auto size, file->GetSize());
+    ARROW_ASSIGN_OR_RAISE(auto header, file->ReadAt(0, 4 + key.size()));
+    uint32_t key_length = 0;
+    if (header->size() >= 4) {
+      std::memcpy(&key_length, header->data(), sizeof(key_length));
+    }
+    if (key_length != key.size() || header->size() < 4 + key_length ||
+        key.compare(0, std::string::npos,
+                    reinterpret_cast<const char*>(header->data()) + 4,
+                    key_length) != 0) {
+      return arrow::Status::IOError("block ", key, " not on disk");
+    }
+    // read on its own so the cached buffer is exactly the block
+    return file->ReadAt(4 + key_length, size - 4 - key_length);
+  }
+
+  arrow::Status WriteDisk(const std::string& key,
+                          const std::shared_ptr<arrow::Buffer>& block) {
+    auto path = DiskPath(DiskName(key));
+    ARROW_ASSIGN_OR_RAISE(auto out, io::FileOutputStream::Open(path + ".tmp"));
+    auto key_length = static_cast<uint32_t>(key.size());
+    ARROW_RETURN_NOT_OK(out->Write(&key_length, sizeof(key_length)));
+    ARROW_RETURN_NOT_OK(out->Write(key.data(), key.size()));
+    ARROW_RETURN_NOT_OK(out->Write(block->data(), block->size()));
+    ARROW_RETURN_NOT_OK(out->Close());
+    if (std::rename((path + ".tmp").c_str(), path.c_str()) != 0) {
+      return arrow::Status::IOError("could not write ", path);
+    }
+    return arrow::Status::OK();
+  }
+
+  // the rest are called with mutex_ held
+  void Complete(const std::string& key, std::shared_ptr<arrow::Buffer> block,
+                bool written_to_disk) {
+    auto name = DiskName(key);
+    if (written_to_disk && disk_.count(name) == 0) {
+      auto size = static_cast<int64_t>(block->size() + key.size() + 4);
+      disk_lru_.push_front(name);
+      disk_.emplace(name, DiskEntry{size, disk_lru_.begin()});
+      disk_bytes_ += size;
+      EvictDisk();
+    }
+    if (memory_.count(key) == 0) {
+      memory_lru_.push_front(key);
+      memory_.emplace(key, MemoryEntry{block, memory_lru_.begin()});
+      memory_bytes_ += block->size();
+      EvictMemory();
+    }
+    auto pending = pending_.find(key);
+    if (pending != pending_.end()) {
+      auto future = std::move(pending->second);
+      pending_.erase(pending);
+      future.MarkFinished(std::move(block));
+    }
+  }
+
+  void Fail(const std::string& key, const arrow::Status& status) {
+    auto pending = pending_.find(key);
+    if (pending == pending_.end()) return;
+    auto future = std::move(pending->second);
+    pending_.erase(pending);
+    future.MarkFinished(status);
+  }
+
+  void EvictMemory() {
+    while (memory_bytes_ > options_.memory_capacity && !memory_lru_.empty()) {
+      auto it = memory_.find(memory_lru_.back());
+      memory_bytes_ -= it->second.block->size();
+      memory_.erase(it);
+      memory_lru_.pop_back();
+      ++stats_.evictions;
+    }
+  }
+
+  void EvictDisk() {
+    while (disk_bytes_ > options_.disk_capacity && !disk_lru_.empty()) {
+      auto it = disk_.find(disk_lru_.back());
+      std::remove(DiskPath(it->first).c_str());
+      disk_bytes_ -= it->second.size;
+      disk_.erase(it);
+      disk_lru_.pop_back();
+      ++stats_.evictions;
+    }
+  }
+
+  const BlockCacheOptions options_;
+  mutable std::mutex mutex_;
+  std::unordered_map<std::string, MemoryEntry> memory_;
+  std::list<std::string> memory_lru_;
+  int64_t memory_bytes_ = 0;
+  std::unordered_map<std::string, DiskEntry> disk_;
+  std::list<std::string> disk_lru_;
+  int64_t disk_bytes_ = 0;
+  std::unordered_map<std::string, BlockFuture> pending_;
+  BlockCacheStats stats_;
+};
+
+// A random access file served from the block cache. Reads are thread safe
+// like the base file's; Read/Seek share one position as usual.
+class CachedFile : public io::RandomAccessFile {
+ public:
+  CachedFile(std::shared_ptr<io::RandomAccessFile> base, std::string file_key,
+             int64_t size, std::shared_ptr<BlockCache> cache)
+      : source_(std::make_shared<Source>(Source{
+            std::move(base), std::move(file_key), size, std::move(cache)})) {}
+
+  arrow::Status Close() override {
+    closed_ = true;
+    return source_->base->Close();
+  }
+  bool closed() const override { return closed_; }
+  arrow::Result<int64_t> Tell() const override { return position_; }
+  arrow::Status Seek(int64_t position) override {
+    position_ = position;
+    return arrow::Status::OK();
+  }
+  arrow::Result<int64_t> GetSize() override { return source_->size; }
+
+  arrow::Result<int64_t> Read(int64_t nbytes, void* out) override {
+    ARROW_ASSIGN_OR_RAISE(auto read, ReadAt(position_, nbytes, out));
+    position_ += read;
+    return read;
+  }
+
+  arrow::Result<std::shared_ptr<arrow::Buffer>> Read(int64_t nbytes) override {
+    ARROW_ASSIGN_OR_RAISE(auto buffer, ReadAt(position_, nbytes));
+    position_ += buffer->size();
+    return buffer;
+  }
+
+  arrow::Result<int64_t> ReadAt(int64_t position, int64_t nbytes,
+                                void* out) override {
+    ARROW_ASSIGN_OR_RAISE(auto buffer, ReadAt(position, nbytes));
+    std::memcpy(out, buffer->data(), buffer->size());
+    return buffer->size();
+  }
+
+  arrow::Result<std::shared_ptr<arrow::Buffer>> ReadAt(
+      int64_t position, int64_t nbytes) override {
+    if (closed_) return arrow::Status::Invalid("file is closed");
+    nbytes = std::max<int64_t>(0, std::min(nbytes, source_->size - position));
+    if (nbytes == 0) return std::make_shared<arrow::Buffer>(nullptr, 0);
+    const auto block_size = source_->cache->options().block_size;
+    auto first = position / block_size;
+    auto last = (position + nbytes - 1) / block_size;
+    ARROW_ASSIGN_OR_RAISE(auto blocks, source_->Fetch(first, last));
+
+    auto offset = position - first * block_size;
+    if (blocks.size() == 1) {
+      return arrow::SliceBuffer(blocks[0], offset, nbytes);
+    }
+    ARROW_ASSIGN_OR_RAISE(auto out, arrow::AllocateBuffer(nbytes));
+    int64_t copied = 0;
+    for (const auto& block : blocks) {
+      auto length = std::min(block->size() - offset, nbytes - copied);
+      std::memcpy(out->mutable_data() + copied, block->data() + offset, length);
+      copied += length;
+      offset = 0;
+    }
+    return std::shared_ptr<arrow::Buffer>(std::move(out));
+  }
+
+  // Prefetches the blocks of the given ranges in the background, one fetch
+  // per run of overlapping or adjacent blocks.
+  arrow::Status WillNeed(const std::vector<io::ReadRange>& ranges) override {
+    const auto block_size = source_->cache->options().block_size;
+    std::vector<std::pair<int64_t, int64_t>> runs;
+    for (const auto& range : ranges) {
+      if (range.length <= 0 || range.offset >= source_->size) continue;
+      auto end = std::min(range.offset + range.length, source_->size);
+      runs.emplace_back(range.offset / block_size, (end - 1) / block_size);
+    }
+    std::sort(runs.begin(), runs.end());
+    std::vector<std::pair<int64_t, int64_t>> merged;
+    for (const auto& run : runs) {
+      if (!merged.empty() && run.first <= merged.back().second + 1) {
+        merged.back().second = std::max(merged.back().second, run.second);
+      } else {
+        merged.push_back(run);
+      }
+    }
+    auto executor = io::default_io_context().executor();
+    for (const auto& run : merged) {
+      ARROW_RETURN_NOT_OK(executor->Spawn([source = source_, run] {
+        // a failed prefetch is retried by the read that needs it
+        auto ignored = source->Fetch(run.first, run.second);
+      }));
+    }
+    return arrow::Status::OK();
+  }
+
+ private:
+  // shared with prefetches, which may outlive the file
+  struct Source {
+    std::shared_ptr<io::RandomAccessFile> base;
+    std::string file_key;
+    int64_t size;
+    std::shared_ptr<BlockCache> cache;
+
+    arrow::Result<std::vector<std::shared_ptr<arrow::Buffer>>> Fetch(
+        int64_t first, int64_t last) {
+      return cache->GetBlocks(file_key, size, first, last,
+                              [this](int64_t offset, int64_t length) {
+                                return base->ReadAt(offset, length);
+                              });
+    }
+  };
+
+  std::shared_ptr<Source> source_;
+  std::atomic<bool> closed_{false};
+  int64_t position_ = 0;
+};
+
+// Wraps any FileSystem; only random access reads go through the cache,
+// everything else is passed straight to the base filesystem.
+class CachingFileSystem : public fs::FileSystem {
+ public:
+  CachingFileSystem(std::shared_ptr<fs::FileSystem> base,
+                    std::shared_ptr<BlockCache> cache)
+      : fs::FileSystem(base->io_context()),
+        base_(std::move(base)),
+        cache_(std::move(cache)) {}
+
+  using fs::FileSystem::GetFileInfo;
+  using fs::FileSystem::OpenInputFile;
+  using fs::FileSystem::OpenInputStream;
+  using fs::FileSystem::OpenOutputStream;
+  using fs::FileSystem::OpenAppendStream;
+
+  const std::shared_ptr<fs::FileSystem>& base() const { return base_; }
+  const std::shared_ptr<BlockCache>& cache() const { return cache_; }
+
+  std::string type_name() const override { return "blockcache"; }
+
+  bool Equals(const fs::FileSystem& other) const override {
+    if (other.type_name() != type_name()) return false;
+    const auto& caching = static_cast<const CachingFileSystem&>(other);
+    return cache_ == caching.cache_ && base_->Equals(*caching.base_);
+  }
+
+  arrow::Result<fs::FileInfo> GetFileInfo(const std::string& path) override {
+    return base_->GetFileInfo(path);
+  }
+  arrow::Result<fs::FileInfoVector> GetFileInfo(
+      const fs::FileSelector& select) override {
+    return base_->GetFileInfo(select);
+  }
+  arrow::Status CreateDir(const std::string& path, bool recursive) override {
+    return base_->CreateDir(path, recursive);
+  }
+  arrow::Status DeleteDir(const std::string& path) override {
+    return base_->DeleteDir(path);
+  }
+  arrow::Status DeleteDirContents(const std::string& path) override {
+    return base_->DeleteDirContents(path);
+  }
+  arrow::Status DeleteRootDirContents() override {
+    return base_->DeleteRootDirContents();
+  }
+  arrow::Status DeleteFile(const std::string& path) override {
+    return base_->DeleteFile(path);
+  }
+  arrow::Status Move(const std::string& src, const std::string& dest) override {
+    return base_->Move(src, dest);
+  }
+  arrow::Status CopyFile(const std::string& src,
+                         const std::string& dest) override {
+    return base_->CopyFile(src, dest);
+  }
+
+  arrow::Result<std::shared_ptr<io::InputStream>> OpenInputStream(
+      const std::string& path) override {
+    return base_->OpenInputStream(path);
+  }
+
+  arrow::Result<std::shared_ptr<io::RandomAccessFile>> OpenInputFile(
+      const std::string& path) override {
+    ARROW_ASSIGN_OR_RAISE(auto info, base_->GetFileInfo(path));
+    return OpenInputFile(info);
+  }
+
+  arrow::Result<std::shared_ptr<io::RandomAccessFile>> OpenInputFile(
+      const fs::FileInfo& info) override {
+    if (info.size() < 0) return OpenInputFile(info.path());
+    ARROW_ASSIGN_OR_RAISE(auto file, base_->OpenInputFile(info));
+    auto file_key = info.path() + "#" + std::to_string(info.size()) + "#" +
+                    std::to_string(info.mtime().time_since_epoch().count());
+    auto cached = std::make_shared<CachedFile>(std::move(file), file_key,
+                                               info.size(), cache_);
+    // Parquet and friends start with the footer
+    auto footer = cache_->options().footer_prefetch;
+    if (footer > 0) {
+      auto offset = std::max<int64_t>(0, info.size() - footer);
+      ARROW_RETURN_NOT_OK(cached->WillNeed({{offset, info.size() - offset}}));
+    }
+    return cached;
+  }
+
+  arrow::Result<std::shared_ptr<io::OutputStream>> OpenOutputStream(
+      const std::string& path,
+      const std::shared_ptr<const arrow::KeyValueMetadata>& metadata)
+      override {
+    return base_->OpenOutputStream(path, metadata);
+  }
+
+  arrow::Result<std::shared_ptr<io::OutputStream>> OpenAppendStream(
+      const std::string& path,
+      const std::shared_ptr<const arrow::KeyValueMetadata>& metadata)
+      override {
+    return base_->OpenAppendStream(path, metadata);
+  }
+
+ private:
+  std::shared_ptr<fs::FileSystem> base_;
+  std::shared_ptr<BlockCache> cache_;
+};
+
+}  // namespace blockcache
@@ -23,6 +23,11 @@
 # SOFTWARE.
 
 g++ datasets_api.cc -O3 -o datasets_api `pkg-config --cflags --libs parquet arrow-dataset`
-g++ s3_datasets.cc -O3 -o s3_dataset `pkg-config --cflags --libs parquet arrow-dataset`
-g++ streaming_engine.cc -O3 -o streaming_engine `pkg-config --cflags --libs parquet arrow-dataset`
-g++ write_partitioned.cc -O3 -o write_partitioned `pkg-config --cflags --libs parquet arrow-dataset`
+g++ s3_datasets.cc -O3 -I../../utils/cpp -o s3_dataset `pkg-config --cflags --libs parquet arrow-dataset`
+g++ streaming_engine.cc -O3 -I../../utils/cpp -o streaming_engine `pkg-config --cflags --libs parquet arrow-dataset`
+g++ write_partitioned.cc -O3 -I../../utils/cpp -o write_partitioned `pkg-config --cflags --libs parquet arrow-dataset`
+g++ dataset_manifest.cc -O3 -o dataset_manifest `pkg-config --cflags --libs parquet arrow-dataset`
+g++ block_cache_fs.cc -O3 -o block_cache_fs `pkg-config --cflags --libs parquet arrow-dataset`
+g++ reducer_bench.cc -O3 -I../../utils/cpp -o reducer_bench `pkg-config --cflags --libs parquet arrow-dataset`
+g++ generate_taxi.cc -O3 -I../../utils/cpp -o generate_taxi `pkg-config --cflags --libs parquet arrow-dataset`
+g++ arena_pool_bench.cc -O3 -I../../utils/cpp -o arena_pool_bench `pkg-config --cflags --libs parquet arrow-dataset`
@@ -0,0 +1,249 @@
+// MIT License
+//
+// Copyright (c) 2021 Packt
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <arrow/api.h>
+#include <arrow/compute/api.h>
+#include <arrow/compute/exec/expression.h>
+#include <arrow/dataset/api.h>
+#include <arrow/filesystem/api.h>
+#include <arrow/util/checked_cast.h>
+#include <arrow/util/config.h>
+#include <parquet/arrow/writer.h>
+#include <parquet/metadata.h>
+#include <parquet/properties.h>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// Writes a table as Parquet files whose row groups cover narrow, mostly
+// disjoint ranges of the clustering keys, so a selective filter on them is
+// answered from a few row groups and the rest are pruned by the footer
+// statistics. Rows are either sorted by the keys lexicographically, which
+// is best when filters are on the first key, or laid out along a Z-order
+// curve over the keys' ranks, which keeps every key reasonably clustered.
+//
+// The page index (per page min/max and offsets) is written too when the
+// Arrow version has it (12 and up), letting readers skip pages inside the
+// row groups that survive.
+namespace clustered {
+
+namespace ds = arrow::dataset;
+namespace fs = arrow::fs;
+namespace cp = arrow::compute;
+
+enum class Layout { kSorted, kZOrder };
+
+struct WriteOptions {
+  std::vector<std::string> keys;
+  Layout layout = Layout::kSorted;
+  int64_t rows_per_row_group = 1 << 20;
+  int64_t rows_per_file = 1 << 24;
+  int64_t data_page_bytes = 1 << 20;
+  bool page_index = true;
+  arrow::Compression::type compression = arrow::Compression::ZSTD;
+  std::string basename_template = "part-{i}.parquet";
+};
+
+namespace detail {
+
+// rank of every row by one key, nulls last
+inline arrow::Result<std::vector<uint64_t>> Ranks(
+    const std::shared_ptr<arrow::Table>& table, const std::string& key) {
+  ARROW_ASSIGN_OR_RAISE(
+      auto indices,
+      cp::SortIndices(arrow::Datum(table),
+                      cp::SortOptions({cp::SortKey(key)})));
+  const auto* sorted = indices->data()->GetValues<uint64_t>(1);
+  std::vector<uint64_t> ranks(table->num_rows());
+  for (int64_t i = 0; i < table->num_rows(); ++i) ranks[sorted[i]] = i;
+  return ranks;
+}
+
+// Morton code of each row: the top bits of every key's rank, interleaved
+inline arrow::Result<std::shared_ptr<arrow::Array>> ZValues(
+    const std::shared_ptr<arrow::Table>& table,
+    const std::vector<std::string>& keys) {
+  const int bits = static_cast<int>(64 / keys.size());
+  const auto n = static_cast<uint64_t>(std::max<int64_t>(table->num_rows(), 1));
+  std::vector<std::vector<uint64_t>> ranks;
+  for (const auto& key : keys) {
+    ARROW_ASSIGN_OR_RAISE(auto key_ranks, Ranks(table, key));
+    // scale ranks to [0, 2^bits) so every key gets the same resolution
+    for (auto& rank : key_ranks) {
+      rank = static_cast<uint64_t>(
+          std::ldexp(static_cast<long double>(rank) / n, bits));
+    }
+    ranks.push_back(std::move(key_ranks));
+  }
+
+  arrow::UInt64Builder builder;
+  ARROW_RETURN_NOT_OK(builder.Reserve(table->num_rows()));
+  for (int64_t row = 0; row < table->num_rows(); ++row) {
+    uint64_t z = 0;
+    for (int bit = bits - 1; bit >= 0; --bit) {
+      for (const auto& key_ranks : ranks) {
+        z = (z << 1) | ((key_ranks[row] >> bit) & 1);
+      }
+    }
+    builder.UnsafeAppend(z);
+  }
+  return builder.Finish();
+}
+
+inline arrow::Result<std::shared_ptr<arrow::Table>> Cluster(
+    const std::shared_ptr<arrow::Table>& table, const WriteOptions& options) {
+  std::shared_ptr<arrow::Array> indices;
+  if (options.layout == Layout::kSorted || options.keys.size() == 1) {
+    std::vector<cp::SortKey> sort_keys;
+    for (const auto& key : options.keys) sort_keys.emplace_back(key);
+    ARROW_ASSIGN_OR_RAISE(indices,
+                          cp::SortIndices(arrow::Datum(table),
+                                          cp::SortOptions(sort_keys)));
+  } else {
+    ARROW_ASSIGN_OR_RAISE(auto z, ZValues(table, options.keys));
+    ARROW_ASSIGN_OR_RAISE(indices, cp::SortIndices(*z));
+  }
+  ARROW_ASSIGN_OR_RAISE(auto sorted, cp::Take(table, indices));
+  return sorted.table();
+}
+
+}  // namespace detail
+
+// Clusters the table and writes it under base_dir, rows_per_file rows to a
+// file and rows_per_row_group to a row group. Returns the written paths.
+inline arrow::Result<std::vector<std::string>> WriteClustered(
+    const std::shared_ptr<arrow::Table>& table,
+    const std::shared_ptr<fs::FileSystem>& filesystem,
+    const std::string& base_dir, const WriteOptions& options) {
+  if (options.keys.empty()) {
+    return arrow::Status::Invalid("no clustering keys given");
+  }
+  if (options.keys.size() > 64) {
+    return arrow::Status::Invalid("at most 64 clustering keys");
+  }
+  for (const auto& key : options.keys) {
+    ARROW_RETURN_NOT_OK(arrow::FieldRef(key).FindOne(*table->schema()));
+  }
+  ARROW_ASSIGN_OR_RAISE(auto sorted, detail::Cluster(table, options));
+
+  parquet::WriterProperties::Builder properties;
+  properties.compression(options.compression)
+      ->data_pagesize(options.data_page_bytes)
+      ->enable_statistics();
+#if ARROW_VERSION_MAJOR >= 12
+  if (options.page_index) properties.enable_write_page_index();
+#endif
+  auto writer_properties = properties.build();
+
+  ARROW_RETURN_NOT_OK(filesystem->CreateDir(base_dir));
+  std::vector<std::string> paths;
+  for (int64_t offset = 0; offset < sorted->num_rows();
+       offset += options.rows_per_file) {
+    auto basename = options.basename_template;
+    auto placeholder = basename.find("{i}");
+    if (placeholder != std::string::npos) {
+      basename.replace(placeholder, 3, std::to_string(paths.size()));
+    }
+    auto path = base_dir + "/" + basename;
+    ARROW_ASSIGN_OR_RAISE(auto output, filesystem->OpenOutputStream(path));
+    ARROW_RETURN_NOT_OK(parquet::arrow::WriteTable(
+        *sorted->Slice(offset, options.rows_per_file),
+        arrow::default_memory_pool(), output, options.rows_per_row_group,
+        writer_properties));
+    ARROW_RETURN_NOT_OK(output->Close());
+    paths.push_back(std::move(path));
+  }
+  return paths;
+}
+
+struct PruningReport {
+  int64_t row_groups = 0;
+  int64_t row_groups_skipped = 0;
+  int64_t bytes = 0;  // compressed bytes of the projected columns
+  int64_t bytes_skipped = 0;
+
+  void Print(std::ostream& os = std::cout) const {
+    os << row_groups_skipped << " of " << row_groups
+       << " row groups skipped, " << bytes - bytes_skipped << " of " << bytes
+       << " bytes read" << std::endl;
+  }
+};
+
+// What a Parquet scan with this filter and projection will skip: the row
+// groups whose statistics rule the filter out, the same test the scanner
+// itself applies, and their column chunk bytes.
+inline arrow::Result<PruningReport> ExplainPruning(
+    const std::shared_ptr<ds::Dataset>& dataset, const cp::Expression& filter,
+    const std::vector<std::string>& columns) {
+  ARROW_ASSIGN_OR_RAISE(auto bound, filter.Bind(*dataset->schema()));
+  std::unordered_set<std::string> projected(columns.begin(), columns.end());
+  for (const auto& ref : cp::FieldsInExpression(bound)) {
+    if (ref.name()) projected.insert(*ref.name());
+  }
+
+  PruningReport report;
+  ARROW_ASSIGN_OR_RAISE(auto fragments, dataset->GetFragments());
+  for (auto maybe_fragment : fragments) {
+    ARROW_ASSIGN_OR_RAISE(auto fragment, maybe_fragment);
+    auto parquet_fragment =
+        std::dynamic_pointer_cast<ds::ParquetFileFragment>(fragment);
+    if (!parquet_fragment) continue;
+    ARROW_RETURN_NOT_OK(parquet_fragment->EnsureCompleteMetadata());
+    auto metadata = parquet_fragment->metadata();
+    // the surviving row groups, a fragment each
+    ARROW_ASSIGN_OR_RAISE(auto kept, parquet_fragment->SplitByRowGroup(bound));
+    std::unordered_set<int> kept_ids;
+    for (const auto& piece : kept) {
+      const auto& ids =
+          arrow::internal::checked_cast<const ds::ParquetFileFragment&>(*piece)
+              .row_groups();
+      kept_ids.insert(ids.begin(), ids.end());
+    }
+
+    for (int rg = 0; rg < metadata->num_row_groups(); ++rg) {
+      auto row_group = metadata->RowGroup(rg);
+      int64_t bytes = 0;
+      for (int c = 0; c < row_group->num_columns(); ++c) {
+        auto chunk = row_group->ColumnChunk(c);
+        // top level name, nested columns count towards their parent
+        auto name = chunk->path_in_schema()->ToDotVector().front();
+        if (projected.count(name)) bytes += chunk->total_compressed_size();
+      }
+      ++report.row_groups;
+      report.bytes += bytes;
+      if (kept_ids.count(rg) == 0) {
+        ++report.row_groups_skipped;
+        report.bytes_skipped += bytes;
+      }
+    }
+  }
+  return report;
+}
+
+}  // namespace clustered
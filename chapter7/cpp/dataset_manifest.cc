@@ -0,0 +1,185 @@
+// MIT License
+//
+// Copyright (c) 2021 Packt
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <arrow/api.h>
+#include <arrow/dataset/api.h>
+#include <arrow/filesystem/api.h>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include "dataset_manifest.h"
+#include "timer.h"
+
+namespace fs = arrow::fs;
+namespace ds = arrow::dataset;
+namespace cp = arrow::compute;
+
+// Discovery against a local dataset behind SlowFileSystem, which adds a
+// random latency around this average to every call, standing in for S3.
+constexpr auto base_dir = "/tmp/manifest_sample";
+constexpr auto manifest_path = "/tmp/manifest_sample.arrow";
+constexpr double average_latency = 0.02;
+
+std::shared_ptr<ds::Partitioning> year_month() {
+  return std::make_shared<ds::DirectoryPartitioning>(
+      arrow::schema({arrow::field("year", arrow::int32()),
+                     arrow::field("month", arrow::int32())}));
+}
+
+arrow::Status write_sample(const std::shared_ptr<fs::FileSystem>& filesystem,
+                           int first_year, int last_year) {
+  arrow::Int32Builder years, months;
+  arrow::Int64Builder passengers;
+  for (int year = first_year; year <= last_year; ++year) {
+    for (int month = 1; month <= 12; ++month) {
+      for (int i = 0; i < 1000; ++i) {
+        ARROW_RETURN_NOT_OK(years.Append(year));
+        ARROW_RETURN_NOT_OK(months.Append(month));
+        ARROW_RETURN_NOT_OK(passengers.Append(1 + (i + month) % 6));
+      }
+    }
+  }
+  std::shared_ptr<arrow::Array> year_arr, month_arr, passenger_arr;
+  ARROW_RETURN_NOT_OK(years.Finish(&year_arr));
+  ARROW_RETURN_NOT_OK(months.Finish(&month_arr));
+  ARROW_RETURN_NOT_OK(passengers.Finish(&passenger_arr));
+  auto table =
+      arrow::Table::Make(arrow::schema({arrow::field("year", arrow::int32()),
+                                        arrow::field("month", arrow::int32()),
+                                        arrow::field("passenger_count",
+                                                     arrow::int64())}),
+                         {year_arr, month_arr, passenger_arr});
+
+  auto dataset = std::make_shared<ds::InMemoryDataset>(table);
+  ARROW_ASSIGN_OR_RAISE(auto scan_builder, dataset->NewScan());
+  ARROW_ASSIGN_OR_RAISE(auto scanner, scan_builder->Finish());
+
+  auto format = std::make_shared<ds::ParquetFileFormat>();
+  ds::FileSystemDatasetWriteOptions write_opts;
+  write_opts.file_write_options = format->DefaultWriteOptions();
+  write_opts.filesystem = filesystem;
+  write_opts.base_dir = base_dir;
+  write_opts.partitioning = year_month();
+  write_opts.basename_template = "part{i}.parquet";
+  write_opts.existing_data_behavior =
+      ds::ExistingDataBehavior::kDeleteMatchingPartitions;
+  return ds::FileSystemDataset::Write(write_opts, scanner);
+}
+
+arrow::Result<int64_t> count_rows(const std::shared_ptr<ds::Dataset>& dataset) {
+  ARROW_ASSIGN_OR_RAISE(auto scan_builder, dataset->NewScan());
+  ARROW_ASSIGN_OR_RAISE(auto scanner, scan_builder->Finish());
+  return scanner->CountRows();
+}
+
+arrow::Status run() {
+  std::shared_ptr<fs::FileSystem> local =
+      std::make_shared<fs::LocalFileSystem>();
+  std::shared_ptr<fs::FileSystem> slow =
+      std::make_shared<fs::SlowFileSystem>(local, average_latency, 42);
+  auto format = std::make_shared<ds::ParquetFileFormat>();
+  ARROW_RETURN_NOT_OK(write_sample(local, 2015, 2017));
+
+  std::shared_ptr<ds::Dataset> discovered;
+  {
+    std::cout << "discovery: ";
+    timer t;
+    fs::FileSelector selector;
+    selector.base_dir = base_dir;
+    selector.recursive = true;
+    ds::FileSystemFactoryOptions options;
+    options.partitioning = year_month();
+    ARROW_ASSIGN_OR_RAISE(auto factory, ds::FileSystemDatasetFactory::Make(
+                                            slow, selector, format, options));
+    ds::FinishOptions finopts;
+    finopts.inspect_options.fragments =
+        ds::InspectOptions::kInspectAllFragments;
+    ARROW_ASSIGN_OR_RAISE(discovered, factory->Finish(finopts));
+  }
+
+  manifest::DatasetManifest sample;
+  {
+    std::cout << "build manifest: ";
+    timer t;
+    ARROW_ASSIGN_OR_RAISE(
+        sample, manifest::BuildManifest(slow, base_dir, year_month()));
+    ARROW_RETURN_NOT_OK(manifest::SaveManifest(sample, manifest_path));
+  }
+
+  std::shared_ptr<ds::Dataset> loaded;
+  {
+    std::cout << "load manifest: ";
+    timer t;
+    ARROW_ASSIGN_OR_RAISE(sample, manifest::LoadManifest(manifest_path));
+    ARROW_ASSIGN_OR_RAISE(loaded, manifest::MakeDataset(sample, slow, format));
+  }
+  ARROW_ASSIGN_OR_RAISE(auto discovered_rows, count_rows(discovered));
+  ARROW_ASSIGN_OR_RAISE(auto loaded_rows, count_rows(loaded));
+  std::cout << sample.entries.size() << " files, " << discovered_rows
+            << " rows discovered, " << loaded_rows << " rows from manifest"
+            << std::endl;
+  std::cout << loaded->schema()->ToString() << std::endl;
+
+  // 2017 is rewritten, which revalidation finds by listing the partition
+  // directories it already knows
+  ARROW_RETURN_NOT_OK(write_sample(local, 2017, 2018));
+  manifest::RevalidateStats stats;
+  {
+    std::cout << "revalidate: ";
+    timer t;
+    ARROW_RETURN_NOT_OK(manifest::RevalidateManifest(
+        &sample, slow, std::chrono::nanoseconds(0), &stats));
+  }
+  std::cout << stats.dirs_listed << " dirs listed, " << stats.unchanged
+            << " unchanged, " << stats.changed << " changed, " << stats.added
+            << " added, " << stats.removed << " removed" << std::endl;
+
+  // 2018 is a new partition directory, so only a rebuild finds it
+  {
+    std::cout << "open (rebuild): ";
+    timer t;
+    std::remove(manifest_path);
+    ARROW_ASSIGN_OR_RAISE(loaded,
+                          manifest::OpenDataset(slow, base_dir, year_month(),
+                                                format, manifest_path));
+  }
+  ARROW_ASSIGN_OR_RAISE(loaded_rows, count_rows(loaded));
+  std::cout << loaded_rows << " rows after the rebuild" << std::endl;
+  {
+    std::cout << "open (cached): ";
+    timer t;
+    ARROW_ASSIGN_OR_RAISE(loaded,
+                          manifest::OpenDataset(slow, base_dir, year_month(),
+                                                format, manifest_path));
+  }
+  return arrow::Status::OK();
+}
+
+int main(int argc, char** argv) {
+  auto status = run();
+  if (!status.ok()) {
+    std::cerr << status.ToString() << std::endl;
+    return 1;
+  }
+}
@@ -0,0 +1,522 @@
+// MIT License
+//
+// Copyright (c) 2021 Packt
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <arrow/api.h>
+#include <arrow/compute/exec/expression.h>
+#include <arrow/dataset/api.h>
+#include <arrow/filesystem/api.h>
+#include <arrow/io/api.h>
+#include <arrow/ipc/api.h>
+#include <arrow/util/base64.h>
+#include <arrow/util/future.h>
+#include <arrow/util/thread_pool.h>
+#include <parquet/arrow/reader.h>
+#include <parquet/arrow/schema.h>
+#include <parquet/exception.h>
+#include <parquet/file_reader.h>
+#include <parquet/metadata.h>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// A dataset manifest: everything FileSystemDatasetFactory finds out by
+// listing a bucket and opening its files, kept in a local Arrow IPC file.
+// The file list with sizes and mtimes, each file's partition expression and
+// Parquet footer and the unified schema are enough to rebuild the dataset
+// without touching the filesystem; the footers are handed to the fragments
+// so scans don't fetch them again and row groups are pruned by statistics
+// up front.
+//
+// Entries older than a max age are revalidated by listing only the
+// directories they live in, which also picks up new files in existing
+// partitions. A new partition directory needs a full BuildManifest.
+
+namespace manifest {
+
+namespace fs = arrow::fs;
+namespace ds = arrow::dataset;
+namespace cp = arrow::compute;
+
+struct Entry {
+  std::string path;
+  int64_t size = 0;
+  int64_t mtime_ns = 0;
+  int64_t validated_ns = 0;  // when it was last checked against the fs
+  cp::Expression partition = cp::literal(true);
+  std::shared_ptr<parquet::FileMetaData> footer;
+};
+
+struct DatasetManifest {
+  std::string base_dir;
+  std::shared_ptr<ds::Partitioning> partitioning;
+  std::shared_ptr<arrow::Schema> schema;  // physical fields + partition fields
+  std::vector<Entry> entries;
+};
+
+struct RevalidateStats {
+  int dirs_listed = 0;
+  int unchanged = 0;
+  int added = 0;
+  int changed = 0;
+  int removed = 0;
+
+  bool modified() const { return added + changed + removed > 0; }
+};
+
+namespace detail {
+
+inline int64_t NowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+inline int64_t MtimeNs(const fs::FileInfo& info) {
+  return info.mtime().time_since_epoch().count();
+}
+
+// FileSystemDatasetFactory skips these by default as well
+inline bool Ignored(const std::string& path) {
+  auto name = path.substr(path.find_last_of('/') + 1);
+  return name.empty() || name[0] == '.' || name[0] == '_';
+}
+
+inline std::string ParentDir(const std::string& path) {
+  auto slash = path.find_last_of('/');
+  return slash == std::string::npos ? "" : path.substr(0, slash);
+}
+
+inline arrow::Result<cp::Expression> ParsePartition(
+    const DatasetManifest& manifest, const std::string& path) {
+  auto dir = ParentDir(path);
+  if (dir.compare(0, manifest.base_dir.size(), manifest.base_dir) == 0) {
+    dir = dir.substr(manifest.base_dir.size());
+  }
+  if (!dir.empty() && dir[0] == '/') dir = dir.substr(1);
+  return manifest.partitioning->Parse(dir);
+}
+
+inline arrow::Result<std::shared_ptr<parquet::FileMetaData>> ReadFooter(
+    const std::shared_ptr<fs::FileSystem>& filesystem,
+    const fs::FileInfo& info) {
+  ARROW_ASSIGN_OR_RAISE(auto file, filesystem->OpenInputFile(info));
+  std::shared_ptr<parquet::FileMetaData> footer;
+  BEGIN_PARQUET_CATCH_EXCEPTIONS
+  footer = parquet::ReadMetaData(file);
+  END_PARQUET_CATCH_EXCEPTIONS
+  return footer;
+}
+
+// footers for many files at once, on the IO thread pool since it's all
+// waiting on the filesystem
+inline arrow::Result<std::vector<Entry>> ReadEntries(
+    const DatasetManifest& manifest,
+    const std::shared_ptr<fs::FileSystem>& filesystem,
+    const std::vector<fs::FileInfo>& infos) {
+  auto executor = arrow::io::default_io_context().executor();
+  std::vector<arrow::Future<std::shared_ptr<parquet::FileMetaData>>> futures;
+  for (const auto& info : infos) {
+    ARROW_ASSIGN_OR_RAISE(auto future, executor->Submit([filesystem, info] {
+      return ReadFooter(filesystem, info);
+    }));
+    futures.push_back(std::move(future));
+  }
+  auto now = NowNs();
+  std::vector<Entry> entries(infos.size());
+  for (size_t i = 0; i < infos.size(); ++i) {
+    auto& entry = entries[i];
+    entry.path = infos[i].path();
+    entry.size = infos[i].size();
+    entry.mtime_ns = MtimeNs(infos[i]);
+    entry.validated_ns = now;
+    ARROW_ASSIGN_OR_RAISE(entry.partition,
+                          ParsePartition(manifest, entry.path));
+    ARROW_ASSIGN_OR_RAISE(entry.footer, futures[i].result());
+  }
+  return entries;
+}
+
+inline arrow::Result<std::shared_ptr<arrow::Schema>> FooterSchema(
+    const parquet::FileMetaData& footer) {
+  std::shared_ptr<arrow::Schema> schema;
+  ARROW_RETURN_NOT_OK(parquet::arrow::FromParquetSchema(
+      footer.schema(), parquet::ArrowReaderProperties(),
+      footer.key_value_metadata(), &schema));
+  return schema;
+}
+
+// unified over every footer rather than the first fragment only, which is
+// what inspecting all fragments would cost on the remote filesystem
+inline arrow::Status UnifySchema(DatasetManifest* manifest) {
+  std::vector<std::shared_ptr<arrow::Schema>> schemas;
+  for (const auto& entry : manifest->entries) {
+    ARROW_ASSIGN_OR_RAISE(auto schema, FooterSchema(*entry.footer));
+    bool seen = false;
+    for (const auto& other : schemas) seen = seen || other->Equals(*schema);
+    if (!seen) schemas.push_back(std::move(schema));
+  }
+  schemas.push_back(manifest->partitioning->schema());
+  ARROW_ASSIGN_OR_RAISE(manifest->schema, arrow::UnifySchemas(schemas));
+  return arrow::Status::OK();
+}
+
+inline arrow::Result<std::string> EncodeSchema(const arrow::Schema& schema) {
+  ARROW_ASSIGN_OR_RAISE(auto buffer, arrow::ipc::SerializeSchema(schema));
+  return arrow::util::base64_encode(arrow::util::string_view(*buffer));
+}
+
+inline arrow::Result<std::shared_ptr<arrow::Schema>> DecodeSchema(
+    const std::string& encoded) {
+  arrow::io::BufferReader reader(
+      arrow::Buffer::FromString(arrow::util::base64_decode(encoded)));
+  arrow::ipc::DictionaryMemo memo;
+  return arrow::ipc::ReadSchema(&reader, &memo);
+}
+
+inline std::shared_ptr<arrow::Schema> ManifestSchema(
+    std::shared_ptr<const arrow::KeyValueMetadata> metadata = nullptr) {
+  return arrow::schema({arrow::field("path", arrow::utf8()),
+                        arrow::field("size", arrow::int64()),
+                        arrow::field("mtime_ns", arrow::int64()),
+                        arrow::field("validated_ns", arrow::int64()),
+                        arrow::field("partition", arrow::binary()),
+                        arrow::field("footer", arrow::binary())},
+                       std::move(metadata));
+}
+
+}  // namespace detail
+
+// Lists base_dir recursively and reads every footer, the same work as
+// dataset discovery with kInspectAllFragments.
+inline arrow::Result<DatasetManifest> BuildManifest(
+    const std::shared_ptr<fs::FileSystem>& filesystem,
+    const std::string& base_dir,
+    std::shared_ptr<ds::Partitioning> partitioning) {
+  DatasetManifest manifest;
+  manifest.base_dir = base_dir;
+  manifest.partitioning = std::move(partitioning);
+
+  fs::FileSelector selector;
+  selector.base_dir = base_dir;
+  selector.recursive = true;
+  ARROW_ASSIGN_OR_RAISE(auto listing, filesystem->GetFileInfo(selector));
+  std::vector<fs::FileInfo> files;
+  for (auto& info : listing) {
+    if (info.IsFile() && !detail::Ignored(info.path())) {
+      files.push_back(std::move(info));
+    }
+  }
+  ARROW_ASSIGN_OR_RAISE(manifest.entries,
+                        detail::ReadEntries(manifest, filesystem, files));
+  ARROW_RETURN_NOT_OK(detail::UnifySchema(&manifest));
+  return manifest;
+}
+
+// Rechecks entries validated more than max_age ago: one non-recursive
+// listing per directory they live in instead of one request per file.
+// Changed and new files have their footers read again.
+inline arrow::Status RevalidateManifest(
+    DatasetManifest* manifest,
+    const std::shared_ptr<fs::FileSystem>& filesystem,
+    std::chrono::nanoseconds max_age, RevalidateStats* stats) {
+  auto now = detail::NowNs();
+  std::vector<std::string> dirs;
+  std::unordered_set<std::string> seen_dirs;
+  for (const auto& entry : manifest->entries) {
+    if (now - entry.validated_ns < max_age.count()) continue;
+    auto dir = detail::ParentDir(entry.path);
+    if (seen_dirs.insert(dir).second) dirs.push_back(std::move(dir));
+  }
+  if (dirs.empty()) return arrow::Status::OK();
+
+  auto executor = arrow::io::default_io_context().executor();
+  std::vector<arrow::Future<std::vector<fs::FileInfo>>> listings;
+  for (const auto& dir : dirs) {
+    fs::FileSelector selector;
+    selector.base_dir = dir;
+    selector.allow_not_found = true;  // the whole partition may be gone
+    ARROW_ASSIGN_OR_RAISE(auto listing, executor->Submit([filesystem,
+                                                          selector] {
+      return filesystem->GetFileInfo(selector);
+    }));
+    listings.push_back(std::move(listing));
+  }
+  std::unordered_map<std::string, fs::FileInfo> listed;
+  for (auto& listing : listings) {
+    ARROW_ASSIGN_OR_RAISE(auto infos, listing.result());
+    for (auto& info : infos) {
+      if (info.IsFile() && !detail::Ignored(info.path())) {
+        listed.emplace(info.path(), std::move(info));
+      }
+    }
+  }
+  stats->dirs_listed += static_cast<int>(dirs.size());
+
+  std::vector<Entry> kept;
+  std::vector<fs::FileInfo> reread;
+  for (auto& entry : manifest->entries) {
+    if (seen_dirs.count(detail::ParentDir(entry.path)) == 0) {
+      kept.push_back(std::move(entry));  // still fresh, not listed
+      continue;
+    }
+    auto it = listed.find(entry.path);
+    if (it == listed.end()) {
+      ++stats->removed;
+    } else if (it->second.size() == entry.size &&
+               detail::MtimeNs(it->second) == entry.mtime_ns) {
+      entry.validated_ns = now;
+      kept.push_back(std::move(entry));
+      ++stats->unchanged;
+      listed.erase(it);
+    } else {
+      reread.push_back(std::move(it->second));
+      ++stats->changed;
+      listed.erase(it);
+    }
+  }
+  // whatever is left in the listing wasn't in the manifest
+  for (auto& file : listed) {
+    reread.push_back(std::move(file.second));
+    ++stats->added;
+  }
+
+  ARROW_ASSIGN_OR_RAISE(auto fresh,
+                        detail::ReadEntries(*manifest, filesystem, reread));
+  for (auto& entry : fresh) kept.push_back(std::move(entry));
+  manifest->entries = std::move(kept);
+  if (stats->added + stats->changed > 0) {
+    ARROW_RETURN_NOT_OK(detail::UnifySchema(manifest));
+  }
+  return arrow::Status::OK();
+}
+
+// Written to a temporary file first so a crash never leaves half a manifest.
+inline arrow::Status SaveManifest(const DatasetManifest& manifest,
+                                  const std::string& path) {
+  arrow::StringBuilder paths;
+  arrow::Int64Builder sizes, mtimes, validated;
+  arrow::BinaryBuilder partitions, footers;
+  for (const auto& entry : manifest.entries) {
+    ARROW_RETURN_NOT_OK(paths.Append(entry.path));
+    ARROW_RETURN_NOT_OK(sizes.Append(entry.size));
+    ARROW_RETURN_NOT_OK(mtimes.Append(entry.mtime_ns));
+    ARROW_RETURN_NOT_OK(validated.Append(entry.validated_ns));
+    ARROW_ASSIGN_OR_RAISE(auto partition, cp::Serialize(entry.partition));
+    ARROW_RETURN_NOT_OK(partitions.Append(partition->data(),
+                                          partition->size()));
+    ARROW_ASSIGN_OR_RAISE(auto sink, arrow::io::BufferOutputStream::Create());
+    entry.footer->WriteTo(sink.get());
+    ARROW_ASSIGN_OR_RAISE(auto footer, sink->Finish());
+    ARROW_RETURN_NOT_OK(footers.Append(footer->data(), footer->size()));
+  }
+  std::vector<std::shared_ptr<arrow::Array>> columns(6);
+  ARROW_RETURN_NOT_OK(paths.Finish(&columns[0]));
+  ARROW_RETURN_NOT_OK(sizes.Finish(&columns[1]));
+  ARROW_RETURN_NOT_OK(mtimes.Finish(&columns[2]));
+  ARROW_RETURN_NOT_OK(validated.Finish(&columns[3]));
+  ARROW_RETURN_NOT_OK(partitions.Finish(&columns[4]));
+  ARROW_RETURN_NOT_OK(footers.Finish(&columns[5]));
+
+  ARROW_ASSIGN_OR_RAISE(auto dataset_schema,
+                        detail::EncodeSchema(*manifest.schema));
+  ARROW_ASSIGN_OR_RAISE(
+      auto partition_schema,
+      detail::EncodeSchema(*manifest.partitioning->schema()));
+  auto schema = detail::ManifestSchema(arrow::key_value_metadata(
+      {"base_dir", "partitioning", "partition_schema", "dataset_schema"},
+      {manifest.base_dir, manifest.partitioning->type_name(), partition_schema,
+       dataset_schema}));
+  auto batch = arrow::RecordBatch::Make(
+      schema, static_cast<int64_t>(manifest.entries.size()), columns);
+
+  auto tmp_path = path + ".tmp";
+  ARROW_ASSIGN_OR_RAISE(auto out, arrow::io::FileOutputStream::Open(tmp_path));
+  ARROW_ASSIGN_OR_RAISE(auto writer, arrow::ipc::MakeFileWriter(out, schema));
+  ARROW_RETURN_NOT_OK(writer->WriteRecordBatch(*batch));
+  ARROW_RETURN_NOT_OK(writer->Close());
+  ARROW_RETURN_NOT_OK(out->Close());
+  if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    return arrow::Status::IOError("could not rename ", tmp_path, " to ", path);
+  }
+  return arrow::Status::OK();
+}
+
+inline arrow::Result<DatasetManifest> LoadManifest(const std::string& path) {
+  ARROW_ASSIGN_OR_RAISE(auto file, arrow::io::ReadableFile::Open(path));
+  ARROW_ASSIGN_OR_RAISE(auto reader,
+                        arrow::ipc::RecordBatchFileReader::Open(file));
+  auto metadata = reader->schema()->metadata();
+  if (metadata == nullptr ||
+      !reader->schema()->Equals(*detail::ManifestSchema(), false)) {
+    return arrow::Status::Invalid(path, " is not a dataset manifest");
+  }
+
+  DatasetManifest manifest;
+  ARROW_ASSIGN_OR_RAISE(manifest.base_dir, metadata->Get("base_dir"));
+  ARROW_ASSIGN_OR_RAISE(auto encoded, metadata->Get("dataset_schema"));
+  ARROW_ASSIGN_OR_RAISE(manifest.schema, detail::DecodeSchema(encoded));
+  ARROW_ASSIGN_OR_RAISE(encoded, metadata->Get("partition_schema"));
+  ARROW_ASSIGN_OR_RAISE(auto partition_schema, detail::DecodeSchema(encoded));
+  ARROW_ASSIGN_OR_RAISE(auto kind, metadata->Get("partitioning"));
+  if (kind == "hive") {
+    manifest.partitioning =
+        std::make_shared<ds::HivePartitioning>(partition_schema);
+  } else if (kind == "directory") {
+    manifest.partitioning =
+        std::make_shared<ds::DirectoryPartitioning>(partition_schema);
+  } else {
+    return arrow::Status::NotImplemented("partitioning ", kind);
+  }
+
+  for (int i = 0; i < reader->num_record_batches(); ++i) {
+    ARROW_ASSIGN_OR_RAISE(auto batch, reader->ReadRecordBatch(i));
+    const auto& paths =
+        static_cast<const arrow::StringArray&>(*batch->column(0));
+    const auto& sizes =
+        static_cast<const arrow::Int64Array&>(*batch->column(1));
+    const auto& mtimes =
+        static_cast<const arrow::Int64Array&>(*batch->column(2));
+    const auto& validated =
+        static_cast<const arrow::Int64Array&>(*batch->column(3));
+    const auto& partitions =
+        static_cast<const arrow::BinaryArray&>(*batch->column(4));
+    const auto& footers =
+        static_cast<const arrow::BinaryArray&>(*batch->column(5));
+    for (int64_t row = 0; row < batch->num_rows(); ++row) {
+      Entry entry;
+      entry.path = paths.GetString(row);
+      entry.size = sizes.Value(row);
+      entry.mtime_ns = mtimes.Value(row);
+      entry.validated_ns = validated.Value(row);
+      auto partition = arrow::Buffer::FromString(partitions.GetString(row));
+      ARROW_ASSIGN_OR_RAISE(entry.partition, cp::Deserialize(partition));
+      auto footer = footers.GetView(row);
+      auto length = static_cast<uint32_t>(footer.size());
+      BEGIN_PARQUET_CATCH_EXCEPTIONS
+      entry.footer = parquet::FileMetaData::Make(footer.data(), &length);
+      END_PARQUET_CATCH_EXCEPTIONS
+      manifest.entries.push_back(std::move(entry));
+    }
+  }
+  return manifest;
+}
+
+// The dataset the manifest describes, built without any filesystem calls.
+// Columns in format->reader_options.dict_columns come back as dictionaries,
+// as they would from discovery.
+inline arrow::Result<std::shared_ptr<ds::Dataset>> MakeDataset(
+    const DatasetManifest& manifest,
+    const std::shared_ptr<fs::FileSystem>& filesystem,
+    const std::shared_ptr<ds::ParquetFileFormat>& format) {
+  const auto& dict_columns = format->reader_options.dict_columns;
+  auto buffer = std::make_shared<arrow::Buffer>(nullptr, 0);
+
+  std::vector<std::shared_ptr<ds::FileFragment>> fragments;
+  for (const auto& entry : manifest.entries) {
+    fs::FileInfo info(entry.path, fs::FileType::File);
+    info.set_size(entry.size);
+    info.set_mtime(fs::TimePoint(std::chrono::nanoseconds(entry.mtime_ns)));
+    std::shared_ptr<ds::FileFormat> file_format = format;
+    ARROW_ASSIGN_OR_RAISE(
+        auto fragment,
+        file_format->MakeFragment(ds::FileSource(info, filesystem),
+                                  entry.partition, nullptr));
+
+    // a reader over an empty file carrying the cached footer, all the
+    // fragment needs to take its metadata and physical schema from
+    parquet::ArrowReaderProperties properties;
+    for (const auto& name : dict_columns) {
+      auto index = entry.footer->schema()->ColumnIndex(name);
+      if (index >= 0) properties.set_read_dictionary(index, true);
+    }
+    std::unique_ptr<parquet::arrow::FileReader> reader;
+    BEGIN_PARQUET_CATCH_EXCEPTIONS
+    auto parquet_reader = parquet::ParquetFileReader::Open(
+        std::make_shared<arrow::io::BufferReader>(buffer),
+        parquet::default_reader_properties(), entry.footer);
+    ARROW_RETURN_NOT_OK(parquet::arrow::FileReader::Make(
+        arrow::default_memory_pool(), std::move(parquet_reader), properties,
+        &reader));
+    END_PARQUET_CATCH_EXCEPTIONS
+    ARROW_RETURN_NOT_OK(
+        std::static_pointer_cast<ds::ParquetFileFragment>(fragment)
+            ->EnsureCompleteMetadata(reader.get()));
+    fragments.push_back(std::move(fragment));
+  }
+
+  auto schema = manifest.schema;
+  for (const auto& name : dict_columns) {
+    auto index = schema->GetFieldIndex(name);
+    if (index < 0) continue;
+    auto field = schema->field(index);
+    ARROW_ASSIGN_OR_RAISE(
+        schema,
+        schema->SetField(index, field->WithType(arrow::dictionary(
+                                    arrow::int32(), field->type()))));
+  }
+  return ds::FileSystemDataset::Make(schema, cp::literal(true), format,
+                                     filesystem, std::move(fragments),
+                                     manifest.partitioning);
+}
+
+// Loads the manifest at manifest_path and revalidates what is older than
+// max_age, or builds one if there is none yet or it was made for another
+// base_dir or partitioning; saves it back whenever a listing refreshed it.
+inline arrow::Result<std::shared_ptr<ds::Dataset>> OpenDataset(
+    const std::shared_ptr<fs::FileSystem>& filesystem,
+    const std::string& base_dir,
+    std::shared_ptr<ds::Partitioning> partitioning,
+    const std::shared_ptr<ds::ParquetFileFormat>& format,
+    const std::string& manifest_path,
+    std::chrono::nanoseconds max_age = std::chrono::hours(24)) {
+  auto maybe_manifest = LoadManifest(manifest_path);
+  if (maybe_manifest.ok() && maybe_manifest->base_dir == base_dir &&
+      maybe_manifest->partitioning->type_name() ==
+          partitioning->type_name() &&
+      maybe_manifest->partitioning->schema()->Equals(
+          *partitioning->schema())) {
+    auto manifest = maybe_manifest.MoveValueUnsafe();
+    RevalidateStats stats;
+    ARROW_RETURN_NOT_OK(
+        RevalidateManifest(&manifest, filesystem, max_age, &stats));
+    // unchanged files still had their validated_ns moved on
+    if (stats.dirs_listed > 0) {
+      ARROW_RETURN_NOT_OK(SaveManifest(manifest, manifest_path));
+    }
+    return MakeDataset(manifest, filesystem, format);
+  }
+  ARROW_ASSIGN_OR_RAISE(
+      auto manifest,
+      BuildManifest(filesystem, base_dir, std::move(partitioning)));
+  ARROW_RETURN_NOT_OK(SaveManifest(manifest, manifest_path));
+  return MakeDataset(manifest, filesystem, format);
+}
+
+}  // namespace manifest
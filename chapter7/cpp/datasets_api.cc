@@ -28,6 +28,7 @@
 #include <parquet/arrow/writer.h>
 #include <iostream>
 #include <memory>
+#include "clustered_writer.h"
 
 #define ABORT_ON_FAIL(expr)                        \
   do {                                             \
@@ -79,6 +80,22 @@ std::string create_sample_dataset(
   return base_path;
 }
 
+// the same rows sorted by b into row groups of two rows, so b < 4 only has
+// to read the two row groups holding 0..3
+std::string create_clustered_dataset(
+    const std::shared_ptr<fs::FileSystem>& filesystem,
+    const std::string& root_path) {
+  auto base_path = root_path + "/clustered_dataset";
+  clustered::WriteOptions options;
+  options.keys = {"b"};
+  options.rows_per_row_group = 2;
+  options.rows_per_file = 5;
+  ABORT_ON_FAIL(clustered::WriteClustered(create_table(), filesystem,
+                                          base_path, options)
+                    .status());
+  return base_path;
+}
+
 std::shared_ptr<arrow::Table> scan_dataset(
     const std::shared_ptr<fs::FileSystem>& filesystem,
     const std::shared_ptr<ds::FileFormat>& format,
@@ -113,10 +130,12 @@ std::shared_ptr<arrow::Table> filter_and_select(
           .ValueOrDie();
 
   auto dataset = factory->Finish().ValueOrDie();
+  auto filter = cp::less(cp::field_ref("b"), cp::literal(4));
+  clustered::ExplainPruning(dataset, filter, {"b"}).ValueOrDie().Print();
+
   auto scan_builder = dataset->NewScan().ValueOrDie();
   ABORT_ON_FAIL(scan_builder->Project({"b"}));
-  ABORT_ON_FAIL(
-      scan_builder->Filter(cp::less(cp::field_ref("b"), cp::literal(4))));
+  ABORT_ON_FAIL(scan_builder->Filter(filter));
   auto scanner = scan_builder->Finish().ValueOrDie();
   return scanner->ToTable().ValueOrDie();
 }  // end of filter_and_select function
@@ -167,6 +186,10 @@ int main(int argc, char** argv) {
   table = filter_and_select(filesystem, format,
                             "/home/zero/sample/parquet_dataset");
   std::cout << table->ToString() << std::endl;
+  auto clustered_path =
+      create_clustered_dataset(filesystem, "/home/zero/sample");
+  table = filter_and_select(filesystem, format, clustered_path);
+  std::cout << table->ToString() << std::endl;
   table = derive_and_rename(filesystem, format,
                             "/home/zero/sample/parquet_dataset");
   std::cout << table->ToString() << std::endl;
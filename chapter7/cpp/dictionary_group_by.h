@@ -0,0 +1,297 @@
+// MIT License
+//
+// Copyright (c) 2021 Packt
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <arrow/api.h>
+#include <arrow/compute/api.h>
+#include <arrow/compute/exec/exec_plan.h>
+#include <arrow/compute/exec/options.h>
+#include <arrow/util/checked_cast.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// hash_mean for the common "few distinct strings" group-by shape. Fed a
+// key column and a numeric value column, e.g. through
+//
+//   scan -> project({key, value}) -> consuming_sink(consumer)
+//
+// When the key arrives dictionary encoded (read with
+// ParquetFileFormat::reader_options.dict_columns) each batch is aggregated
+// into small dense arrays indexed directly by the dictionary indices, with
+// no per-row hashing at all. Only the dictionary entries are hashed, once
+// per batch, to map them onto global group ids. That same mapping is what
+// unifies the dictionaries of different fragments. Plain string keys, or
+// dictionaries too large for the dense arrays to pay off, fall back to
+// hashing every row.
+class DictionaryGroupedMean : public arrow::compute::SinkNodeConsumer {
+ public:
+  // dictionaries bigger than this are treated as high cardinality
+  static constexpr int64_t kMaxDenseDictionary = 1 << 16;
+
+  DictionaryGroupedMean(std::string key_name, std::string value_name)
+      : key_name_(std::move(key_name)), value_name_(std::move(value_name)) {}
+
+  arrow::Status Consume(arrow::compute::ExecBatch batch) override {
+    ARROW_ASSIGN_OR_RAISE(auto key, ToArray(batch.values[0], batch.length));
+    ARROW_ASSIGN_OR_RAISE(auto value_array,
+                          ToArray(batch.values[1], batch.length));
+    ARROW_ASSIGN_OR_RAISE(auto value, ToDouble(value_array));
+
+    if (key->type_id() == arrow::Type::DICTIONARY) {
+      const auto& dict_array =
+          arrow::internal::checked_cast<const arrow::DictionaryArray&>(*key);
+      const auto& dictionary = *dict_array.dictionary();
+      // the dense path reads the dictionary as utf8, anything else is
+      // decoded and goes through the hashed path
+      if (dictionary.type_id() == arrow::Type::STRING &&
+          dictionary.length() <= kMaxDenseDictionary &&
+          dictionary.length() <= key->length()) {
+        ++dense_batches_;
+        return ConsumeDense(dict_array, *value);
+      }
+      ARROW_ASSIGN_OR_RAISE(key, DecodeDictionary(dict_array));
+    }
+    ++hashed_batches_;
+    return ConsumeHashed(*key, *value);
+  }
+
+  arrow::Future<> Finish() override { return arrow::Status::OK(); }
+
+  // one row per group: mean(<value>), <key>, like the hash_mean aggregate
+  arrow::Result<std::shared_ptr<arrow::Table>> result() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    arrow::DoubleBuilder means;
+    arrow::StringBuilder keys;
+    for (size_t id = 0; id < groups_.size(); ++id) {
+      // a group whose values were all null still gets a (null) mean
+      const auto& group = groups_[id];
+      if (group.count > 0) {
+        ARROW_RETURN_NOT_OK(means.Append(group.sum / group.count));
+      } else {
+        ARROW_RETURN_NOT_OK(means.AppendNull());
+      }
+      if (static_cast<int64_t>(id) == null_group_) {
+        ARROW_RETURN_NOT_OK(keys.AppendNull());
+      } else {
+        ARROW_RETURN_NOT_OK(keys.Append(names_[id]));
+      }
+    }
+    ARROW_ASSIGN_OR_RAISE(auto mean_array, means.Finish());
+    ARROW_ASSIGN_OR_RAISE(auto key_array, keys.Finish());
+    auto schema = arrow::schema(
+        {arrow::field("mean(" + value_name_ + ")", arrow::float64()),
+         arrow::field(key_name_, arrow::utf8())});
+    return arrow::Table::Make(schema, {mean_array, key_array});
+  }
+
+  int64_t dense_batches() const { return dense_batches_; }
+  int64_t hashed_batches() const { return hashed_batches_; }
+
+ private:
+  struct Group {
+    double sum = 0;
+    int64_t count = 0;  // non-null values
+    int64_t rows = 0;
+
+    void Merge(const Group& other) {
+      sum += other.sum;
+      count += other.count;
+      rows += other.rows;
+    }
+  };
+
+  // a column of the batch as an array, scalars (a key constant over the
+  // batch, say a partition field) repeated to the batch length
+  static arrow::Result<std::shared_ptr<arrow::Array>> ToArray(
+      const arrow::Datum& datum, int64_t length) {
+    if (datum.is_scalar()) {
+      return arrow::MakeArrayFromScalar(*datum.scalar(), length);
+    }
+    if (!datum.is_array()) {
+      return arrow::Status::NotImplemented("grouping a ",
+                                           datum.ToString(), " column");
+    }
+    return datum.make_array();
+  }
+
+  static arrow::Result<std::shared_ptr<arrow::DoubleArray>> ToDouble(
+      const std::shared_ptr<arrow::Array>& values) {
+    if (values->type_id() != arrow::Type::DOUBLE) {
+      ARROW_ASSIGN_OR_RAISE(
+          auto cast, arrow::compute::Cast(*values, arrow::float64()));
+      return std::static_pointer_cast<arrow::DoubleArray>(cast);
+    }
+    return std::static_pointer_cast<arrow::DoubleArray>(values);
+  }
+
+  static arrow::Result<std::shared_ptr<arrow::Array>> DecodeDictionary(
+      const arrow::DictionaryArray& dict_array) {
+    ARROW_ASSIGN_OR_RAISE(
+        arrow::Datum decoded,
+        arrow::compute::Take(dict_array.dictionary(), dict_array.indices()));
+    return decoded.make_array();
+  }
+
+  // global group id of a key, must hold mutex_
+  int64_t GroupIdLocked(const std::string_view* key) {
+    if (key == nullptr) {
+      if (null_group_ < 0) {
+        null_group_ = static_cast<int64_t>(groups_.size());
+        groups_.emplace_back();
+        names_.emplace_back();
+      }
+      return null_group_;
+    }
+    auto it = ids_.find(std::string(*key));
+    if (it != ids_.end()) return it->second;
+    const auto id = static_cast<int64_t>(groups_.size());
+    ids_.emplace(std::string(*key), id);
+    groups_.emplace_back();
+    names_.emplace_back(*key);
+    return id;
+  }
+
+  template <typename IndexType>
+  static void AccumulateDense(const arrow::DictionaryArray& dict_array,
+                              const arrow::DoubleArray& values,
+                              std::vector<Group>* local,
+                              Group* null_key_group) {
+    const auto& indices =
+        arrow::internal::checked_cast<const arrow::NumericArray<IndexType>&>(
+            *dict_array.indices());
+    const auto* raw_indices = indices.raw_values();
+    const double* raw_values = values.raw_values();
+    if (indices.null_count() == 0 && values.null_count() == 0) {
+      for (int64_t i = 0; i < values.length(); ++i) {
+        Group& group = (*local)[raw_indices[i]];
+        group.sum += raw_values[i];
+        ++group.count;
+        ++group.rows;
+      }
+      return;
+    }
+    for (int64_t i = 0; i < values.length(); ++i) {
+      Group& group =
+          indices.IsNull(i) ? *null_key_group : (*local)[raw_indices[i]];
+      ++group.rows;
+      if (values.IsValid(i)) {
+        group.sum += raw_values[i];
+        ++group.count;
+      }
+    }
+  }
+
+  arrow::Status ConsumeDense(const arrow::DictionaryArray& dict_array,
+                             const arrow::DoubleArray& values) {
+    const auto& dictionary = static_cast<const arrow::StringArray&>(
+        *dict_array.dictionary());
+
+    // aggregate lock free into arrays indexed by this batch's dictionary
+    std::vector<Group> local(dictionary.length());
+    Group null_key;
+    const auto& dict_type =
+        static_cast<const arrow::DictionaryType&>(*dict_array.type());
+    switch (dict_type.index_type()->id()) {
+      case arrow::Type::INT8:
+        AccumulateDense<arrow::Int8Type>(dict_array, values, &local, &null_key);
+        break;
+      case arrow::Type::INT16:
+        AccumulateDense<arrow::Int16Type>(dict_array, values, &local,
+                                          &null_key);
+        break;
+      case arrow::Type::INT32:
+        AccumulateDense<arrow::Int32Type>(dict_array, values, &local,
+                                          &null_key);
+        break;
+      case arrow::Type::INT64:
+        AccumulateDense<arrow::Int64Type>(dict_array, values, &local,
+                                          &null_key);
+        break;
+      default:
+        return arrow::Status::NotImplemented(
+            "dictionary index type ", dict_type.index_type()->ToString());
+    }
+
+    // then unify: map each dictionary entry onto its global group once
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (int64_t j = 0; j < dictionary.length(); ++j) {
+      if (local[j].rows == 0) continue;
+      const auto view = dictionary.GetView(j);
+      const std::string_view name{view.data(), view.size()};
+      groups_[GroupIdLocked(&name)].Merge(local[j]);
+    }
+    if (null_key.rows > 0) {
+      groups_[GroupIdLocked(nullptr)].Merge(null_key);
+    }
+    return arrow::Status::OK();
+  }
+
+  arrow::Status ConsumeHashed(const arrow::Array& key,
+                              const arrow::DoubleArray& values) {
+    if (key.type_id() != arrow::Type::STRING) {
+      return arrow::Status::NotImplemented("grouping on ",
+                                           key.type()->ToString());
+    }
+    const auto& keys = static_cast<const arrow::StringArray&>(key);
+
+    // hash into a batch local map first to keep the lock short
+    std::unordered_map<std::string_view, Group> local;
+    Group null_key;
+    for (int64_t i = 0; i < values.length(); ++i) {
+      Group* group = &null_key;
+      if (keys.IsValid(i)) {
+        const auto view = keys.GetView(i);
+        group = &local[std::string_view{view.data(), view.size()}];
+      }
+      ++group->rows;
+      if (values.IsValid(i)) {
+        group->sum += values.Value(i);
+        ++group->count;
+      }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& entry : local) {
+      groups_[GroupIdLocked(&entry.first)].Merge(entry.second);
+    }
+    if (null_key.rows > 0) {
+      groups_[GroupIdLocked(nullptr)].Merge(null_key);
+    }
+    return arrow::Status::OK();
+  }
+
+  const std::string key_name_;
+  const std::string value_name_;
+  mutable std::mutex mutex_;
+  std::unordered_map<std::string, int64_t> ids_;
+  std::vector<Group> groups_;      // indexed by global group id
+  std::vector<std::string> names_;  // indexed by global group id
+  int64_t null_group_ = -1;
+  std::atomic<int64_t> dense_batches_{0};
+  std::atomic<int64_t> hashed_batches_{0};
+};
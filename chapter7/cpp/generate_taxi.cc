@@ -0,0 +1,66 @@
+// MIT License
+//
+// Copyright (c) 2021 Packt
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <arrow/api.h>
+#include <arrow/filesystem/api.h>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include "taxi_data.h"
+
+namespace fs = arrow::fs;
+
+// generate_taxi <dir> [rows per month] [first year] [last year]
+//
+// Writes a synthetic copy of the taxi dataset to <dir>. Point the other
+// examples at it with TAXI_DATA_DIR=<dir> to run them without S3.
+arrow::Status run(int argc, char** argv) {
+  if (argc < 2) {
+    return arrow::Status::Invalid(
+        "usage: generate_taxi <dir> [rows per month] [first year] [last year]");
+  }
+  taxidata::GenerateOptions options;
+  if (argc > 2) options.rows_per_month = std::stoll(argv[2]);
+  if (argc > 3) options.first_year = options.last_year = std::stoi(argv[3]);
+  if (argc > 4) options.last_year = std::stoi(argv[4]);
+
+  auto filesystem = std::make_shared<fs::LocalFileSystem>();
+  ARROW_ASSIGN_OR_RAISE(auto base_dir, filesystem->NormalizePath(argv[1]));
+  auto start = std::chrono::steady_clock::now();
+  ARROW_RETURN_NOT_OK(taxidata::Generate(filesystem, base_dir, options));
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  const int months = (options.last_year - options.first_year + 1) * 12;
+  std::cout << "wrote " << months * options.rows_per_month << " rows in "
+            << months << " files to " << base_dir << " in " << elapsed.count()
+            << " s" << std::endl;
+  return arrow::Status::OK();
+}
+
+int main(int argc, char** argv) {
+  auto status = run(argc, argv);
+  if (!status.ok()) {
+    std::cerr << status.ToString() << std::endl;
+    return 1;
+  }
+}
@@ -0,0 +1,400 @@
+// MIT License
+//
+// Copyright (c) 2021 Packt
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <arrow/api.h>
+#include <arrow/compute/exec/expression.h>
+#include <arrow/dataset/api.h>
+#include <arrow/filesystem/api.h>
+#include <arrow/util/byte_size.h>
+#include <arrow/util/future.h>
+#include <arrow/util/thread_pool.h>
+#include <parquet/arrow/writer.h>
+#include <parquet/properties.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Writes batches into a key/value (hive or directory) partitioned Parquet
+// dataset. Rows are buffered per partition until they make a row group of
+// about target_row_group_bytes in memory; that row group is then encoded
+// and compressed on a dedicated thread pool while the caller keeps
+// partitioning batches. Row groups of one file are written in order, files
+// are written in parallel. A file is closed once its compressed size passes
+// target_file_bytes and at most max_open_files are open at a time, the
+// least recently written one being closed to make room. Buffered plus in
+// flight bytes are capped by max_buffered_bytes, Write blocks above it.
+namespace partitioned {
+
+namespace ds = arrow::dataset;
+namespace fs = arrow::fs;
+namespace cp = arrow::compute;
+
+struct WriterOptions {
+  std::shared_ptr<fs::FileSystem> filesystem;
+  std::string base_dir;
+  std::shared_ptr<ds::Partitioning> partitioning;
+  std::string basename_template = "part-{i}.parquet";
+
+  arrow::Compression::type compression = arrow::Compression::ZSTD;
+  int compression_level = 3;
+  bool dictionary = true;
+
+  int64_t target_file_bytes = int64_t(512) << 20;  // compressed
+  int64_t target_row_group_bytes = int64_t(128) << 20;  // in memory
+  int max_open_files = 64;
+  int64_t max_buffered_bytes = int64_t(2) << 30;
+  int encode_threads = static_cast<int>(std::thread::hardware_concurrency());
+};
+
+struct WriteStats {
+  int64_t rows = 0;
+  int64_t files = 0;
+  int64_t row_groups = 0;
+  int64_t evictions = 0;  // files closed early for max_open_files
+  int64_t bytes_in = 0;  // in memory size of the batches written
+  int64_t bytes_out = 0;  // Parquet bytes on the filesystem
+  int64_t buffered_high_water = 0;
+  int64_t encoder_high_water = 0;  // peak allocated by the Parquet encoders
+  double seconds = 0;
+
+  void Print(std::ostream& os = std::cout) const {
+    os << rows << " rows in " << files << " files and " << row_groups
+       << " row groups (" << evictions << " closed early), "
+       << bytes_in / (1 << 20) << " MiB in, " << bytes_out / (1 << 20)
+       << " MiB out, " << seconds << " s, "
+       << bytes_in / seconds / (1 << 20) << " MiB/s in, "
+       << rows / seconds / 1e6 << " Mrows/s; high water: "
+       << buffered_high_water / (1 << 20) << " MiB buffered, "
+       << encoder_high_water / (1 << 20) << " MiB in encoders" << std::endl;
+  }
+};
+
+class PartitionedParquetWriter {
+ public:
+  static arrow::Result<std::unique_ptr<PartitionedParquetWriter>> Make(
+      WriterOptions options) {
+    if (!options.filesystem || !options.partitioning) {
+      return arrow::Status::Invalid("a filesystem and partitioning are needed");
+    }
+    std::unique_ptr<PartitionedParquetWriter> writer(
+        new PartitionedParquetWriter(std::move(options)));
+    ARROW_ASSIGN_OR_RAISE(
+        writer->pool_,
+        arrow::internal::ThreadPool::Make(
+            std::max(1, writer->options_.encode_threads)));
+    return writer;
+  }
+
+  ~PartitionedParquetWriter() {
+    if (!finished_) auto ignored = Finish();
+  }
+
+  arrow::Status Write(const std::shared_ptr<arrow::RecordBatch>& batch) {
+    if (batch->num_rows() == 0) return arrow::Status::OK();
+    stats_.rows += batch->num_rows();
+    ARROW_ASSIGN_OR_RAISE(auto parts, options_.partitioning->Partition(batch));
+    for (size_t i = 0; i < parts.batches.size(); ++i) {
+      const auto& part = parts.batches[i];
+      if (part->num_rows() == 0) continue;
+      ARROW_ASSIGN_OR_RAISE(auto dir, Directory(parts.expressions[i]));
+      ARROW_ASSIGN_OR_RAISE(auto file, GetFile(dir, part->schema()));
+
+      auto bytes = arrow::util::TotalBufferSize(*part);
+      stats_.bytes_in += bytes;
+      file->pending.push_back(part);
+      file->pending_bytes += bytes;
+      Buffer(bytes);
+      if (file->pending_bytes >= options_.target_row_group_bytes) {
+        ARROW_RETURN_NOT_OK(Flush(file));
+      }
+      if (file->bytes_written->load() >= options_.target_file_bytes) {
+        ARROW_RETURN_NOT_OK(Close(dir));
+      }
+      ARROW_RETURN_NOT_OK(WaitForBuffer());
+    }
+    return arrow::Status::OK();
+  }
+
+  // Flushes and closes every file and waits for the encoders.
+  arrow::Result<WriteStats> Finish() {
+    finished_ = true;
+    arrow::Status status;
+    while (!files_.empty()) {
+      auto dir = files_.begin()->first;
+      auto closed = Close(dir);
+      if (status.ok()) status = closed;
+    }
+    for (auto& closing : closing_) {
+      auto done = closing.status();
+      if (status.ok()) status = done;
+    }
+    closing_.clear();
+    ARROW_RETURN_NOT_OK(status);
+
+    stats_.bytes_out = bytes_out_->load();
+    stats_.encoder_high_water = encoder_pool_.max_memory();
+    stats_.seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start_)
+                         .count();
+    return stats_;
+  }
+
+ private:
+  struct OpenFile {
+    std::shared_ptr<arrow::io::OutputStream> sink;
+    std::shared_ptr<parquet::arrow::FileWriter> writer;
+    std::shared_ptr<arrow::Schema> schema;
+    arrow::RecordBatchVector pending;
+    int64_t pending_bytes = 0;
+    // the last row group task of this file, the next one starts after it
+    arrow::Future<> tail = arrow::Future<>::MakeFinished();
+    std::shared_ptr<std::atomic<int64_t>> bytes_written =
+        std::make_shared<std::atomic<int64_t>>(0);
+    std::list<std::string>::iterator lru;
+  };
+
+  explicit PartitionedParquetWriter(WriterOptions options)
+      : options_(std::move(options)),
+        encoder_pool_(arrow::default_memory_pool()),
+        bytes_out_(std::make_shared<std::atomic<int64_t>>(0)),
+        buffered_(std::make_shared<BufferState>()),
+        start_(std::chrono::steady_clock::now()) {}
+
+  // the partition's path relative to base_dir, e.g. year=2015/month=3
+  arrow::Result<std::string> Directory(const cp::Expression& partition) {
+    ARROW_ASSIGN_OR_RAISE(auto known, cp::ExtractKnownFieldValues(partition));
+    bool hive = options_.partitioning->type_name() == "hive";
+    std::string dir;
+    for (const auto& field : options_.partitioning->schema()->fields()) {
+      auto value = known.map.find(arrow::FieldRef(field->name()));
+      std::string segment = "__HIVE_DEFAULT_PARTITION__";
+      if (value != known.map.end() && value->second.scalar()->is_valid) {
+        segment = value->second.scalar()->ToString();
+      }
+      dir += (hive ? field->name() + "=" : "") + segment + "/";
+    }
+    return dir;
+  }
+
+  arrow::Result<OpenFile*> GetFile(
+      const std::string& dir, const std::shared_ptr<arrow::Schema>& schema) {
+    auto it = files_.find(dir);
+    if (it != files_.end()) {
+      lru_.splice(lru_.begin(), lru_, it->second.lru);
+      return &it->second;
+    }
+    if (static_cast<int>(files_.size()) >= options_.max_open_files) {
+      ++stats_.evictions;
+      auto victim = lru_.back();
+      ARROW_RETURN_NOT_OK(Close(victim));
+    }
+
+    auto path = options_.base_dir + "/" + dir;
+    ARROW_RETURN_NOT_OK(options_.filesystem->CreateDir(path));
+    auto basename = options_.basename_template;
+    auto index = std::to_string(next_index_[dir]++);
+    auto placeholder = basename.find("{i}");
+    if (placeholder != std::string::npos) {
+      basename.replace(placeholder, 3, index);
+    }
+
+    OpenFile file;
+    file.schema = schema;
+    ARROW_ASSIGN_OR_RAISE(
+        file.sink, options_.filesystem->OpenOutputStream(path + basename));
+    parquet::WriterProperties::Builder properties;
+    properties.compression(options_.compression)
+        ->compression_level(options_.compression_level)
+        ->max_row_group_length(std::numeric_limits<int64_t>::max())
+        ->memory_pool(&encoder_pool_);
+    if (options_.dictionary) {
+      properties.enable_dictionary();
+    } else {
+      properties.disable_dictionary();
+    }
+    std::unique_ptr<parquet::arrow::FileWriter> writer;
+    ARROW_RETURN_NOT_OK(parquet::arrow::FileWriter::Open(
+        *schema, &encoder_pool_, file.sink, properties.build(),
+        parquet::ArrowWriterProperties::Builder().store_schema()->build(),
+        &writer));
+    file.writer = std::move(writer);
+    ++stats_.files;
+
+    lru_.push_front(dir);
+    file.lru = lru_.begin();
+    return &files_.emplace(dir, std::move(file)).first->second;
+  }
+
+  // Runs task on the encode pool once `after` has succeeded; if it failed
+  // the task is skipped, skipped() runs instead and the error is passed on.
+  arrow::Future<> Chain(const arrow::Future<>& after,
+                        std::function<arrow::Status()> task,
+                        std::function<void()> skipped = [] {}) {
+    auto pool = pool_;
+    return after.Then(
+        [pool, task]() -> arrow::Future<> {
+          return arrow::DeferNotOk(pool->Submit(task));
+        },
+        [skipped](const arrow::Status& error) -> arrow::Future<> {
+          skipped();
+          return arrow::Future<>::MakeFinished(error);
+        });
+  }
+
+  // the file's pending batches become one row group
+  arrow::Status Flush(OpenFile* file) {
+    if (file->pending.empty()) return arrow::Status::OK();
+    ARROW_ASSIGN_OR_RAISE(
+        auto table, arrow::Table::FromRecordBatches(file->schema,
+                                                    std::move(file->pending)));
+    auto bytes = file->pending_bytes;
+    file->pending.clear();
+    file->pending_bytes = 0;
+    ++stats_.row_groups;
+
+    auto writer = file->writer;
+    auto sink = file->sink;
+    auto written = file->bytes_written;
+    auto buffered = buffered_;
+    file->tail = Chain(
+        file->tail,
+        [=] {
+          auto status = writer->WriteTable(*table, table->num_rows());
+          auto position = sink->Tell();
+          if (position.ok()) written->store(*position);
+          buffered->Release(bytes);
+          return status;
+        },
+        [=] { buffered->Release(bytes); });
+    return arrow::Status::OK();
+  }
+
+  arrow::Status Close(const std::string& dir) {
+    auto it = files_.find(dir);
+    if (it == files_.end()) return arrow::Status::OK();
+    auto& file = it->second;
+    auto status = Flush(&file);
+    auto writer = file.writer;
+    auto sink = file.sink;
+    auto bytes_out = bytes_out_;
+    closing_.push_back(Chain(file.tail, [=] {
+      ARROW_RETURN_NOT_OK(writer->Close());
+      ARROW_ASSIGN_OR_RAISE(auto size, sink->Tell());
+      *bytes_out += size;
+      return sink->Close();
+    }));
+    lru_.erase(file.lru);
+    files_.erase(it);
+    return status;
+  }
+
+  struct BufferState {
+    std::mutex mutex;
+    std::condition_variable released;
+    int64_t bytes = 0;
+
+    void Release(int64_t n) {
+      std::lock_guard<std::mutex> lock(mutex);
+      bytes -= n;
+      released.notify_all();
+    }
+  };
+
+  void Buffer(int64_t n) {
+    std::lock_guard<std::mutex> lock(buffered_->mutex);
+    buffered_->bytes += n;
+    stats_.buffered_high_water =
+        std::max(stats_.buffered_high_water, buffered_->bytes);
+  }
+
+  // Above the cap the biggest pending row groups are handed to the encoders
+  // early, then we wait for them to make room.
+  arrow::Status WaitForBuffer() {
+    while (true) {
+      {
+        std::lock_guard<std::mutex> lock(buffered_->mutex);
+        if (buffered_->bytes <= options_.max_buffered_bytes) break;
+      }
+      OpenFile* largest = nullptr;
+      for (auto& file : files_) {
+        if (largest == nullptr ||
+            file.second.pending_bytes > largest->pending_bytes) {
+          largest = &file.second;
+        }
+      }
+      if (largest != nullptr && largest->pending_bytes > 0) {
+        ARROW_RETURN_NOT_OK(Flush(largest));
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(buffered_->mutex);
+      buffered_->released.wait(lock, [&] {
+        return buffered_->bytes <= options_.max_buffered_bytes;
+      });
+    }
+    return arrow::Status::OK();
+  }
+
+  const WriterOptions options_;
+  arrow::ProxyMemoryPool encoder_pool_;
+  std::shared_ptr<arrow::internal::ThreadPool> pool_;
+  std::map<std::string, OpenFile> files_;
+  std::list<std::string> lru_;  // most recently written first
+  std::map<std::string, int> next_index_;
+  std::vector<arrow::Future<>> closing_;
+  std::shared_ptr<std::atomic<int64_t>> bytes_out_;
+  std::shared_ptr<BufferState> buffered_;
+  WriteStats stats_;
+  bool finished_ = false;
+  std::chrono::steady_clock::time_point start_;
+};
+
+// Drains the scanner into the writer, the scan threads decoding and the
+// encode pool writing at the same time.
+inline arrow::Result<WriteStats> WritePartitioned(ds::Scanner* scanner,
+                                                  WriterOptions options) {
+  ARROW_ASSIGN_OR_RAISE(auto writer,
+                        PartitionedParquetWriter::Make(std::move(options)));
+  ARROW_ASSIGN_OR_RAISE(auto reader, scanner->ToRecordBatchReader());
+  std::shared_ptr<arrow::RecordBatch> batch;
+  while (true) {
+    ARROW_RETURN_NOT_OK(reader->ReadNext(&batch));
+    if (batch == nullptr) break;
+    ARROW_RETURN_NOT_OK(writer->Write(batch));
+  }
+  return writer->Finish();
+}
+
+}  // namespace partitioned
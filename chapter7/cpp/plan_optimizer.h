@@ -0,0 +1,303 @@
+// MIT License
+//
+// Copyright (c) 2021 Packt
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <arrow/api.h>
+#include <arrow/compute/api.h>
+#include <arrow/compute/exec/exec_plan.h>
+#include <arrow/compute/exec/expression.h>
+#include <arrow/compute/exec/options.h>
+#include <arrow/dataset/api.h>
+#include <arrow/dataset/plan.h>
+#include <arrow/util/variant.h>
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// A small rule based optimizer for Declaration trees, run before AddToPlan:
+//
+//  * a filter directly on a dataset scan is pushed into the scan's filter
+//    and removed when every fragment that survives partition pruning is
+//    guaranteed to satisfy it by its partition expression
+//  * two adjacent projects are merged into one
+//  * a project which only selects fields by name is removed in front of an
+//    aggregate that only refers to those fields by name
+//
+// The report says what was rewritten, how many fragments the partitioning
+// pruned and how many rows never needed to go through the removed filter.
+
+namespace optimizer {
+
+namespace ds = arrow::dataset;
+namespace cp = arrow::compute;
+
+struct OptimizerOptions {
+  // counting rows opens every surviving fragment's footer
+  bool count_unfiltered_rows = true;
+  // nodes which pass batches through unchanged and can be looked through
+  std::vector<std::string> passthrough = {"trace"};
+};
+
+struct OptimizerReport {
+  int filters_removed = 0;
+  int projects_merged = 0;
+  int projects_removed = 0;
+  int fragments_total = 0;
+  int fragments_pruned = 0;
+  int64_t rows_unfiltered = 0;
+
+  void Print(std::ostream& os = std::cout) const {
+    os << "optimizer: removed " << filters_removed << " filter(s), merged "
+       << projects_merged << " and removed " << projects_removed
+       << " project(s); " << fragments_pruned << " of " << fragments_total
+       << " fragments pruned by partition, " << rows_unfiltered
+       << " rows skipped the filter" << std::endl;
+  }
+};
+
+namespace detail {
+
+using Replacer =
+    std::function<arrow::Result<cp::Expression>(const cp::Expression&)>;
+
+// rebuilds `expr` bottom up with every field_ref passed through `replace`
+inline arrow::Result<cp::Expression> ReplaceFieldRefs(
+    const cp::Expression& expr, const Replacer& replace) {
+  if (expr.field_ref()) return replace(expr);
+  if (auto call = expr.call()) {
+    std::vector<cp::Expression> arguments;
+    for (const auto& argument : call->arguments) {
+      ARROW_ASSIGN_OR_RAISE(auto replaced, ReplaceFieldRefs(argument, replace));
+      arguments.push_back(std::move(replaced));
+    }
+    return cp::call(call->function_name, std::move(arguments), call->options);
+  }
+  return expr;
+}
+
+inline cp::Declaration* SingleInput(cp::Declaration* decl) {
+  if (decl->inputs.size() != 1) return nullptr;
+  return arrow::util::get_if<cp::Declaration>(&decl->inputs[0]);
+}
+
+// the first input of `decl` which isn't a passthrough node
+inline cp::Declaration* ProducerOf(cp::Declaration* decl,
+                                   const OptimizerOptions& options) {
+  auto* input = SingleInput(decl);
+  while (input != nullptr &&
+         std::find(options.passthrough.begin(), options.passthrough.end(),
+                   input->factory_name) != options.passthrough.end()) {
+    input = SingleInput(input);
+  }
+  return input;
+}
+
+// replaces a single input node by its input
+inline void Splice(cp::Declaration* decl) {
+  cp::Declaration input = std::move(*SingleInput(decl));
+  *decl = std::move(input);
+}
+
+// a project made only of field_ref(name) expressions keeping their names
+inline bool IsPureSelection(const cp::ProjectNodeOptions& project) {
+  for (size_t i = 0; i < project.expressions.size(); ++i) {
+    const auto* ref = project.expressions[i].field_ref();
+    if (ref == nullptr || ref->name() == nullptr) return false;
+    if (i < project.names.size() && *ref->name() != project.names[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+inline bool Selects(const cp::ProjectNodeOptions& project,
+                    const cp::FieldRef& ref) {
+  if (ref.name() == nullptr) return false;
+  for (const auto& expr : project.expressions) {
+    if (*expr.field_ref()->name() == *ref.name()) return true;
+  }
+  return false;
+}
+
+inline arrow::Result<bool> TryRemoveFilter(cp::Declaration* decl,
+                                           const OptimizerOptions& options,
+                                           OptimizerReport* report) {
+  auto* input = ProducerOf(decl, options);
+  if (input == nullptr || input->factory_name != "scan") return false;
+  const auto& filter_opts =
+      static_cast<const cp::FilterNodeOptions&>(*decl->options);
+  const auto& scan_opts =
+      static_cast<const ds::ScanNodeOptions&>(*input->options);
+  const auto& dataset = scan_opts.dataset;
+
+  ARROW_ASSIGN_OR_RAISE(auto predicate,
+                        filter_opts.filter_expression.Bind(*dataset->schema()));
+  // the scan needs the predicate too, that's what does the pruning
+  auto scan_filter = scan_opts.scan_options->filter;
+  if (!scan_filter.IsBound()) {
+    ARROW_ASSIGN_OR_RAISE(scan_filter, scan_filter.Bind(*dataset->schema()));
+  }
+  if (!scan_filter.Equals(predicate)) {
+    ARROW_ASSIGN_OR_RAISE(scan_filter, cp::and_(scan_filter, predicate)
+                                           .Bind(*dataset->schema()));
+  }
+
+  ARROW_ASSIGN_OR_RAISE(auto all_fragments, dataset->GetFragments());
+  ARROW_ASSIGN_OR_RAISE(auto kept_fragments,
+                        dataset->GetFragments(scan_filter));
+  int total = 0;
+  for (auto maybe_fragment : all_fragments) {
+    ARROW_RETURN_NOT_OK(maybe_fragment.status());
+    ++total;
+  }
+  ds::FragmentVector kept;
+  for (auto maybe_fragment : kept_fragments) {
+    ARROW_ASSIGN_OR_RAISE(auto fragment, maybe_fragment);
+    ARROW_ASSIGN_OR_RAISE(
+        auto simplified,
+        cp::SimplifyWithGuarantee(predicate, fragment->partition_expression()));
+    if (!simplified.Equals(cp::literal(true))) {
+      return false;  // some rows still need the filter
+    }
+    kept.push_back(std::move(fragment));
+  }
+
+  report->fragments_total += total;
+  report->fragments_pruned += total - static_cast<int>(kept.size());
+  if (options.count_unfiltered_rows) {
+    for (const auto& fragment : kept) {
+      ARROW_ASSIGN_OR_RAISE(
+          auto rows,
+          fragment->CountRows(cp::literal(true), scan_opts.scan_options)
+              .result());
+      if (rows.has_value()) report->rows_unfiltered += *rows;
+    }
+  }
+
+  // copy the scan options rather than change the caller's
+  auto new_scan_options =
+      std::make_shared<ds::ScanOptions>(*scan_opts.scan_options);
+  new_scan_options->filter = scan_filter;
+  auto new_scan_opts = std::make_shared<ds::ScanNodeOptions>(scan_opts);
+  new_scan_opts->scan_options = std::move(new_scan_options);
+  input->options = std::move(new_scan_opts);
+
+  Splice(decl);
+  ++report->filters_removed;
+  return true;
+}
+
+inline arrow::Result<bool> TryMergeProjects(cp::Declaration* decl,
+                                            const OptimizerOptions& options,
+                                            OptimizerReport* report) {
+  auto* input = ProducerOf(decl, options);
+  if (input == nullptr || input->factory_name != "project" ||
+      SingleInput(input) == nullptr) {
+    return false;
+  }
+  const auto& outer =
+      static_cast<const cp::ProjectNodeOptions&>(*decl->options);
+  const auto& inner =
+      static_cast<const cp::ProjectNodeOptions&>(*input->options);
+  if (inner.names.size() != inner.expressions.size()) return false;
+
+  bool mergeable = true;
+  auto substitute = [&](const cp::Expression& ref_expr)
+      -> arrow::Result<cp::Expression> {
+    const auto* name = ref_expr.field_ref()->name();
+    for (size_t i = 0; name != nullptr && i < inner.names.size(); ++i) {
+      if (inner.names[i] == *name) return inner.expressions[i];
+    }
+    mergeable = false;  // refers to something the inner project doesn't name
+    return ref_expr;
+  };
+  std::vector<cp::Expression> merged;
+  for (const auto& expr : outer.expressions) {
+    ARROW_ASSIGN_OR_RAISE(auto replaced, ReplaceFieldRefs(expr, substitute));
+    merged.push_back(std::move(replaced));
+  }
+  if (!mergeable) return false;
+
+  decl->options = std::make_shared<cp::ProjectNodeOptions>(std::move(merged),
+                                                           outer.names);
+  Splice(input);
+  ++report->projects_merged;
+  return true;
+}
+
+inline bool TryRemoveSelection(cp::Declaration* decl,
+                               const OptimizerOptions& options,
+                               OptimizerReport* report) {
+  auto* input = ProducerOf(decl, options);
+  if (input == nullptr || input->factory_name != "project" ||
+      SingleInput(input) == nullptr) {
+    return false;
+  }
+  const auto& project =
+      static_cast<const cp::ProjectNodeOptions&>(*input->options);
+  const auto& aggregate =
+      static_cast<const cp::AggregateNodeOptions&>(*decl->options);
+  if (!IsPureSelection(project)) return false;
+  for (const auto* refs : {&aggregate.targets, &aggregate.keys}) {
+    for (const auto& ref : *refs) {
+      if (!Selects(project, ref)) return false;
+    }
+  }
+
+  Splice(input);
+  ++report->projects_removed;
+  return true;
+}
+
+}  // namespace detail
+
+// Rewrites `decl` in place, inputs first so rules see optimized subtrees.
+inline arrow::Status OptimizePlan(cp::Declaration* decl,
+                                  OptimizerReport* report,
+                                  const OptimizerOptions& options = {}) {
+  for (auto& input : decl->inputs) {
+    if (auto* input_decl = arrow::util::get_if<cp::Declaration>(&input)) {
+      ARROW_RETURN_NOT_OK(OptimizePlan(input_decl, report, options));
+    }
+  }
+
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    if (decl->factory_name == "filter") {
+      ARROW_ASSIGN_OR_RAISE(changed,
+                            detail::TryRemoveFilter(decl, options, report));
+    } else if (decl->factory_name == "project") {
+      ARROW_ASSIGN_OR_RAISE(changed,
+                            detail::TryMergeProjects(decl, options, report));
+    } else if (decl->factory_name == "aggregate") {
+      changed = detail::TryRemoveSelection(decl, options, report);
+    }
+  }
+  return arrow::Status::OK();
+}
+
+}  // namespace optimizer
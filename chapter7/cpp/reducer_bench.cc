@@ -0,0 +1,174 @@
+// MIT License
+//
+// Copyright (c) 2021 Packt
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <arrow/api.h>
+#include <arrow/compute/api.h>
+#include <arrow/dataset/api.h>
+#include <atomic>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "benchmark.h"
+#include "reducer.h"
+
+namespace ds = arrow::dataset;
+namespace cp = arrow::compute;
+
+// Per-batch statistics in a Scanner::Scan callback: the shared atomics
+// compute_mean used to fold cp::Sum results into, against per-thread
+// reducers, over an in-memory dataset so the scan itself costs little.
+constexpr int64_t kRows = int64_t(1) << 25;
+constexpr int64_t kBatchRows = int64_t(1) << 16;
+
+std::shared_ptr<arrow::Table> make_trips() {
+  std::mt19937_64 rng(42);
+  std::uniform_int_distribution<int64_t> passengers(0, 6);
+  std::lognormal_distribution<double> fares(2.5, 0.8);
+  std::bernoulli_distribution valid(0.99);
+  arrow::Int64Builder passenger_builder;
+  arrow::DoubleBuilder fare_builder;
+  arrow::RecordBatchVector batches;
+  auto schema = arrow::schema({arrow::field("passenger_count", arrow::int64()),
+                               arrow::field("fare_amount", arrow::float64())});
+  for (int64_t start = 0; start < kRows; start += kBatchRows) {
+    if (!passenger_builder.Reserve(kBatchRows).ok() ||
+        !fare_builder.Reserve(kBatchRows).ok()) {
+      return nullptr;
+    }
+    for (int64_t i = 0; i < kBatchRows; ++i) {
+      passenger_builder.UnsafeAppend(passengers(rng));
+      if (valid(rng)) {
+        fare_builder.UnsafeAppend(fares(rng));
+      } else {
+        fare_builder.UnsafeAppendNull();
+      }
+    }
+    std::shared_ptr<arrow::Array> passenger_arr, fare_arr;
+    if (!passenger_builder.Finish(&passenger_arr).ok() ||
+        !fare_builder.Finish(&fare_arr).ok()) {
+      return nullptr;
+    }
+    batches.push_back(arrow::RecordBatch::Make(schema, kBatchRows,
+                                               {passenger_arr, fare_arr}));
+  }
+  return arrow::Table::FromRecordBatches(schema, batches).ValueOrDie();
+}
+
+std::shared_ptr<ds::Scanner> make_scanner(
+    const std::shared_ptr<arrow::Table>& table) {
+  auto dataset = std::make_shared<ds::InMemoryDataset>(table);
+  auto scan_builder = dataset->NewScan().ValueOrDie();
+  scan_builder->UseThreads(true);
+  scan_builder->BatchSize(kBatchRows);
+  return scan_builder->Finish().ValueOrDie();
+}
+
+double atomic_sum_count(ds::Scanner* scanner) {
+  std::atomic<int64_t> passengers(0), count(0);
+  auto status = scanner->Scan([&](ds::TaggedRecordBatch batch) {
+    ARROW_ASSIGN_OR_RAISE(
+        auto result,
+        cp::Sum(batch.record_batch->GetColumnByName("passenger_count")));
+    passengers += result.scalar_as<arrow::Int64Scalar>().value;
+    count += batch.record_batch->num_rows();
+    return arrow::Status::OK();
+  });
+  return status.ok() ? double(passengers.load()) / double(count.load()) : NAN;
+}
+
+double per_thread_sum_count(ds::Scanner* scanner) {
+  reduce::PerThread<reduce::SumCount> passengers;
+  auto status = scanner->Scan(passengers.Visitor(
+      [](reduce::SumCount& local, const arrow::RecordBatch& batch) {
+        return local.Update(*batch.GetColumnByName("passenger_count"));
+      }));
+  return status.ok() ? passengers.Merge().mean() : NAN;
+}
+
+reduce::Moments per_thread_moments(ds::Scanner* scanner) {
+  reduce::PerThread<reduce::Moments> fares;
+  auto status = scanner->Scan(fares.Visitor(
+      [](reduce::Moments& local, const arrow::RecordBatch& batch) {
+        return local.Update(*batch.GetColumnByName("fare_amount"));
+      }));
+  return status.ok() ? fares.Merge() : reduce::Moments{};
+}
+
+int main(int argc, char** argv) {
+  const std::string prefix = argc > 1 ? argv[1] : "reducer_bench";
+  auto table = make_trips();
+  if (table == nullptr) return 1;
+  auto scanner = make_scanner(table);
+
+  // the fare column through cp:: for comparison, with the nulls skipped
+  auto fares = table->GetColumnByName("fare_amount");
+  auto mean = cp::Mean(fares).ValueOrDie().scalar_as<arrow::DoubleScalar>();
+  auto variance = cp::Variance(fares, cp::VarianceOptions(/*ddof=*/1))
+                      .ValueOrDie()
+                      .scalar_as<arrow::DoubleScalar>();
+  auto moments = per_thread_moments(scanner.get());
+  std::cout << "fare_amount: count=" << moments.count
+            << " mean=" << moments.mean << " (cp::Mean " << mean.value
+            << ") variance=" << moments.variance() << " (cp::Variance "
+            << variance.value << ") min=" << moments.min
+            << " max=" << moments.max << std::endl;
+  // passenger_count has no nulls, so both means agree
+  std::cout << "passenger_count mean: atomics "
+            << atomic_sum_count(scanner.get()) << ", per thread "
+            << per_thread_sum_count(scanner.get()) << std::endl;
+
+  std::vector<int> thread_counts{1, 2, 4};
+  const int hw = static_cast<int>(std::thread::hardware_concurrency());
+  for (int t = 8; t <= hw; t *= 2) thread_counts.push_back(t);
+
+  bench::Options opts;
+  opts.trials = 10;
+  bench::Reporter reporter;
+  const int64_t column_bytes = kRows * 8;
+  for (int threads : thread_counts) {
+    if (!arrow::SetCpuThreadPoolCapacity(threads).ok()) return 1;
+    reporter.Add(bench::Run("atomic_sum_count", kRows, column_bytes, threads,
+                            opts, [&] {
+                              return atomic_sum_count(scanner.get());
+                            }));
+    reporter.Add(bench::Run("per_thread_sum_count", kRows, column_bytes,
+                            threads, opts, [&] {
+                              return per_thread_sum_count(scanner.get());
+                            }));
+    reporter.Add(bench::Run("per_thread_moments", kRows, column_bytes,
+                            threads, opts, [&] {
+                              return per_thread_moments(scanner.get()).m2;
+                            }));
+  }
+
+  if (!reporter.WriteJson(prefix + ".json") ||
+      !reporter.WriteCsv(prefix + ".csv")) {
+    std::cerr << "failed writing results to " << prefix << ".{json,csv}"
+              << std::endl;
+    return 1;
+  }
+}
@@ -23,9 +23,14 @@
 #include <arrow/api.h>
 #include <arrow/dataset/api.h>
 #include <arrow/filesystem/api.h>
-#include <atomic>
 #include <iostream>
 #include <memory>
+#include <string>
+#include "block_cache_fs.h"
+#include "dataset_manifest.h"
+#include "profiler.h"
+#include "reducer.h"
+#include "taxi_data.h"
 #include "timer.h"
 
 #define ABORT_ON_FAIL(expr)                        \
@@ -41,16 +46,35 @@ namespace fs = arrow::fs;
 namespace ds = arrow::dataset;
 namespace cp = arrow::compute;
 
-void timing_test() {
+// Where the taxi data lives: the public bucket, or with TAXI_DATA_DIR set
+// a local copy written by generate_taxi, so the timings can be reproduced
+// offline.
+struct TaxiSource {
+  std::shared_ptr<fs::FileSystem> filesystem;
+  std::string base_dir;
+  std::string manifest_path;
+  bool local;
+};
+
+TaxiSource taxi_source() {
+  const auto local_dir = taxidata::LocalDir();
+  if (!local_dir.empty()) {
+    return {std::make_shared<fs::LocalFileSystem>(), local_dir,
+            "taxi_manifest_local.arrow", true};
+  }
   auto opts = fs::S3Options::Anonymous();
   opts.region = "us-east-2";
+  return {fs::S3FileSystem::Make(opts).ValueOrDie(), "ursa-labs-taxi-data",
+          "taxi_manifest.arrow", false};
+}
 
+void timing_test() {
+  auto source = taxi_source();
   std::shared_ptr<ds::FileFormat> format =
       std::make_shared<ds::ParquetFileFormat>();
-  std::shared_ptr<fs::FileSystem> filesystem =
-      fs::S3FileSystem::Make(opts).ValueOrDie();
+  std::shared_ptr<fs::FileSystem> filesystem = source.filesystem;
   fs::FileSelector selector;
-  selector.base_dir = "ursa-labs-taxi-data";
+  selector.base_dir = source.base_dir;
   selector.recursive = true;  // check all the subdirectories
 
   std::shared_ptr<ds::DatasetFactory> factory;
@@ -58,6 +82,7 @@ void timing_test() {
 
   {
     timer t;
+    PROFILE_SCOPE("discovery");
     factory = ds::FileSystemDatasetFactory::Make(filesystem, selector, format,
                                                  ds::FileSystemFactoryOptions())
                   .ValueOrDie();
@@ -69,67 +94,100 @@ void timing_test() {
 
   {
     timer t;
+    PROFILE_SCOPE("count_rows");
+    std::cout << scanner->CountRows().ValueOrDie() << std::endl;
+  }
+
+  // the same dataset from a local manifest, listed and read only once
+  auto parquet_format = std::make_shared<ds::ParquetFileFormat>();
+  auto partitioning = std::make_shared<ds::DirectoryPartitioning>(
+      arrow::schema({arrow::field("year", arrow::int32()),
+                     arrow::field("month", arrow::int32())}));
+  {
+    timer t;
+    PROFILE_SCOPE("discovery_manifest");
+    dataset = manifest::OpenDataset(filesystem, selector.base_dir,
+                                    partitioning, parquet_format,
+                                    source.manifest_path)
+                  .ValueOrDie();
+  }
+  scanner = dataset->NewScan().ValueOrDie()->Finish().ValueOrDie();
+  {
+    timer t;
+    PROFILE_SCOPE("count_rows_manifest");
     std::cout << scanner->CountRows().ValueOrDie() << std::endl;
   }
 }
 
 void compute_mean() {
-  auto opts = fs::S3Options::Anonymous();
-  opts.region = "us-east-2";
-
+  auto source = taxi_source();
   std::shared_ptr<ds::FileFormat> format =
       std::make_shared<ds::ParquetFileFormat>();
+  // repeated runs read the column chunks from the local block cache; a
+  // local copy is read directly
+  blockcache::BlockCacheOptions cache_options;
+  cache_options.disk_dir = "taxi_block_cache";
+  auto cache = blockcache::BlockCache::Make(cache_options).ValueOrDie();
   std::shared_ptr<fs::FileSystem> filesystem =
-      fs::S3FileSystem::Make(opts).ValueOrDie();
+      source.local ? source.filesystem
+                   : std::make_shared<blockcache::CachingFileSystem>(
+                         source.filesystem, cache);
   fs::FileSelector selector;
-  selector.base_dir = "ursa-labs-taxi-data";
+  selector.base_dir = source.base_dir;
   selector.recursive = true;  // check all the subdirectories
 
   std::shared_ptr<ds::DatasetFactory> factory;
   std::shared_ptr<ds::Dataset> dataset;
 
+  {
+    PROFILE_SCOPE("discovery");
+    factory = ds::FileSystemDatasetFactory::Make(filesystem, selector, format,
+                                                 ds::FileSystemFactoryOptions())
+                  .ValueOrDie();
+    dataset = factory->Finish().ValueOrDie();
+  }
+
   {
     timer t;
+    PROFILE_SCOPE("compute_mean");
     auto scan_builder = dataset->NewScan().ValueOrDie();
     scan_builder->BatchSize(1 << 28);  // default is 1 << 20
     scan_builder->UseThreads(true);
     scan_builder->Project({"passenger_count"});
     auto scanner = scan_builder->Finish().ValueOrDie();
-    std::atomic<int64_t> passengers(0), count(0);
-    ABORT_ON_FAIL(
-        scanner->Scan([&](ds::TaggedRecordBatch batch) -> arrow::Status {
-          ARROW_ASSIGN_OR_RAISE(
-              auto result,
-              cp::Sum(batch.record_batch->GetColumnByName("passenger_count")));
-          passengers += result.scalar_as<arrow::Int64Scalar>().value;
-          count += batch.record_batch->num_rows();
-          return arrow::Status::OK();
-        }));
-    double mean = double(passengers.load()) / double(count.load());
-    std::cout << mean << std::endl;
+    // each scan thread sums into its own accumulator, merged at the end
+    reduce::PerThread<reduce::SumCount> passengers;
+    ABORT_ON_FAIL(scanner->Scan(passengers.Visitor(
+        [](reduce::SumCount& local, const arrow::RecordBatch& batch) {
+          PROFILE_SCOPE("aggregate");
+          return local.Update(*batch.GetColumnByName("passenger_count"));
+        })));
+    std::cout << passengers.Merge().mean() << std::endl;
   }  // end of the timer block
+  if (!source.local) cache->stats().Print();
 }
 
 void scan_fragments() {
-  auto opts = fs::S3Options::Anonymous();
-  opts.region = "us-east-2";
-
+  auto source = taxi_source();
   std::shared_ptr<ds::FileFormat> format =
       std::make_shared<ds::ParquetFileFormat>();
-  std::shared_ptr<fs::FileSystem> filesystem =
-      fs::S3FileSystem::Make(opts).ValueOrDie();
+  std::shared_ptr<fs::FileSystem> filesystem = source.filesystem;
   fs::FileSelector selector;
-  selector.base_dir = "ursa-labs-taxi-data";
+  selector.base_dir = source.base_dir;
   selector.recursive = true;  // check all the subdirectories
 
   ds::FileSystemFactoryOptions options;
   options.partitioning =
       ds::DirectoryPartitioning::MakeFactory({"year", "month"});
 
-  auto factory =
-      ds::FileSystemDatasetFactory::Make(filesystem, selector, format, options)
-          .ValueOrDie();
-  auto dataset = factory->Finish().ValueOrDie();
+  std::shared_ptr<ds::Dataset> dataset;
+  {
+    PROFILE_SCOPE("discovery");
+    auto factory = ds::FileSystemDatasetFactory::Make(filesystem, selector,
+                                                      format, options)
+                       .ValueOrDie();
+    dataset = factory->Finish().ValueOrDie();
+  }
   auto fragments = dataset->GetFragments().ValueOrDie();
 
   for (const auto& fragment : fragments) {
@@ -146,4 +204,9 @@ int main(int argc, char** argv) {
   timing_test();
   compute_mean();
   scan_fragments();
+
+  // open in chrome://tracing or ui.perfetto.dev to see the timeline
+  auto& profiler = prof::Profiler::Instance();
+  profiler.PrintSummary();
+  profiler.WriteChromeTrace("s3_datasets_trace.json");
 }
\ No newline at end of file
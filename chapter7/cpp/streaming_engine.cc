@@ -32,35 +32,64 @@
 #include <signal.h>
 #include <iostream>
 #include <memory>
+#include <unordered_set>
+#include "arena_pool.h"
+#include "block_cache_fs.h"
+#include "dataset_manifest.h"
+#include "dictionary_group_by.h"
+#include "plan_optimizer.h"
+#include "prepared_query.h"
+#include "profiler.h"
+#include "taxi_data.h"
 #include "timer.h"
+#include "trace_node.h"
 
 namespace fs = arrow::fs;
 namespace ds = arrow::dataset;
 namespace cp = arrow::compute;
 
-arrow::Result<std::shared_ptr<ds::Dataset>> create_dataset() {
+std::shared_ptr<blockcache::BlockCache> taxi_block_cache() {
+  static auto cache = [] {
+    blockcache::BlockCacheOptions options;
+    options.memory_capacity = int64_t(1) << 30;
+    options.disk_dir = "taxi_block_cache";
+    return blockcache::BlockCache::Make(options).ValueOrDie();
+  }();
+  return cache;
+}
+
+// columns named in dict_columns are read from Parquet as dictionary arrays.
+// The listing and footers are kept in a local manifest after the first run.
+arrow::Result<std::shared_ptr<ds::Dataset>> create_dataset(
+    const std::unordered_set<std::string>& dict_columns = {}) {
+  PROFILE_SCOPE("discovery");
+  auto parquet_format = std::make_shared<ds::ParquetFileFormat>();
+  parquet_format->reader_options.dict_columns = dict_columns;
+  auto partitioning = std::make_shared<ds::DirectoryPartitioning>(
+      arrow::schema({arrow::field("year", arrow::int32()),
+                     arrow::field("month", arrow::int32())}));
+
+  // TAXI_DATA_DIR points at a copy written by generate_taxi
+  const auto local_dir = taxidata::LocalDir();
+  if (!local_dir.empty()) {
+    return manifest::OpenDataset(std::make_shared<fs::LocalFileSystem>(),
+                                 local_dir, std::move(partitioning),
+                                 parquet_format, "taxi_manifest_local.arrow");
+  }
+
   auto opts = fs::S3Options::Anonymous();
   opts.region = "us-east-2";
-
-  std::shared_ptr<ds::FileFormat> format =
-      std::make_shared<ds::ParquetFileFormat>();
+  // byte ranges read on earlier runs come from the local block cache
   std::shared_ptr<fs::FileSystem> filesystem =
-      fs::S3FileSystem::Make(opts).ValueOrDie();
-  fs::FileSelector selector;
-  selector.base_dir = "ursa-labs-taxi-data";
-  selector.recursive = true;  // check all the subdirectories
-
-  ds::FileSystemFactoryOptions options;
-  options.partitioning =
-      ds::DirectoryPartitioning::MakeFactory({"year", "month"});
-  ARROW_ASSIGN_OR_RAISE(auto factory,
-                        ds::FileSystemDatasetFactory::Make(filesystem, selector,
-                                                           format, options));
-
-  return factory->Finish();
+      std::make_shared<blockcache::CachingFileSystem>(
+          fs::S3FileSystem::Make(opts).ValueOrDie(), taxi_block_cache());
+  return manifest::OpenDataset(filesystem, "ursa-labs-taxi-data",
+                               std::move(partitioning), parquet_format,
+                               "taxi_manifest.arrow");
 }
 
 arrow::Status calc_mean(std::shared_ptr<ds::Dataset> dataset) {
+  PROFILE_SCOPE("calc_mean");
   auto ctx = cp::default_exec_context();
 
   auto options = std::make_shared<ds::ScanOptions>();
@@ -82,6 +111,7 @@ arrow::Status calc_mean(std::shared_ptr<ds::Dataset> dataset) {
   ARROW_RETURN_NOT_OK(
       cp::Declaration::Sequence(
           {{"scan", scan_node_options},
+           {"trace", TraceNodeOptions{"aggregate"}},
            {"aggregate", cp::AggregateNodeOptions{{{"mean", nullptr}},
                                                   {"passenger_count"},
                                                   {"mean(passenger_count)"}}},
@@ -92,6 +122,7 @@ arrow::Status calc_mean(std::shared_ptr<ds::Dataset> dataset) {
 
   {
     timer t;
+    PROFILE_SCOPE("execute");
     ARROW_RETURN_NOT_OK(plan->StartProducing());
     auto maybe_slow_mean = sink_gen().result();
     plan->finished().Wait();
@@ -103,6 +134,7 @@ arrow::Status calc_mean(std::shared_ptr<ds::Dataset> dataset) {
 }
 
 arrow::Status grouped_mean(std::shared_ptr<ds::Dataset> dataset) {
+  PROFILE_SCOPE("grouped_mean");
   auto ctx = cp::default_exec_context();
 
   auto options = std::make_shared<ds::ScanOptions>();
@@ -124,6 +156,7 @@ arrow::Status grouped_mean(std::shared_ptr<ds::Dataset> dataset) {
   ARROW_RETURN_NOT_OK(
       cp::Declaration::Sequence(
           {{"scan", scan_node_options},
+           {"trace", TraceNodeOptions{"aggregate"}},
            {"aggregate", cp::AggregateNodeOptions{{{"hash_mean", nullptr}},
                                                   {"passenger_count"},
                                                   {"mean(passenger_count)"},
@@ -142,6 +175,7 @@ arrow::Status grouped_mean(std::shared_ptr<ds::Dataset> dataset) {
   std::shared_ptr<arrow::Table> response_table;
   {
     timer t;
+    PROFILE_SCOPE("execute");
     ARROW_RETURN_NOT_OK(plan->StartProducing());
     ARROW_ASSIGN_OR_RAISE(
         response_table, arrow::Table::FromRecordBatchReader(sink_reader.get()));
@@ -152,11 +186,67 @@ arrow::Status grouped_mean(std::shared_ptr<ds::Dataset> dataset) {
   return future.status();
 }
 
-arrow::Status grouped_filtered_mean(std::shared_ptr<ds::Dataset> dataset) {
+// grouped_mean on a dataset created with vendor_id as a dict_column, with
+// the aggregate node replaced by the dictionary-indexed group by
+arrow::Status grouped_mean_dictionary(std::shared_ptr<ds::Dataset> dataset) {
+  PROFILE_SCOPE("grouped_mean_dictionary");
   auto ctx = cp::default_exec_context();
 
   auto options = std::make_shared<ds::ScanOptions>();
   options->use_threads = true;
+  ARROW_ASSIGN_OR_RAISE(auto projection, ds::ProjectionDescr::FromNames(
+                                             {"vendor_id", "passenger_count"},
+                                             *dataset->schema()));
+  ds::SetProjection(options.get(), projection);
+
+  arrow::util::BackpressureOptions backpressure =
+      arrow::util::BackpressureOptions::Make(ds::kDefaultBackpressureLow,
+                                             ds::kDefaultBackpressureHigh);
+
+  auto scan_node_options =
+      ds::ScanNodeOptions{dataset, options, backpressure.toggle};
+
+  auto group_by = std::make_shared<DictionaryGroupedMean>("vendor_id",
+                                                          "passenger_count");
+  ARROW_ASSIGN_OR_RAISE(auto plan, cp::ExecPlan::Make(ctx));
+  ARROW_RETURN_NOT_OK(
+      cp::Declaration::Sequence(
+          {{"scan", scan_node_options},
+           // pin the key and value to the first two columns of each batch
+           {"project",
+            cp::ProjectNodeOptions{{cp::field_ref("vendor_id"),
+                                    cp::field_ref("passenger_count")},
+                                   {"vendor_id", "passenger_count"}}},
+           {"consuming_sink", cp::ConsumingSinkNodeOptions{group_by}}})
+          .AddToPlan(plan.get()));
+  ARROW_RETURN_NOT_OK(plan->Validate());
+
+  {
+    timer t;
+    PROFILE_SCOPE("execute");
+    ARROW_RETURN_NOT_OK(plan->StartProducing());
+    ARROW_RETURN_NOT_OK(plan->finished().status());
+  }
+  ARROW_ASSIGN_OR_RAISE(auto response_table, group_by->result());
+  std::cout << "Results: " << response_table->ToString() << std::endl;
+  std::cout << group_by->dense_batches() << " batches grouped on dictionary "
+            << "indices, " << group_by->hashed_batches() << " hashed"
+            << std::endl;
+  return arrow::Status::OK();
+}
+
+arrow::Status grouped_filtered_mean(std::shared_ptr<ds::Dataset> dataset) {
+  PROFILE_SCOPE("grouped_filtered_mean");
+  // the scan, the plan and the result all allocate from an arena made for
+  // this query; declared first, it goes last, in one piece
+  arena::ArenaMemoryPool query_pool;
+  cp::ExecContext query_ctx(&query_pool,
+                            cp::default_exec_context()->executor());
+  auto ctx = &query_ctx;
+
+  auto options = std::make_shared<ds::ScanOptions>();
+  options->use_threads = true;
+  options->pool = &query_pool;
   options->filter = cp::greater(cp::field_ref("year"), cp::literal(2015));
   ARROW_ASSIGN_OR_RAISE(auto projection,
                         ds::ProjectionDescr::FromNames(
@@ -172,20 +262,30 @@ arrow::Status grouped_filtered_mean(std::shared_ptr<ds::Dataset> dataset) {
 
   arrow::AsyncGenerator<arrow::util::optional<cp::ExecBatch>> sink_gen;
   ARROW_ASSIGN_OR_RAISE(auto plan, cp::ExecPlan::Make(ctx));
-  ARROW_RETURN_NOT_OK(
-      cp::Declaration::Sequence(
-          {{"scan", scan_node_options},
-           {"filter", cp::FilterNodeOptions{cp::greater(cp::field_ref("year"),
-                                                        cp::literal(2015))}},
-           {"project", cp::ProjectNodeOptions{{cp::field_ref("passenger_count"),
-                                               cp::field_ref("year")},
-                                              {"passenger_count", "year"}}},
-           {"aggregate", cp::AggregateNodeOptions{{{"hash_mean", nullptr}},
-                                                  {"passenger_count"},
-                                                  {"mean(passenger_count)"},
-                                                  {"year"}}},
-           {"sink", cp::SinkNodeOptions{&sink_gen, std::move(backpressure)}}})
-          .AddToPlan(plan.get()));
+  // the filter repeats the partition pruning done by the scan and the
+  // project only selects what the aggregate already refers to by name, the
+  // optimizer drops both
+  auto declaration = cp::Declaration::Sequence(
+      {{"scan", scan_node_options},
+       {"trace", TraceNodeOptions{"filter"}},
+       {"filter", cp::FilterNodeOptions{
+                      cp::greater(cp::field_ref("year"), cp::literal(2015))}},
+       {"project", cp::ProjectNodeOptions{{cp::field_ref("passenger_count"),
+                                           cp::field_ref("year")},
+                                          {"passenger_count", "year"}}},
+       {"trace", TraceNodeOptions{"aggregate"}},
+       {"aggregate", cp::AggregateNodeOptions{{{"hash_mean", nullptr}},
+                                              {"passenger_count"},
+                                              {"mean(passenger_count)"},
+                                              {"year"}}},
+       {"sink", cp::SinkNodeOptions{&sink_gen, std::move(backpressure)}}});
+  optimizer::OptimizerReport report;
+  {
+    PROFILE_SCOPE("optimize");
+    ARROW_RETURN_NOT_OK(optimizer::OptimizePlan(&declaration, &report));
+  }
+  report.Print();
+  ARROW_RETURN_NOT_OK(declaration.AddToPlan(plan.get()));
 
   auto schema =
       arrow::schema({arrow::field("mean(passenger_count)", arrow::float64()),
@@ -198,16 +298,48 @@ arrow::Status grouped_filtered_mean(std::shared_ptr<ds::Dataset> dataset) {
   std::shared_ptr<arrow::Table> response_table;
   {
     timer t;
+    PROFILE_SCOPE("execute");
     ARROW_RETURN_NOT_OK(plan->StartProducing());
     ARROW_ASSIGN_OR_RAISE(
         response_table, arrow::Table::FromRecordBatchReader(sink_reader.get()));
   }
   std::cout << "Results: " << response_table->ToString() << std::endl;
+  std::cout << "query arena peak: " << query_pool.max_memory() << " bytes, "
+            << query_pool.reserved_bytes() << " reserved" << std::endl;
   plan->StopProducing();
   auto future = plan->finished();
   return future.status();
 }
 
+arrow::Status prepared_grouped_filtered_mean(
+    std::shared_ptr<ds::Dataset> dataset) {
+  PROFILE_SCOPE("prepared_grouped_filtered_mean");
+  // grouped_filtered_mean with the year as a parameter, planned once
+  prepared::AggregateQuery query;
+  query.columns = {"passenger_count", "year"};
+  query.filter =
+      cp::greater(cp::field_ref("year"), prepared::param("min_year"));
+  query.aggregate = cp::AggregateNodeOptions{{{"hash_mean", nullptr}},
+                                             {"passenger_count"},
+                                             {"mean(passenger_count)"},
+                                             {"year"}};
+  ARROW_ASSIGN_OR_RAISE(
+      auto prepared_query,
+      prepared::PreparedQuery::Prepare(dataset, std::move(query),
+                                       {{"min_year", arrow::Datum{2015}}}));
+
+  for (int32_t year = 2015; year <= 2018; ++year) {
+    PROFILE_SCOPE("execute");
+    ARROW_ASSIGN_OR_RAISE(
+        auto response_table,
+        prepared_query->Execute({{"min_year", arrow::Datum{year}}}));
+    std::cout << "year > " << year << ": " << response_table->ToString()
+              << std::endl;
+  }
+  prepared_query->PrintStats();
+  return arrow::Status::OK();
+}
+
 int main(int argc, char** argv) {
   // ignore SIGPIPE errors during S3 communication
   // so we don't randomly blow up and die
@@ -217,8 +349,25 @@ int main(int argc, char** argv) {
   auto dataset = create_dataset().ValueOrDie();
 
   ds::internal::Initialize();
-  auto status = grouped_filtered_mean(dataset);
+  auto status = RegisterTraceNode();
+  if (status.ok()) {
+    status = grouped_filtered_mean(dataset);
+  }
+  if (status.ok()) {
+    status = prepared_grouped_filtered_mean(dataset);
+  }
+  if (status.ok()) {
+    auto dict_dataset = create_dataset({"vendor_id"});
+    status = dict_dataset.ok() ? grouped_mean_dictionary(*dict_dataset)
+                               : dict_dataset.status();
+  }
   if (!status.ok()) {
     std::cerr << status.message() << std::endl;
   }
+
+  // open in chrome://tracing or ui.perfetto.dev to see the timeline
+  auto& profiler = prof::Profiler::Instance();
+  profiler.PrintSummary();
+  taxi_block_cache()->stats().Print();
+  profiler.WriteChromeTrace("streaming_engine_trace.json");
 }
\ No newline at end of file
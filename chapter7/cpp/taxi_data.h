@@ -0,0 +1,155 @@
+// MIT License
+//
+// Copyright (c) 2021 Packt
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <arrow/api.h>
+#include <arrow/filesystem/api.h>
+#include <parquet/arrow/writer.h>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+#include "datagen.h"
+
+// A local stand-in for s3://ursa-labs-taxi-data: same schema, same
+// year/month/data.parquet layout, generated by datagen so benchmarks can run
+// offline and give the same data every time. Value ranges are roughly those
+// of the real trips, but the columns are independent of each other (a
+// dropoff can come before its pickup), so use it for timing, not answers.
+namespace taxidata {
+
+// directory of a generated copy to use instead of S3, from TAXI_DATA_DIR;
+// empty when unset
+inline std::string LocalDir() {
+  const char* dir = std::getenv("TAXI_DATA_DIR");
+  return dir ? dir : "";
+}
+
+// microseconds since the epoch at midnight on the first of the month
+inline int64_t MonthStartMicros(int year, int month) {
+  // days_from_civil, see http://howardhinnant.github.io/date_algorithms.html
+  year -= month <= 2;
+  const int era = (year >= 0 ? year : year - 399) / 400;
+  const int yoe = year - era * 400;
+  const int doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5;
+  const int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  const int64_t days = int64_t(era) * 146097 + doe - 719468;
+  return days * 86400 * 1000000;
+}
+
+inline std::vector<datagen::ColumnSpec> Columns(int year, int month) {
+  using datagen::kNormal;
+  using datagen::kSkewed;
+  using datagen::kUniform;
+  const double start = MonthStartMicros(year, month);
+  const double end = month == 12 ? MonthStartMicros(year + 1, 1)
+                                 : MonthStartMicros(year, month + 1);
+  auto ts = arrow::timestamp(arrow::TimeUnit::MICRO);
+
+  datagen::ColumnSpec vendor{"vendor_id", arrow::utf8()};
+  vendor.values = {"CMT", "DDS", "VTS"};
+  datagen::ColumnSpec pickup{"pickup_at", ts, kUniform, start, end};
+  // files are close to, but not quite, in time order
+  pickup.sortedness = 0.9;
+  datagen::ColumnSpec dropoff{"dropoff_at", ts, kUniform, start, end};
+  datagen::ColumnSpec passengers{"passenger_count", arrow::int8(), kSkewed,
+                                 1, 6};
+  passengers.cardinality = 6;
+  datagen::ColumnSpec distance{"trip_distance", arrow::float32(), kSkewed,
+                               0, 30};
+  datagen::ColumnSpec rate_code{"rate_code_id", arrow::utf8()};
+  rate_code.values = {"1", "2", "3", "4", "5", "6"};
+  rate_code.distribution = kSkewed;
+  rate_code.null_rate = 0.3;
+  datagen::ColumnSpec store{"store_and_fwd_flag", arrow::utf8()};
+  store.values = {"N", "Y"};
+  store.distribution = kSkewed;
+  store.skew = 20;
+  datagen::ColumnSpec payment{"payment_type", arrow::utf8()};
+  payment.values = {"CRD", "CSH", "DIS", "NOC", "UNK"};
+  payment.distribution = kSkewed;
+  datagen::ColumnSpec fare{"fare_amount", arrow::float32(), kNormal, 12.5, 8};
+  datagen::ColumnSpec extra{"extra", arrow::float32(), kUniform, 0, 1};
+  extra.cardinality = 3;
+  datagen::ColumnSpec mta{"mta_tax", arrow::float32(), kUniform, 0.5, 0.5};
+  datagen::ColumnSpec tip{"tip_amount", arrow::float32(), kSkewed, 0, 20};
+  datagen::ColumnSpec tolls{"tolls_amount", arrow::float32(), kSkewed, 0, 15};
+  tolls.skew = 12;
+  datagen::ColumnSpec total{"total_amount", arrow::float32(), kNormal, 16, 10};
+
+  return {vendor,
+          pickup,
+          dropoff,
+          passengers,
+          distance,
+          {"pickup_longitude", arrow::float64(), kNormal, -73.97, 0.04},
+          {"pickup_latitude", arrow::float64(), kNormal, 40.75, 0.03},
+          rate_code,
+          store,
+          {"dropoff_longitude", arrow::float64(), kNormal, -73.97, 0.04},
+          {"dropoff_latitude", arrow::float64(), kNormal, 40.75, 0.03},
+          payment,
+          fare,
+          extra,
+          mta,
+          tip,
+          tolls,
+          total};
+}
+
+struct GenerateOptions {
+  int first_year = 2009, last_year = 2019;
+  int64_t rows_per_month = 1 << 20;
+  int64_t batch_rows = 1 << 16;
+  int64_t row_group_rows = 1 << 20;
+  uint64_t seed = 42;
+};
+
+// writes base_dir/<year>/<month>/data.parquet for every month in range;
+// each month has its own seed, so a single month can be regenerated alone
+inline arrow::Status Generate(const std::shared_ptr<arrow::fs::FileSystem>& fs,
+                              const std::string& base_dir,
+                              const GenerateOptions& options) {
+  for (int year = options.first_year; year <= options.last_year; ++year) {
+    for (int month = 1; month <= 12; ++month) {
+      datagen::Generator gen(Columns(year, month),
+                             options.seed ^ uint64_t(year * 12 + month));
+      ARROW_ASSIGN_OR_RAISE(auto table, gen.MakeTable(options.rows_per_month,
+                                                      options.batch_rows));
+      // months are zero padded in the bucket, 2009/01/data.parquet
+      const std::string dir = base_dir + "/" + std::to_string(year) + "/" +
+                              (month < 10 ? "0" : "") + std::to_string(month);
+      ARROW_RETURN_NOT_OK(fs->CreateDir(dir));
+      ARROW_ASSIGN_OR_RAISE(auto output,
+                            fs->OpenOutputStream(dir + "/data.parquet"));
+      ARROW_RETURN_NOT_OK(parquet::arrow::WriteTable(
+          *table, arrow::default_memory_pool(), output,
+          options.row_group_rows));
+      ARROW_RETURN_NOT_OK(output->Close());
+    }
+  }
+  return arrow::Status::OK();
+}
+
+}  // namespace taxidata
@@ -0,0 +1,90 @@
+// MIT License
+//
+// Copyright (c) 2021 Packt
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <arrow/compute/exec/exec_plan.h>
+#include <arrow/compute/exec/options.h>
+#include <arrow/util/checked_cast.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "profiler.h"
+
+// A pass-through ExecNode which records a profiler span around handing each
+// batch to the next node. Batches are pushed downstream synchronously, so
+// the span covers all of the work done by the nodes after it on that thread:
+//
+//   scan -> trace("filter") -> filter -> trace("aggregate") -> aggregate
+//
+// shows the aggregate spans nested inside the filter spans on whichever
+// thread pool threads delivered the batches.
+struct TraceNodeOptions : public arrow::compute::ExecNodeOptions {
+  explicit TraceNodeOptions(std::string phase) : phase(std::move(phase)) {}
+
+  std::string phase;
+};
+
+class TraceNode : public arrow::compute::MapNode {
+ public:
+  TraceNode(arrow::compute::ExecPlan* plan,
+            std::vector<arrow::compute::ExecNode*> inputs,
+            std::shared_ptr<arrow::Schema> output_schema, const char* phase)
+      : MapNode(plan, std::move(inputs), std::move(output_schema),
+                /*async_mode=*/false),
+        phase_(phase) {}
+
+  static arrow::Result<arrow::compute::ExecNode*> Make(
+      arrow::compute::ExecPlan* plan,
+      std::vector<arrow::compute::ExecNode*> inputs,
+      const arrow::compute::ExecNodeOptions& options) {
+    if (inputs.size() != 1) {
+      return arrow::Status::Invalid("TraceNode requires exactly one input");
+    }
+    const auto& trace_options =
+        arrow::internal::checked_cast<const TraceNodeOptions&>(options);
+    auto schema = inputs[0]->output_schema();
+    return plan->EmplaceNode<TraceNode>(
+        plan, std::move(inputs), std::move(schema),
+        prof::Profiler::Instance().Intern(trace_options.phase));
+  }
+
+  const char* kind_name() const override { return "TraceNode"; }
+
+  void InputReceived(arrow::compute::ExecNode* input,
+                     arrow::compute::ExecBatch batch) override {
+    prof::ScopedSpan span{phase_};
+    SubmitTask(
+        [](arrow::compute::ExecBatch batch)
+            -> arrow::Result<arrow::compute::ExecBatch> { return batch; },
+        std::move(batch));
+  }
+
+ private:
+  const char* phase_;
+};
+
+// make "trace" available to Declarations, call once before building plans
+inline arrow::Status RegisterTraceNode() {
+  return arrow::compute::default_exec_factory_registry()->AddFactory(
+      "trace", TraceNode::Make);
+}
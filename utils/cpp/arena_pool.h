@@ -0,0 +1,349 @@
+// MIT License
+//
+// Copyright (c) 2021 Packt
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <arrow/api.h>
+#include <arrow/util/config.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// A MemoryPool for a single query. Small allocations are carved out of
+// large chunks by a bump pointer private to the allocating thread, freed
+// blocks go on per-thread free lists by power-of-two size class and are
+// reused by the next allocation of that class, and all the chunks go back
+// to the backing pool together when the arena is destroyed or Release()d.
+// A query's short-lived per-batch buffers then never reach the global heap
+// one at a time, and can't leave it fragmented when the query is over.
+// Allocations above max_class_bytes go straight to the backing pool.
+//
+//   arena::ArenaMemoryPool pool;
+//   cp::ExecContext ctx(&pool);        // kernels and exec plans
+//   scan_options->pool = &pool;        // dataset scans
+//   parquet::arrow::OpenFile(input, &pool, &reader);  // ReadTable
+//
+// Like any pool, it has to outlive every buffer allocated from it; unlike
+// most, nothing is returned to the system until then, so it suits queries,
+// not long-running services. A block is reused by the thread that frees
+// it, so a pipeline where one thread only allocates and another only frees
+// keeps taking new chunks for as long as the query runs.
+namespace arena {
+
+struct ArenaOptions {
+  int64_t chunk_bytes = int64_t(4) << 20;
+  int64_t max_class_bytes = int64_t(256) << 10;  // a power of two
+  arrow::MemoryPool* backing = arrow::system_memory_pool();
+};
+
+class ArenaMemoryPool : public arrow::MemoryPool {
+ public:
+  static constexpr int64_t kAlignment = 64;
+  static constexpr int kMinClassShift = 6;  // 64 bytes, one cache line
+  static constexpr int kMaxClasses = 24;
+
+  explicit ArenaMemoryPool(ArenaOptions options = {})
+      : options_(options), epoch_(NextEpoch()) {
+    int num_classes = 1;
+    while (num_classes < kMaxClasses &&
+           (int64_t(1) << (kMinClassShift + num_classes)) <=
+               options_.max_class_bytes) {
+      ++num_classes;
+    }
+    options_.max_class_bytes = int64_t(1) << (kMinClassShift + num_classes - 1);
+    options_.chunk_bytes =
+        std::max(options_.chunk_bytes, options_.max_class_bytes);
+  }
+
+  // Buffers still alive would point into freed chunks, so if there are any
+  // the chunks are leaked instead, and said so: the pool was dropped before
+  // something it allocated, a table kept past the end of its query say.
+  ~ArenaMemoryPool() override {
+    if (bytes_allocated() != 0) {
+      std::cerr << "ArenaMemoryPool destroyed with " << bytes_allocated()
+                << " bytes still in use, leaking " << reserved_bytes()
+                << " bytes" << std::endl;
+      return;
+    }
+    ReleaseAll();
+  }
+
+#if ARROW_VERSION_MAJOR >= 11
+  arrow::Status Allocate(int64_t size, int64_t alignment,
+                         uint8_t** out) override {
+    ARROW_RETURN_NOT_OK(CheckAlignment(alignment));
+    return Allocate(size, out);
+  }
+
+  arrow::Status Reallocate(int64_t old_size, int64_t new_size,
+                           int64_t alignment, uint8_t** ptr) override {
+    ARROW_RETURN_NOT_OK(CheckAlignment(alignment));
+    return Reallocate(old_size, new_size, ptr);
+  }
+
+  void Free(uint8_t* buffer, int64_t size, int64_t alignment) override {
+    Free(buffer, size);
+  }
+
+  arrow::Status Allocate(int64_t size, uint8_t** out) {
+#else
+  arrow::Status Allocate(int64_t size, uint8_t** out) override {
+#endif
+    if (size < 0) return arrow::Status::Invalid("negative allocation size");
+    if (size == 0) {
+      *out = ZeroSizeArea();
+      return arrow::Status::OK();
+    }
+    const int c = ClassOf(size);
+    if (c < 0) {
+      ARROW_RETURN_NOT_OK(options_.backing->Allocate(size, out));
+      large_bytes_.fetch_add(size, std::memory_order_relaxed);
+    } else {
+      ARROW_ASSIGN_OR_RAISE(*out, AllocateSmall(c));
+    }
+    num_allocations_.fetch_add(1, std::memory_order_relaxed);
+    Track(size);
+    return arrow::Status::OK();
+  }
+
+#if ARROW_VERSION_MAJOR >= 11
+  arrow::Status Reallocate(int64_t old_size, int64_t new_size, uint8_t** ptr) {
+#else
+  arrow::Status Reallocate(int64_t old_size, int64_t new_size,
+                           uint8_t** ptr) override {
+#endif
+    if (new_size < 0) return arrow::Status::Invalid("negative allocation size");
+    const int old_class = old_size == 0 ? -2 : ClassOf(old_size);
+    const int new_class = new_size == 0 ? -2 : ClassOf(new_size);
+    if (old_class == -1 && new_class == -1) {
+      ARROW_RETURN_NOT_OK(
+          options_.backing->Reallocate(old_size, new_size, ptr));
+      large_bytes_.fetch_add(new_size - old_size, std::memory_order_relaxed);
+      Track(new_size - old_size);
+      return arrow::Status::OK();
+    }
+    if (old_class >= 0 && old_class == new_class) {
+      // still fits the block it has
+      Track(new_size - old_size);
+      return arrow::Status::OK();
+    }
+    uint8_t* moved;
+    ARROW_RETURN_NOT_OK(Allocate(new_size, &moved));
+    if (old_size > 0 && new_size > 0) {
+      std::memcpy(moved, *ptr, std::min(old_size, new_size));
+    }
+    Free(*ptr, old_size);
+    *ptr = moved;
+    return arrow::Status::OK();
+  }
+
+#if ARROW_VERSION_MAJOR >= 11
+  void Free(uint8_t* buffer, int64_t size) {
+#else
+  void Free(uint8_t* buffer, int64_t size) override {
+#endif
+    if (size == 0) return;
+    const int c = ClassOf(size);
+    if (c < 0) {
+      options_.backing->Free(buffer, size);
+      large_bytes_.fetch_sub(size, std::memory_order_relaxed);
+    } else {
+      // onto the freeing thread's list, whichever thread allocated it; the
+      // arena owns every chunk, so blocks can move between threads freely
+      auto* block = reinterpret_cast<FreeBlock*>(buffer);
+      Shard* shard = LocalShard();
+      block->next = shard->free[c];
+      shard->free[c] = block;
+    }
+    Track(-size);
+  }
+
+  // live bytes, as requested by callers
+  int64_t bytes_allocated() const override {
+    return bytes_allocated_.load(std::memory_order_relaxed);
+  }
+
+  int64_t max_memory() const override {
+    return max_memory_.load(std::memory_order_relaxed);
+  }
+
+#if ARROW_VERSION_MAJOR >= 13
+  int64_t total_bytes_allocated() const override {
+    return total_bytes_allocated_.load(std::memory_order_relaxed);
+  }
+
+  int64_t num_allocations() const override {
+    return num_allocations_.load(std::memory_order_relaxed);
+  }
+#endif
+
+  std::string backend_name() const override {
+    return "arena(" + options_.backing->backend_name() + ")";
+  }
+
+  // bytes held from the backing pool: every chunk plus live large
+  // allocations
+  int64_t reserved_bytes() const {
+    return chunk_bytes_.load(std::memory_order_relaxed) +
+           large_bytes_.load(std::memory_order_relaxed);
+  }
+
+  // Hands every chunk back to the backing pool so the arena can serve the
+  // next query. Fails while anything allocated from it is still alive;
+  // no other thread may be using the pool meanwhile.
+  arrow::Status Release() {
+    if (bytes_allocated() != 0) {
+      return arrow::Status::Invalid("arena still has ", bytes_allocated(),
+                                    " bytes in use");
+    }
+    ReleaseAll();
+    max_memory_ = 0;
+    return arrow::Status::OK();
+  }
+
+ private:
+  struct FreeBlock {
+    FreeBlock* next;
+  };
+
+  // what one thread allocates from; only that thread touches it
+  struct Shard {
+    uint8_t* cursor = nullptr;
+    uint8_t* end = nullptr;
+    std::vector<uint8_t*> chunks;
+    std::array<FreeBlock*, kMaxClasses> free{};
+  };
+
+  static uint64_t NextEpoch() {
+    static std::atomic<uint64_t> next{1};
+    return next.fetch_add(1);
+  }
+
+  static uint8_t* ZeroSizeArea() {
+    alignas(kAlignment) static uint8_t zero_size_area[1];
+    return zero_size_area;
+  }
+
+  static arrow::Status CheckAlignment(int64_t alignment) {
+    if (alignment > kAlignment || kAlignment % alignment != 0) {
+      return arrow::Status::NotImplemented("arena alignment is ", kAlignment,
+                                           ", asked for ", alignment);
+    }
+    return arrow::Status::OK();
+  }
+
+  // size class of an allocation, -1 above max_class_bytes
+  int ClassOf(int64_t size) const {
+    if (size > options_.max_class_bytes) return -1;
+    int c = 0;
+    while ((int64_t(1) << (kMinClassShift + c)) < size) ++c;
+    return c;
+  }
+
+  void Track(int64_t delta) {
+    const int64_t now =
+        bytes_allocated_.fetch_add(delta, std::memory_order_relaxed) + delta;
+    if (delta > 0) {
+      total_bytes_allocated_.fetch_add(delta, std::memory_order_relaxed);
+    }
+    int64_t peak = max_memory_.load(std::memory_order_relaxed);
+    while (now > peak &&
+           !max_memory_.compare_exchange_weak(peak, now,
+                                              std::memory_order_relaxed)) {
+    }
+  }
+
+  // the calling thread's shard, remembered per thread for the last arena
+  // it used, so the lock is only taken when a thread switches arenas
+  Shard* LocalShard() {
+    struct Cache {
+      uint64_t epoch = 0;
+      Shard* shard = nullptr;
+    };
+    static thread_local Cache cache;
+    const uint64_t epoch = epoch_.load(std::memory_order_acquire);
+    if (cache.epoch == epoch) return cache.shard;
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& shard = shards_[std::this_thread::get_id()];
+    if (!shard) shard.reset(new Shard);
+    cache = {epoch, shard.get()};
+    return shard.get();
+  }
+
+  arrow::Result<uint8_t*> AllocateSmall(int c) {
+    Shard* shard = LocalShard();
+    if (FreeBlock* block = shard->free[c]) {
+      shard->free[c] = block->next;
+      return reinterpret_cast<uint8_t*>(block);
+    }
+    const int64_t bytes = int64_t(1) << (kMinClassShift + c);
+    if (shard->end - shard->cursor < bytes) {
+      // whatever is left of the old chunk is abandoned until Release
+      uint8_t* chunk;
+      ARROW_RETURN_NOT_OK(
+          options_.backing->Allocate(options_.chunk_bytes, &chunk));
+      shard->chunks.push_back(chunk);
+      shard->cursor = chunk;
+      shard->end = chunk + options_.chunk_bytes;
+      chunk_bytes_.fetch_add(options_.chunk_bytes, std::memory_order_relaxed);
+    }
+    uint8_t* out = shard->cursor;
+    shard->cursor += bytes;
+    return out;
+  }
+
+  void ReleaseAll() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& entry : shards_) {
+      for (uint8_t* chunk : entry.second->chunks) {
+        options_.backing->Free(chunk, options_.chunk_bytes);
+      }
+    }
+    shards_.clear();
+    chunk_bytes_ = 0;
+    // thread caches still point at the old shards; a new epoch misses them
+    epoch_ = NextEpoch();
+  }
+
+  ArenaOptions options_;
+  std::atomic<uint64_t> epoch_;
+  std::mutex mutex_;
+  std::unordered_map<std::thread::id, std::unique_ptr<Shard>> shards_;
+  std::atomic<int64_t> bytes_allocated_{0};
+  std::atomic<int64_t> max_memory_{0};
+  std::atomic<int64_t> total_bytes_allocated_{0};
+  std::atomic<int64_t> num_allocations_{0};
+  std::atomic<int64_t> chunk_bytes_{0};
+  std::atomic<int64_t> large_bytes_{0};
+};
+
+}  // namespace arena
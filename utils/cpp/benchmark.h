@@ -0,0 +1,177 @@
+// MIT License
+//
+// Copyright (c) 2021 Packt
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <utility>
+#include <vector>
+
+// A small header-only harness for microbenchmarks. Unlike timer.h this uses
+// a monotonic clock, runs warmup iterations before measuring and repeats the
+// measurement enough times to report a distribution instead of one number.
+namespace bench {
+
+using clock = std::chrono::steady_clock;
+
+// keep the compiler from optimizing away a result we never look at
+template <typename T>
+inline void DoNotOptimize(const T& value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+struct Options {
+  int warmup = 3;   // iterations run and thrown away before measuring
+  int trials = 25;  // measured iterations
+};
+
+struct Stats {
+  std::string name;
+  int64_t rows = 0;
+  int64_t bytes = 0;  // bytes touched per iteration (input + output)
+  int threads = 1;
+  int trials = 0;
+  double min = 0, mean = 0, median = 0, p95 = 0, p99 = 0, max = 0;  // seconds
+
+  double rows_per_sec() const { return median > 0 ? rows / median : 0; }
+  double bytes_per_sec() const { return median > 0 ? bytes / median : 0; }
+};
+
+// linear interpolation between the closest ranks, `sorted` must be ascending
+inline double Percentile(const std::vector<double>& sorted, double q) {
+  if (sorted.empty()) return 0;
+  const double rank = q * (sorted.size() - 1);
+  const size_t lo = static_cast<size_t>(rank);
+  const size_t hi = std::min(lo + 1, sorted.size() - 1);
+  return sorted[lo] + (rank - lo) * (sorted[hi] - sorted[lo]);
+}
+
+inline Stats Summarize(std::string name, int64_t rows, int64_t bytes,
+                       int threads, std::vector<double> samples) {
+  Stats s;
+  s.name = std::move(name);
+  s.rows = rows;
+  s.bytes = bytes;
+  s.threads = threads;
+  s.trials = static_cast<int>(samples.size());
+  if (samples.empty()) return s;
+
+  std::sort(samples.begin(), samples.end());
+  s.min = samples.front();
+  s.max = samples.back();
+  s.mean = std::accumulate(samples.begin(), samples.end(), 0.0) /
+           samples.size();
+  s.median = Percentile(samples, 0.5);
+  s.p95 = Percentile(samples, 0.95);
+  s.p99 = Percentile(samples, 0.99);
+  return s;
+}
+
+// Runs `fn` opts.warmup times, then opts.trials timed times. Whatever `fn`
+// returns is passed to DoNotOptimize so the work can't be elided.
+template <typename Fn>
+Stats Run(std::string name, int64_t rows, int64_t bytes, int threads,
+          const Options& opts, Fn&& fn) {
+  for (int i = 0; i < opts.warmup; ++i) {
+    auto result = fn();
+    DoNotOptimize(result);
+  }
+
+  std::vector<double> samples;
+  samples.reserve(opts.trials);
+  for (int i = 0; i < opts.trials; ++i) {
+    const auto start = clock::now();
+    auto result = fn();
+    DoNotOptimize(result);
+    samples.push_back(
+        std::chrono::duration<double>(clock::now() - start).count());
+  }
+  return Summarize(std::move(name), rows, bytes, threads, std::move(samples));
+}
+
+// Collects results and writes them out as JSON or CSV for later comparison.
+class Reporter {
+ public:
+  void Add(Stats s) {
+    Print(s);
+    results_.push_back(std::move(s));
+  }
+
+  const std::vector<Stats>& results() const { return results_; }
+
+  static void Print(const Stats& s) {
+    std::cout << std::left << std::setw(24) << s.name << " rows=" << s.rows
+              << " threads=" << s.threads << std::fixed << std::setprecision(1)
+              << " median=" << s.median * 1e6 << "us p95=" << s.p95 * 1e6
+              << "us p99=" << s.p99 * 1e6 << "us "
+              << s.rows_per_sec() / 1e6 << " Mrows/s "
+              << s.bytes_per_sec() / (1 << 20) << " MiB/s" << std::endl;
+    std::cout.unsetf(std::ios::floatfield);
+  }
+
+  bool WriteCsv(const std::string& path) const {
+    std::ofstream out(path);
+    if (!out) return false;
+    out << "name,rows,bytes,threads,trials,min_s,mean_s,median_s,p95_s,p99_s,"
+           "max_s,rows_per_s,bytes_per_s\n";
+    out << std::setprecision(9);
+    for (const auto& s : results_) {
+      out << s.name << ',' << s.rows << ',' << s.bytes << ',' << s.threads
+          << ',' << s.trials << ',' << s.min << ',' << s.mean << ','
+          << s.median << ',' << s.p95 << ',' << s.p99 << ',' << s.max << ','
+          << s.rows_per_sec() << ',' << s.bytes_per_sec() << '\n';
+    }
+    return static_cast<bool>(out);
+  }
+
+  bool WriteJson(const std::string& path) const {
+    std::ofstream out(path);
+    if (!out) return false;
+    out << std::setprecision(9) << "[\n";
+    for (size_t i = 0; i < results_.size(); ++i) {
+      const auto& s = results_[i];
+      out << "  {\"name\": \"" << s.name << "\", \"rows\": " << s.rows
+          << ", \"bytes\": " << s.bytes << ", \"threads\": " << s.threads
+          << ", \"trials\": " << s.trials << ", \"min_s\": " << s.min
+          << ", \"mean_s\": " << s.mean << ", \"median_s\": " << s.median
+          << ", \"p95_s\": " << s.p95 << ", \"p99_s\": " << s.p99
+          << ", \"max_s\": " << s.max
+          << ", \"rows_per_s\": " << s.rows_per_sec()
+          << ", \"bytes_per_s\": " << s.bytes_per_sec() << "}"
+          << (i + 1 < results_.size() ? ",\n" : "\n");
+    }
+    out << "]\n";
+    return static_cast<bool>(out);
+  }
+
+ private:
+  std::vector<Stats> results_;
+};
+
+}  // namespace bench
@@ -0,0 +1,301 @@
+// MIT License
+//
+// Copyright (c) 2021 Packt
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <arrow/api.h>
+#include <arrow/util/bit_util.h>
+#include <arrow/util/parallel.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Synthetic data from a schema description, for benchmarks that shouldn't
+// depend on a bucket being reachable. Every column is generated straight
+// into its Arrow buffers, no builders, and batches are generated in
+// parallel on the CPU thread pool. Batch i of a generator with a given
+// seed is the same on every run and every machine, whatever the thread
+// count, since each (batch, column) pair draws from its own seeded stream.
+//
+//   datagen::Generator gen({{"fare", arrow::float64(), datagen::kNormal,
+//                            12.5, 4.0}},
+//                          /*seed=*/42);
+//   ARROW_ASSIGN_OR_RAISE(auto table, gen.MakeTable(1 << 24, 1 << 20));
+namespace datagen {
+
+enum Distribution {
+  kUniform,     // in [a, b)
+  kNormal,      // mean a, standard deviation b
+  kSkewed,      // like kUniform, but mass piles up near a; b - a is scaled
+                // by u^skew
+  kSequential,  // a + b * row, rows counted across batches
+};
+
+struct ColumnSpec {
+  std::string name;
+  std::shared_ptr<arrow::DataType> type;
+  Distribution distribution = kUniform;
+  double a = 0, b = 1;
+  double skew = 3;  // kSkewed only
+  // > 0 draws from this many distinct values spread over the range; strings
+  // always come from a vocabulary, `values` or "<name>_<k>"
+  int64_t cardinality = 0;
+  std::vector<std::string> values;
+  double null_rate = 0;
+  // 0 is random order, 1 sorted within each batch; in between, sorted and
+  // then that fraction of rows left in place, the rest swapped randomly
+  double sortedness = 0;
+};
+
+// splitmix64: tiny, fast and good enough for test data
+struct Rng {
+  uint64_t state;
+
+  explicit Rng(uint64_t seed) : state(seed) {}
+
+  uint64_t Next() {
+    uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+  }
+
+  double Uniform() { return (Next() >> 11) * 0x1.0p-53; }  // [0, 1)
+
+  double Normal() {
+    // Box-Muller, one of the pair is enough here
+    double u = Uniform(), v = Uniform();
+    return std::sqrt(-2 * std::log1p(-u)) * std::cos(2 * M_PI * v);
+  }
+};
+
+class Generator {
+ public:
+  Generator(std::vector<ColumnSpec> columns, uint64_t seed)
+      : columns_(std::move(columns)), seed_(seed) {
+    arrow::FieldVector fields;
+    for (auto& column : columns_) {
+      fields.push_back(
+          arrow::field(column.name, column.type, column.null_rate > 0));
+      if (column.type->id() == arrow::Type::STRING && column.values.empty()) {
+        auto n = std::max<int64_t>(column.cardinality, 1);
+        for (int64_t k = 0; k < n; ++k) {
+          column.values.push_back(column.name + "_" + std::to_string(k));
+        }
+      }
+    }
+    schema_ = arrow::schema(std::move(fields));
+  }
+
+  const std::shared_ptr<arrow::Schema>& schema() const { return schema_; }
+
+  // batch `index` of `rows` rows; rows before it are assumed to be
+  // index * rows, which is what kSequential counts from
+  arrow::Result<std::shared_ptr<arrow::RecordBatch>> MakeBatch(
+      int64_t index, int64_t rows) const {
+    arrow::ArrayVector arrays;
+    for (size_t c = 0; c < columns_.size(); ++c) {
+      Rng rng(Seed(index, c));
+      ARROW_ASSIGN_OR_RAISE(auto array,
+                            MakeColumn(columns_[c], rows, index * rows, &rng));
+      arrays.push_back(std::move(array));
+    }
+    return arrow::RecordBatch::Make(schema_, rows, std::move(arrays));
+  }
+
+  // `rows` rows in batches of batch_rows, generated in parallel
+  arrow::Result<arrow::RecordBatchVector> MakeBatches(
+      int64_t rows, int64_t batch_rows) const {
+    const int64_t n = (rows + batch_rows - 1) / batch_rows;
+    arrow::RecordBatchVector batches(n);
+    ARROW_RETURN_NOT_OK(arrow::internal::ParallelFor(
+        static_cast<int>(n), [&](int i) -> arrow::Status {
+          int64_t length = std::min(batch_rows, rows - i * batch_rows);
+          ARROW_ASSIGN_OR_RAISE(batches[i], MakeBatch(i, batch_rows));
+          if (length < batch_rows) batches[i] = batches[i]->Slice(0, length);
+          return arrow::Status::OK();
+        }));
+    return batches;
+  }
+
+  arrow::Result<std::shared_ptr<arrow::Table>> MakeTable(
+      int64_t rows, int64_t batch_rows) const {
+    ARROW_ASSIGN_OR_RAISE(auto batches, MakeBatches(rows, batch_rows));
+    return arrow::Table::FromRecordBatches(schema_, batches);
+  }
+
+ private:
+  uint64_t Seed(int64_t batch, size_t column) const {
+    Rng mix(seed_ ^ (static_cast<uint64_t>(batch) * 0x100000001b3ULL));
+    for (size_t i = 0; i <= column; ++i) mix.Next();
+    return mix.Next();
+  }
+
+  static double Draw(const ColumnSpec& spec, int64_t row, Rng* rng) {
+    if (spec.cardinality > 0 && spec.distribution != kSequential) {
+      double u = spec.distribution == kSkewed
+                     ? std::pow(rng->Uniform(), spec.skew)
+                     : rng->Uniform();
+      auto k = static_cast<int64_t>(u * spec.cardinality);
+      double step = spec.cardinality > 1
+                        ? (spec.b - spec.a) / (spec.cardinality - 1)
+                        : 0;
+      return spec.a + k * step;
+    }
+    switch (spec.distribution) {
+      case kNormal:
+        return spec.a + spec.b * rng->Normal();
+      case kSkewed:
+        return spec.a + (spec.b - spec.a) * std::pow(rng->Uniform(), spec.skew);
+      case kSequential:
+        return spec.a + spec.b * row;
+      default:
+        return spec.a + (spec.b - spec.a) * rng->Uniform();
+    }
+  }
+
+  // sorts, then scatters the unsorted fraction
+  template <typename T>
+  static void Arrange(const ColumnSpec& spec, T* values, int64_t rows,
+                      Rng* rng) {
+    if (spec.sortedness <= 0 || rows < 2) return;
+    std::sort(values, values + rows);
+    auto swaps = static_cast<int64_t>((1 - spec.sortedness) * rows / 2);
+    for (int64_t i = 0; i < swaps; ++i) {
+      std::swap(values[rng->Next() % rows], values[rng->Next() % rows]);
+    }
+  }
+
+  template <typename T>
+  static arrow::Result<std::shared_ptr<arrow::Buffer>> Values(
+      const ColumnSpec& spec, int64_t rows, int64_t row0, Rng* rng) {
+    ARROW_ASSIGN_OR_RAISE(auto buffer, arrow::AllocateBuffer(rows * sizeof(T)));
+    auto* out = reinterpret_cast<T*>(buffer->mutable_data());
+    for (int64_t i = 0; i < rows; ++i) {
+      double v = Draw(spec, row0 + i, rng);
+      out[i] = std::is_integral<T>::value ? static_cast<T>(std::llround(v))
+                                          : static_cast<T>(v);
+    }
+    Arrange(spec, out, rows, rng);
+    return std::shared_ptr<arrow::Buffer>(std::move(buffer));
+  }
+
+  static arrow::Result<std::shared_ptr<arrow::Buffer>> Validity(
+      const ColumnSpec& spec, int64_t rows, Rng* rng, int64_t* null_count) {
+    *null_count = 0;
+    if (spec.null_rate <= 0) return std::shared_ptr<arrow::Buffer>();
+    ARROW_ASSIGN_OR_RAISE(auto bitmap, arrow::AllocateEmptyBitmap(rows));
+    for (int64_t i = 0; i < rows; ++i) {
+      if (rng->Uniform() >= spec.null_rate) {
+        arrow::bit_util::SetBit(bitmap->mutable_data(), i);
+      } else {
+        ++*null_count;
+      }
+    }
+    return std::shared_ptr<arrow::Buffer>(std::move(bitmap));
+  }
+
+  static arrow::Result<std::shared_ptr<arrow::Array>> Strings(
+      const ColumnSpec& spec, int64_t rows, Rng* rng,
+      std::shared_ptr<arrow::Buffer> validity, int64_t null_count) {
+    std::vector<int32_t> picks(rows);
+    const auto n = static_cast<int64_t>(spec.values.size());
+    for (auto& pick : picks) {
+      double u = spec.distribution == kSkewed
+                     ? std::pow(rng->Uniform(), spec.skew)
+                     : rng->Uniform();
+      pick = static_cast<int32_t>(std::min<int64_t>(u * n, n - 1));
+    }
+    Arrange(spec, picks.data(), rows, rng);
+
+    ARROW_ASSIGN_OR_RAISE(auto offsets,
+                          arrow::AllocateBuffer((rows + 1) * sizeof(int32_t)));
+    auto* out = reinterpret_cast<int32_t*>(offsets->mutable_data());
+    int64_t total = 0;
+    for (int64_t i = 0; i < rows; ++i) {
+      out[i] = static_cast<int32_t>(total);
+      total += spec.values[picks[i]].size();
+    }
+    out[rows] = static_cast<int32_t>(total);
+    ARROW_ASSIGN_OR_RAISE(auto data, arrow::AllocateBuffer(total));
+    auto* chars = data->mutable_data();
+    for (int64_t i = 0; i < rows; ++i) {
+      const auto& value = spec.values[picks[i]];
+      std::memcpy(chars + out[i], value.data(), value.size());
+    }
+    return arrow::MakeArray(arrow::ArrayData::Make(
+        spec.type, rows,
+        {std::move(validity), std::move(offsets), std::move(data)},
+        null_count));
+  }
+
+  static arrow::Result<std::shared_ptr<arrow::Array>> MakeColumn(
+      const ColumnSpec& spec, int64_t rows, int64_t row0, Rng* rng) {
+    int64_t null_count;
+    ARROW_ASSIGN_OR_RAISE(auto validity,
+                          Validity(spec, rows, rng, &null_count));
+    if (spec.type->id() == arrow::Type::STRING) {
+      return Strings(spec, rows, rng, std::move(validity), null_count);
+    }
+    std::shared_ptr<arrow::Buffer> values;
+    switch (spec.type->id()) {
+      case arrow::Type::INT8:
+        ARROW_ASSIGN_OR_RAISE(values, Values<int8_t>(spec, rows, row0, rng));
+        break;
+      case arrow::Type::INT16:
+        ARROW_ASSIGN_OR_RAISE(values, Values<int16_t>(spec, rows, row0, rng));
+        break;
+      case arrow::Type::INT32:
+      case arrow::Type::DATE32:
+        ARROW_ASSIGN_OR_RAISE(values, Values<int32_t>(spec, rows, row0, rng));
+        break;
+      case arrow::Type::INT64:
+      case arrow::Type::TIMESTAMP:
+        ARROW_ASSIGN_OR_RAISE(values, Values<int64_t>(spec, rows, row0, rng));
+        break;
+      case arrow::Type::FLOAT:
+        ARROW_ASSIGN_OR_RAISE(values, Values<float>(spec, rows, row0, rng));
+        break;
+      case arrow::Type::DOUBLE:
+        ARROW_ASSIGN_OR_RAISE(values, Values<double>(spec, rows, row0, rng));
+        break;
+      default:
+        return arrow::Status::NotImplemented("can't generate ",
+                                             spec.type->ToString());
+    }
+    return arrow::MakeArray(arrow::ArrayData::Make(
+        spec.type, rows, {std::move(validity), std::move(values)},
+        null_count));
+  }
+
+  std::vector<ColumnSpec> columns_;
+  uint64_t seed_;
+  std::shared_ptr<arrow::Schema> schema_;
+};
+
+}  // namespace datagen
@@ -0,0 +1,253 @@
+// MIT License
+//
+// Copyright (c) 2021 Packt
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <arrow/api.h>
+#include <arrow/io/api.h>
+#include <arrow/util/future.h>
+#include <arrow/util/thread_pool.h>
+#include <parquet/arrow/reader.h>
+#include <parquet/arrow/schema.h>
+#include <parquet/file_reader.h>
+#include <parquet/metadata.h>
+#include <parquet/properties.h>
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Streams a Parquet file as RecordBatches instead of ReadTable'ing all of
+// it. Row groups are decoded ahead of the consumer in file order, each
+// with pre-buffered, coalesced column chunk reads and its columns decoded
+// in parallel on the CPU thread pool. Decoding runs ahead only while the
+// row groups decoded or in flight but not yet handed out fit in
+// readahead_bytes (always at least one), counted as their uncompressed
+// column chunk sizes, so memory stays bounded however large the file is.
+//
+//   pqstream::StreamOptions options;
+//   options.columns = {"total_amount"};
+//   ARROW_ASSIGN_OR_RAISE(auto reader,
+//                         pqstream::ParquetStreamReader::Open(path, options));
+//   // reader->ReadNext(&batch) until batch is null
+namespace pqstream {
+
+struct StreamOptions {
+  std::vector<int> row_groups;  // empty means all
+  std::vector<std::string> columns;  // top-level names, empty means all
+  int64_t batch_size = 64 * 1024;
+  int64_t readahead_bytes = int64_t(256) << 20;
+  bool pre_buffer = true;
+  bool use_threads = true;  // decode the columns of a row group in parallel
+  arrow::MemoryPool* pool = arrow::default_memory_pool();
+};
+
+struct StreamStats {
+  int64_t row_groups = 0;
+  int64_t rows = 0;
+  int64_t buffered_high_water = 0;  // estimated bytes decoded or in flight
+};
+
+class ParquetStreamReader : public arrow::RecordBatchReader {
+ public:
+  static arrow::Result<std::shared_ptr<ParquetStreamReader>> Open(
+      const std::string& path, const StreamOptions& options) {
+    ARROW_ASSIGN_OR_RAISE(auto file, arrow::io::ReadableFile::Open(path));
+    return Open(std::move(file), options);
+  }
+
+  static arrow::Result<std::shared_ptr<ParquetStreamReader>> Open(
+      std::shared_ptr<arrow::io::RandomAccessFile> file,
+      const StreamOptions& options) {
+    parquet::ArrowReaderProperties properties(options.use_threads);
+    properties.set_pre_buffer(options.pre_buffer);
+    properties.set_batch_size(options.batch_size);
+    parquet::arrow::FileReaderBuilder builder;
+    ARROW_RETURN_NOT_OK(builder.Open(std::move(file)));
+    std::unique_ptr<parquet::arrow::FileReader> file_reader;
+    ARROW_RETURN_NOT_OK(builder.memory_pool(options.pool)
+                            ->properties(properties)
+                            ->Build(&file_reader));
+
+    std::shared_ptr<ParquetStreamReader> reader(
+        new ParquetStreamReader(options));
+    reader->file_reader_ = std::move(file_reader);
+    ARROW_RETURN_NOT_OK(reader->Init());
+    return reader;
+  }
+
+  ~ParquetStreamReader() override {
+    // the decode thread still uses the FileReader
+    for (auto& pending : in_flight_) pending.future.Wait();
+  }
+
+  std::shared_ptr<arrow::Schema> schema() const override { return schema_; }
+
+  const StreamStats& stats() const { return stats_; }
+
+  arrow::Status ReadNext(std::shared_ptr<arrow::RecordBatch>* batch) override {
+    while (true) {
+      if (current_) {
+        ARROW_RETURN_NOT_OK(current_->ReadNext(batch));
+        if (*batch != nullptr) {
+          stats_.rows += (*batch)->num_rows();
+          return arrow::Status::OK();
+        }
+        current_.reset();
+        current_table_.reset();
+        buffered_ -= current_bytes_;
+        current_bytes_ = 0;
+      }
+      ARROW_RETURN_NOT_OK(Fill());
+      if (in_flight_.empty()) {
+        *batch = nullptr;
+        return arrow::Status::OK();
+      }
+      auto next = std::move(in_flight_.front());
+      in_flight_.pop_front();
+      ARROW_ASSIGN_OR_RAISE(current_table_, next.future.result());
+      current_bytes_ = next.bytes;
+      ++stats_.row_groups;
+      current_ = std::make_shared<arrow::TableBatchReader>(*current_table_);
+      current_->set_chunksize(options_.batch_size);
+      // the next row groups decode while this one is consumed
+      ARROW_RETURN_NOT_OK(Fill());
+    }
+  }
+
+ private:
+  struct Pending {
+    arrow::Future<std::shared_ptr<arrow::Table>> future;
+    int64_t bytes = 0;
+  };
+
+  explicit ParquetStreamReader(const StreamOptions& options)
+      : options_(options) {}
+
+  arrow::Status Init() {
+    const auto& manifest = file_reader_->manifest();
+    std::shared_ptr<arrow::Schema> file_schema;
+    ARROW_RETURN_NOT_OK(file_reader_->GetSchema(&file_schema));
+
+    std::vector<int> fields;
+    if (options_.columns.empty()) {
+      for (int i = 0; i < file_schema->num_fields(); ++i) fields.push_back(i);
+    } else {
+      for (const auto& name : options_.columns) {
+        auto i = file_schema->GetFieldIndex(name);
+        if (i < 0) {
+          return arrow::Status::KeyError("no column ", name, " in file");
+        }
+        fields.push_back(i);
+      }
+    }
+    arrow::FieldVector selected;
+    for (int i : fields) {
+      selected.push_back(file_schema->field(i));
+      AddLeaves(manifest.schema_fields[i]);
+    }
+    schema_ = arrow::schema(std::move(selected));
+
+    auto metadata = file_reader_->parquet_reader()->metadata();
+    if (options_.row_groups.empty()) {
+      for (int i = 0; i < metadata->num_row_groups(); ++i) {
+        pending_.push_back(i);
+      }
+    } else {
+      pending_.assign(options_.row_groups.begin(), options_.row_groups.end());
+    }
+    for (int row_group : pending_) {
+      if (row_group < 0 || row_group >= metadata->num_row_groups()) {
+        return arrow::Status::IndexError("no row group ", row_group);
+      }
+    }
+
+    // one thread: a FileReader must not be used by two threads at once,
+    // the columns are still decoded in parallel on the CPU pool
+    ARROW_ASSIGN_OR_RAISE(decoder_, arrow::internal::ThreadPool::Make(1));
+    return arrow::Status::OK();
+  }
+
+  void AddLeaves(const parquet::arrow::SchemaField& field) {
+    if (field.is_leaf()) {
+      leaves_.push_back(field.column_index);
+      return;
+    }
+    for (const auto& child : field.children) AddLeaves(child);
+  }
+
+  int64_t RowGroupBytes(int row_group) const {
+    auto metadata =
+        file_reader_->parquet_reader()->metadata()->RowGroup(row_group);
+    int64_t bytes = 0;
+    for (int leaf : leaves_) {
+      bytes += metadata->ColumnChunk(leaf)->total_uncompressed_size();
+    }
+    return bytes;
+  }
+
+  // submits row groups while they fit in the readahead budget
+  arrow::Status Fill() {
+    while (!pending_.empty()) {
+      int row_group = pending_.front();
+      int64_t bytes = RowGroupBytes(row_group);
+      bool idle = in_flight_.empty() && !current_;
+      if (!idle && buffered_ + bytes > options_.readahead_bytes) break;
+      pending_.pop_front();
+
+      auto file_reader = file_reader_;
+      auto leaves = leaves_;
+      ARROW_ASSIGN_OR_RAISE(
+          auto future,
+          decoder_->Submit(
+              [file_reader, leaves,
+               row_group]() -> arrow::Result<std::shared_ptr<arrow::Table>> {
+                std::shared_ptr<arrow::Table> table;
+                ARROW_RETURN_NOT_OK(
+                    file_reader->ReadRowGroups({row_group}, leaves, &table));
+                return table;
+              }));
+      in_flight_.push_back({std::move(future), bytes});
+      buffered_ += bytes;
+      stats_.buffered_high_water =
+          std::max(stats_.buffered_high_water, buffered_);
+    }
+    return arrow::Status::OK();
+  }
+
+  const StreamOptions options_;
+  std::shared_ptr<parquet::arrow::FileReader> file_reader_;
+  std::shared_ptr<arrow::internal::ThreadPool> decoder_;
+  std::shared_ptr<arrow::Schema> schema_;
+  std::vector<int> leaves_;
+  std::deque<int> pending_;
+  std::deque<Pending> in_flight_;
+  std::shared_ptr<arrow::Table> current_table_;
+  std::shared_ptr<arrow::TableBatchReader> current_;
+  int64_t current_bytes_ = 0;
+  int64_t buffered_ = 0;
+  StreamStats stats_;
+};
+
+}  // namespace pqstream
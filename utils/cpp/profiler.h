@@ -0,0 +1,274 @@
+// MIT License
+//
+// Copyright (c) 2021 Packt
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+// A header-only scoped profiler. Each thread records finished spans into its
+// own fixed size ring buffer without taking any locks, so it is cheap enough
+// to leave enabled around per-batch work on the thread pool. The collected
+// spans can be written out as a Chrome trace (chrome://tracing or
+// ui.perfetto.dev) or summarized per span name.
+//
+//   void scan() {
+//     PROFILE_SCOPE("scan");
+//     ...
+//   }
+//   prof::Profiler::Instance().WriteChromeTrace("trace.json");
+//
+// Span names must outlive the profiler, use string literals or
+// prof::Profiler::Instance().Intern() for names built at runtime.
+namespace prof {
+
+using clock = std::chrono::steady_clock;
+
+struct Event {
+  const char* name;
+  int64_t start_ns;
+  int64_t end_ns;
+  uint32_t depth;  // nesting level within the recording thread
+};
+
+class ThreadBuffer {
+ public:
+  static constexpr size_t kCapacity = 1 << 14;  // per thread, oldest dropped
+
+  ThreadBuffer(uint32_t tid, std::string name)
+      : tid_(tid), name_(std::move(name)), events_(kCapacity) {}
+
+  void Record(const Event& e) {
+    const uint64_t head = head_.load(std::memory_order_relaxed);
+    events_[head % kCapacity] = e;
+    head_.store(head + 1, std::memory_order_release);
+  }
+
+  // copy out the events still held by the ring, oldest first
+  std::vector<Event> Snapshot() const {
+    const uint64_t head = head_.load(std::memory_order_acquire);
+    const uint64_t begin = head > kCapacity ? head - kCapacity : 0;
+    std::vector<Event> out;
+    out.reserve(head - begin);
+    for (uint64_t i = begin; i < head; ++i) {
+      out.push_back(events_[i % kCapacity]);
+    }
+    return out;
+  }
+
+  uint64_t dropped() const {
+    const uint64_t head = head_.load(std::memory_order_acquire);
+    return head > kCapacity ? head - kCapacity : 0;
+  }
+
+  void Clear() { head_.store(0, std::memory_order_release); }
+
+  uint32_t tid() const { return tid_; }
+  const std::string& name() const { return name_; }
+
+  uint32_t depth = 0;  // only touched by the owning thread
+
+ private:
+  const uint32_t tid_;
+  const std::string name_;
+  std::vector<Event> events_;
+  std::atomic<uint64_t> head_{0};
+};
+
+class Profiler {
+ public:
+  static Profiler& Instance() {
+    static Profiler instance;
+    return instance;
+  }
+
+  bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+  void set_enabled(bool enabled) { enabled_.store(enabled); }
+
+  int64_t NowNanos() const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() -
+                                                                epoch_)
+        .count();
+  }
+
+  // The calling thread's buffer, registered the first time a thread records
+  // a span. Buffers are owned by the profiler so their spans survive the
+  // thread that recorded them.
+  ThreadBuffer* LocalBuffer() {
+    thread_local ThreadBuffer* buffer = nullptr;
+    if (buffer == nullptr) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      const auto tid = static_cast<uint32_t>(buffers_.size() + 1);
+      buffers_.push_back(
+          std::make_unique<ThreadBuffer>(tid, "thread " + std::to_string(tid)));
+      buffer = buffers_.back().get();
+    }
+    return buffer;
+  }
+
+  const char* Intern(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return names_.insert(name).first->c_str();
+  }
+
+  // Not synchronized with recording threads, call this (and the writers
+  // below) once the work being profiled has finished.
+  void Clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& b : buffers_) b->Clear();
+  }
+
+  bool WriteChromeTrace(const std::string& path) {
+    std::ofstream out(path);
+    if (!out) return false;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    bool first = true;
+    auto sep = [&]() -> std::ostream& {
+      if (!first) out << ",\n";
+      first = false;
+      return out;
+    };
+    out << std::fixed << std::setprecision(3);
+    for (const auto& b : buffers_) {
+      sep() << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, "
+               "\"tid\": "
+            << b->tid() << ", \"args\": {\"name\": \"" << b->name() << "\"}}";
+      for (const auto& e : b->Snapshot()) {
+        // complete events, timestamps and durations are in microseconds
+        sep() << "{\"name\": \"" << Escape(e.name)
+              << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << b->tid()
+              << ", \"ts\": " << e.start_ns / 1e3
+              << ", \"dur\": " << (e.end_ns - e.start_ns) / 1e3
+              << ", \"args\": {\"depth\": " << e.depth << "}}";
+      }
+    }
+    out << "\n]}\n";
+    return static_cast<bool>(out);
+  }
+
+  // total, count and thread count per span name, sorted by name
+  void PrintSummary(std::ostream& os = std::cout) {
+    struct Totals {
+      int64_t count = 0;
+      int64_t total_ns = 0;
+      std::set<uint32_t> threads;
+    };
+    std::map<std::string, Totals> totals;
+    uint64_t dropped = 0;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (const auto& b : buffers_) {
+        dropped += b->dropped();
+        for (const auto& e : b->Snapshot()) {
+          auto& t = totals[e.name];
+          ++t.count;
+          t.total_ns += e.end_ns - e.start_ns;
+          t.threads.insert(b->tid());
+        }
+      }
+    }
+
+    os << std::left << std::setw(32) << "span" << std::right << std::setw(10)
+       << "count" << std::setw(14) << "total ms" << std::setw(14) << "mean ms"
+       << std::setw(10) << "threads" << std::endl;
+    os << std::fixed << std::setprecision(3);
+    for (const auto& entry : totals) {
+      const auto& t = entry.second;
+      os << std::left << std::setw(32) << entry.first << std::right
+         << std::setw(10) << t.count << std::setw(14) << t.total_ns / 1e6
+         << std::setw(14) << t.total_ns / 1e6 / t.count << std::setw(10)
+         << t.threads.size() << std::endl;
+    }
+    os.unsetf(std::ios::floatfield);
+    if (dropped > 0) {
+      os << dropped << " spans were dropped from full ring buffers"
+         << std::endl;
+    }
+  }
+
+ private:
+  Profiler() : epoch_{clock::now()} {}
+
+  static std::string Escape(const char* s) {
+    std::string out;
+    for (; *s; ++s) {
+      if (*s == '"' || *s == '\\') out.push_back('\\');
+      out.push_back(*s);
+    }
+    return out;
+  }
+
+  const clock::time_point epoch_;
+  std::atomic<bool> enabled_{true};
+  std::mutex mutex_;
+  std::vector<std::unique_ptr<ThreadBuffer>> buffers_;
+  std::set<std::string> names_;
+};
+
+// Records one span from construction to destruction on the current thread.
+// Spans opened while another is active on the same thread nest inside it.
+class ScopedSpan {
+ public:
+  explicit ScopedSpan(const char* name) : name_(name) {
+    auto& profiler = Profiler::Instance();
+    if (!profiler.enabled()) return;
+    buffer_ = profiler.LocalBuffer();
+    depth_ = buffer_->depth++;
+    start_ns_ = profiler.NowNanos();
+  }
+
+  ~ScopedSpan() {
+    if (buffer_ == nullptr) return;
+    buffer_->Record(
+        Event{name_, start_ns_, Profiler::Instance().NowNanos(), depth_});
+    --buffer_->depth;
+  }
+
+  ScopedSpan(const ScopedSpan&) = delete;
+  ScopedSpan& operator=(const ScopedSpan&) = delete;
+
+ private:
+  const char* name_;
+  ThreadBuffer* buffer_ = nullptr;
+  int64_t start_ns_ = 0;
+  uint32_t depth_ = 0;
+};
+
+}  // namespace prof
+
+#define PROF_CONCAT_INNER(a, b) a##b
+#define PROF_CONCAT(a, b) PROF_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) \
+  prof::ScopedSpan PROF_CONCAT(prof_span_, __LINE__) { name }
@@ -0,0 +1,306 @@
+// MIT License
+//
+// Copyright (c) 2021 Packt
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <arrow/api.h>
+#include <arrow/dataset/api.h>
+#include <arrow/util/bit_run_reader.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+
+// Per-thread partial aggregates for Scanner::Scan callbacks. Every scan
+// thread folds its batches into its own cache line padded accumulator, so
+// nothing is shared while scanning; the partials are merged once at the
+// end.
+//
+//   reduce::PerThread<reduce::Moments> moments;
+//   ABORT_ON_FAIL(scanner->Scan(moments.Visitor(
+//       [](reduce::Moments& local, const arrow::RecordBatch& batch) {
+//         return local.Update(*batch.GetColumnByName("fare_amount"));
+//       })));
+//   auto total = moments.Merge();  // total.mean(), total.variance(), ...
+//
+// An accumulator is anything default constructible with a Merge(const&).
+namespace reduce {
+
+// Neumaier's variant of Kahan summation, also right when the next term is
+// larger than the running sum
+struct KahanSum {
+  double sum = 0;
+  double compensation = 0;
+
+  void Add(double value) {
+    double t = sum + value;
+    if (std::abs(sum) >= std::abs(value)) {
+      compensation += (sum - t) + value;
+    } else {
+      compensation += (value - t) + sum;
+    }
+    sum = t;
+  }
+  void Merge(const KahanSum& other) {
+    Add(other.sum);
+    compensation += other.compensation;
+  }
+  double value() const { return sum + compensation; }
+};
+
+// Pairwise summation, error grows with log(n) instead of n. The leaves are
+// plain loops the compiler can vectorize.
+template <typename T, typename F>
+double PairwiseSum(const T* values, int64_t n, F&& transform) {
+  constexpr int64_t kLeaf = 128;
+  if (n <= kLeaf) {
+    double sum = 0;
+    for (int64_t i = 0; i < n; ++i) sum += transform(values[i]);
+    return sum;
+  }
+  int64_t half = (n / 2 + kLeaf - 1) / kLeaf * kLeaf;
+  return PairwiseSum(values, half, transform) +
+         PairwiseSum(values + half, n - half, transform);
+}
+
+namespace internal {
+
+template <typename ArrowType, typename F>
+void VisitRuns(const arrow::Array& array, F& f) {
+  using c_type = typename ArrowType::c_type;
+  const auto* values = array.data()->GetValues<c_type>(1);
+  if (array.null_count() == 0) {
+    f(values, array.length());
+    return;
+  }
+  arrow::internal::VisitSetBitRunsVoid(
+      array.null_bitmap_data(), array.offset(), array.length(),
+      [&](int64_t position, int64_t length) { f(values + position, length); });
+}
+
+}  // namespace internal
+
+// Calls f(const c_type* values, int64_t n) on each run of valid values of a
+// numeric column; what names the aggregate in the error for other types.
+template <typename F>
+arrow::Status VisitValidRuns(const arrow::Array& array, const char* what,
+                             F&& f) {
+  switch (array.type_id()) {
+    case arrow::Type::INT8:
+      internal::VisitRuns<arrow::Int8Type>(array, f);
+      break;
+    case arrow::Type::INT16:
+      internal::VisitRuns<arrow::Int16Type>(array, f);
+      break;
+    case arrow::Type::INT32:
+      internal::VisitRuns<arrow::Int32Type>(array, f);
+      break;
+    case arrow::Type::INT64:
+      internal::VisitRuns<arrow::Int64Type>(array, f);
+      break;
+    case arrow::Type::UINT8:
+      internal::VisitRuns<arrow::UInt8Type>(array, f);
+      break;
+    case arrow::Type::UINT16:
+      internal::VisitRuns<arrow::UInt16Type>(array, f);
+      break;
+    case arrow::Type::UINT32:
+      internal::VisitRuns<arrow::UInt32Type>(array, f);
+      break;
+    case arrow::Type::UINT64:
+      internal::VisitRuns<arrow::UInt64Type>(array, f);
+      break;
+    case arrow::Type::FLOAT:
+      internal::VisitRuns<arrow::FloatType>(array, f);
+      break;
+    case arrow::Type::DOUBLE:
+      internal::VisitRuns<arrow::DoubleType>(array, f);
+      break;
+    default:
+      return arrow::Status::TypeError("no ", what, " for ",
+                                      array.type()->ToString());
+  }
+  return arrow::Status::OK();
+}
+
+// count, sum, mean, variance, min and max of a numeric column. Each run of
+// valid values gets a pairwise two pass mean and sum of squared deviations,
+// runs and partials are combined with Chan et al.'s parallel update.
+struct Moments {
+  int64_t count = 0;
+  double mean = 0;
+  double m2 = 0;  // sum of squared deviations from the mean
+  KahanSum sum;
+  double min = std::numeric_limits<double>::infinity();
+  double max = -std::numeric_limits<double>::infinity();
+
+  double variance() const { return count > 1 ? m2 / (count - 1) : NAN; }
+  double population_variance() const { return count > 0 ? m2 / count : NAN; }
+  double stddev() const { return std::sqrt(variance()); }
+
+  template <typename T>
+  void Update(const T* values, int64_t n) {
+    if (n == 0) return;
+    double run_sum = PairwiseSum(values, n, [](T v) { return double(v); });
+    double run_mean = run_sum / n;
+    double run_m2 = PairwiseSum(values, n, [run_mean](T v) {
+      double d = double(v) - run_mean;
+      return d * d;
+    });
+    auto bounds = std::minmax_element(values, values + n);
+    Combine(n, run_mean, run_m2, run_sum, double(*bounds.first),
+            double(*bounds.second));
+  }
+
+  // null slots are skipped
+  arrow::Status Update(const arrow::Array& array) {
+    return VisitValidRuns(array, "moments",
+                          [this](const auto* values, int64_t n) {
+                            Update(values, n);
+                          });
+  }
+
+  void Merge(const Moments& other) {
+    Combine(other.count, other.mean, other.m2, 0, other.min, other.max);
+    sum.Merge(other.sum);
+  }
+
+ private:
+  void Combine(int64_t n, double other_mean, double other_m2,
+               double other_sum, double other_min, double other_max) {
+    if (n == 0) return;
+    auto total = count + n;
+    double delta = other_mean - mean;
+    mean += delta * n / total;
+    m2 += other_m2 + delta * delta * (double(count) * n / total);
+    count = total;
+    sum.Add(other_sum);
+    min = std::min(min, other_min);
+    max = std::max(max, other_max);
+  }
+};
+
+// What compute_mean used to keep in two atomics. One pairwise pass per run
+// of valid values, none of the second pass or min/max Moments pays for.
+struct SumCount {
+  KahanSum sum;
+  int64_t count = 0;
+
+  // null slots are skipped
+  arrow::Status Update(const arrow::Array& array) {
+    return VisitValidRuns(array, "sum", [this](const auto* values, int64_t n) {
+      sum.Add(PairwiseSum(values, n, [](auto v) { return double(v); }));
+      count += n;
+    });
+  }
+  void Merge(const SumCount& other) {
+    sum.Merge(other.sum);
+    count += other.count;
+  }
+  double mean() const { return count > 0 ? sum.value() / count : NAN; }
+};
+
+// A small dense index per thread, handed out the first time it's asked for.
+inline int ThreadIndex() {
+  static std::atomic<int> next{0};
+  thread_local int index = next++;
+  return index;
+}
+
+// One padded accumulator per thread. The slot mutex is only ever contended
+// when more than kMaxSlots threads have scanned in this process and two of
+// them wrap to the same slot, and is taken once per batch, not per row.
+template <typename Acc>
+class PerThread {
+ public:
+  static constexpr int kMaxSlots = 256;
+
+  PerThread() = default;
+  PerThread(const PerThread&) = delete;
+  PerThread& operator=(const PerThread&) = delete;
+  ~PerThread() {
+    for (auto& slot : slots_) delete slot.load();
+  }
+
+  // Runs f on this thread's accumulator.
+  template <typename F>
+  auto With(F&& f) -> decltype(f(std::declval<Acc&>())) {
+    auto& slot = LocalSlot();
+    std::lock_guard<std::mutex> lock(slot.mutex);
+    return f(slot.acc);
+  }
+
+  // A Scanner::Scan visitor calling f(Acc&, const RecordBatch&) -> Status.
+  template <typename F>
+  std::function<arrow::Status(arrow::dataset::TaggedRecordBatch)> Visitor(
+      F f) {
+    return [this, f](arrow::dataset::TaggedRecordBatch batch) {
+      return With([&](Acc& local) { return f(local, *batch.record_batch); });
+    };
+  }
+
+  // All partials merged, call once the scan is done.
+  Acc Merge() const {
+    Acc total;
+    for (const auto& slot : slots_) {
+      if (auto* s = slot.load()) total.Merge(s->acc);
+    }
+    return total;
+  }
+
+  int threads_seen() const {
+    int seen = 0;
+    for (const auto& slot : slots_) seen += slot.load() != nullptr;
+    return seen;
+  }
+
+ private:
+  struct alignas(64) Slot {
+    std::mutex mutex;
+    Acc acc;
+  };
+
+  Slot& LocalSlot() {
+    auto& entry = slots_[ThreadIndex() % kMaxSlots];
+    auto* slot = entry.load(std::memory_order_acquire);
+    if (slot == nullptr) {
+      auto* fresh = new Slot();
+      if (entry.compare_exchange_strong(slot, fresh,
+                                        std::memory_order_acq_rel)) {
+        slot = fresh;
+      } else {
+        delete fresh;  // another thread wrapped to the same slot first
+      }
+    }
+    return *slot;
+  }
+
+  std::array<std::atomic<Slot*>, kMaxSlots> slots_{};
+};
+
+}  // namespace reduce